@@ -3,4 +3,7 @@
 #define SAFE_DELETE(x) {delete x;x=NULL;}
 #define SAFE_DELETEA(x) {delete[] x;x=NULL;}
 
+// コンパイラのバージョン (キャッシュのキーに使用)
+#define DCC_VERSION "dcc-0.2.0"
+
 #endif
@@ -1,11 +1,18 @@
 #ifndef AST_HPP
 #define AST_HPP
 
+#include <new>
 #include <string>
 #include <map>
+#include <utility>
 #include <vector>
+#include <stdint.h>
+#include <llvm/ADT/DenseSet.h>
+#include <llvm/Support/AlignOf.h>
+#include <llvm/Support/Allocator.h>
 #include <llvm/Support/Casting.h>
 #include "APP.hpp"
+#include "symbol.hpp"
 
 /*
  * クラス宣言
@@ -20,10 +27,9 @@ class BinaryExprAST;
 class NullExprAST;
 class CallExprAST;
 class ReturnStmtAST;
+class BlockAST;
 class IfStatementAST;
-class IfEndAST;
 class ForStatementAST;
-class ForEndAST;
 class ComparisonAST;
 class GlobalVariableAST;
 class VariableAST;
@@ -44,17 +50,58 @@ enum AstID{
 	CallExprID,     // 4
 	ReturnStmtID,   // 5
 	IfID,           // 6
-	IfEndID,        // 7
+	BlockID,        // 7
 	ForID,          // 8
-	ForEndID,       // 9
-	ComparisonID,   // 10
-	GlobalVariableID,//11
-	VariableID,     // 12
-	NumberID,       // 13
-	StringID,       // 14
-	BreakID,        // 15
-	ContinueID,     // 16
-	NewLineID       // 17
+	ComparisonID,   // 9
+	GlobalVariableID,//10
+	VariableID,     // 11
+	NumberID,       // 12
+	StringID,       // 13
+	BreakID,        // 14
+	ContinueID,     // 15
+	NewLineID       // 16
+};
+
+/**
+ * 二項演算子
+ */
+enum BinaryOp{
+	BOP_ASSIGN,    // =
+	BOP_ADD,       // +
+	BOP_SUB,       // -
+	BOP_MUL,       // *
+	BOP_DIV,       // /
+	BOP_FLOOR_DIV, // //
+	BOP_REM        // %
+};
+
+/**
+ * 比較演算子
+ */
+enum CompareOp{
+	CMP_EQ, // ==
+	CMP_NE, // !=
+	CMP_LT, // <
+	CMP_GT, // >
+	CMP_LE, // <=
+	CMP_GE  // >=
+};
+
+/**
+ * ifの種類
+ */
+enum IfKind{
+	IF_IF,      // if
+	IF_ELSE_IF, // else if
+	IF_ELSE     // else
+};
+
+/**
+ * 条件式の結合
+ */
+enum LogicalOp{
+	LOGICAL_AND, // and
+	LOGICAL_OR   // or
 };
 
 /**
@@ -69,17 +116,76 @@ class BaseAST{
 	AstID getValueID() const {return ID;}
 };
 
+/**
+ * ASTのノードを確保するアリーナ
+ * ノードはスラブに詰めて確保し、アリーナの破棄時にまとめてデストラクタを呼んで解放する
+ * ノードのデストラクタは子ノードを解放しないので、ノードを個別にdeleteしてはいけない
+ */
+class ASTArena{
+	typedef void (*Destructor)(void*);
+
+	llvm::BumpPtrAllocator Allocator;
+	std::vector<std::pair<void*, Destructor> > Nodes; // 確保した順
+	size_t BytesUsed;
+
+	template<typename T>
+	static void destroy(void *node){static_cast<T*>(node)->~T();}
+
+	ASTArena(const ASTArena&);
+	ASTArena &operator=(const ASTArena&);
+
+	public:
+		ASTArena() : BytesUsed(0){}
+		~ASTArena(){reset();}
+
+		// ノードを確保して構築する
+		template<typename T, typename... Args>
+		T *create(Args&&... args){
+			void *mem = Allocator.Allocate(sizeof(T), llvm::AlignOf<T>::Alignment);
+			T *node = new (mem) T(std::forward<Args>(args)...);
+			Nodes.push_back(std::make_pair(mem, &destroy<T>));
+			BytesUsed += sizeof(T);
+			return node;
+		}
+
+		void reset();
+
+		// 確保したノードの数を取得
+		size_t getNodeCount(){return Nodes.size();}
+
+		// ノードが使っているバイト数を取得
+		size_t getBytesUsed(){return BytesUsed;}
+
+		// スラブとして確保したバイト数を取得 (アリーナの最大使用量)
+		size_t getBytesReserved(){return Allocator.getTotalMemory();}
+};
+
 /**
  * ソースコードを表すAST
+ * 配下のノードは全てこのASTのアリーナから確保する
+ * (関数ごとに並列に解析した場合は、スレッドごとのアリーナも引き取る)
  */
 class TranslationUnitAST{
+	std::vector<ASTArena*> Arenas; // 0番目が自身のアリーナ
 	std::vector<PrototypeAST*> Prototypes;
 	std::vector<FunctionAST*> Functions;
 
 	public:
-		TranslationUnitAST(){}
+		TranslationUnitAST(){Arenas.push_back(new ASTArena());}
 		~TranslationUnitAST();
 
+		// ノードを確保するアリーナを取得する
+		ASTArena &getArena(){return *Arenas[0];}
+
+		// 別に確保したアリーナを引き取る (このASTと一緒に解放する)
+		bool adoptArena(ASTArena *arena){Arenas.push_back(arena); return true;}
+
+		// アリーナの数を取得する
+		int getArenaNum(){return Arenas.size();}
+
+		// i番目のアリーナを取得する
+		ASTArena &getArena(int i){return *Arenas.at(i);}
+
 		// モジュールにプロトタイプ宣言を追加する
 		bool addPrototype (PrototypeAST *proto);
 
@@ -113,6 +219,7 @@ class PrototypeAST{
 	private:
 		std::string FuncIdentify;
 		std::string FuncName;
+		SymbolID Symbol;
 		std::vector<std::string> ParamsName;
 		std::vector<std::string> ParamsIdentify;
 
@@ -122,12 +229,16 @@ class PrototypeAST{
 				const std::vector<std::string> &params_name, 
 				const std::vector<std::string> &params_identify)
 			: FuncIdentify(func_id), FuncName(func_name), 
+			Symbol(SymbolTable::getInstance().intern(func_name)),
 			ParamsName(params_name), ParamsIdentify(params_identify){}
 		
 
 		// 関数名を取得する
 		std::string getName(){return FuncName;}
 
+		// 関数名の番号を取得する
+		SymbolID getSymbol(){return Symbol;}
+
 		// 関数の戻り値の型を取得する
 		std::string getIdentify(){return FuncIdentify;}
 
@@ -152,7 +263,6 @@ class FunctionAST{
 	
 	public:
 	FunctionAST(PrototypeAST *proto, FunctionStmtAST *body) : Proto(proto), Body(body){}
-	~FunctionAST();
 
 	// 関数名を取得する
 	std::string getName(){return Proto->getName();}
@@ -166,37 +276,34 @@ class FunctionAST{
 
 /**
  * 関数定義（ボディ）を表すAST
+ * 文は入れ子のBlockASTで持つ (if, forの中の文はそれぞれのBlockASTに入る)
  */
 class FunctionStmtAST{
 	std::vector<VariableDeclAST*> VariableDecls;
-	std::vector<std::string> GlobalVariables;
-	std::vector<BaseAST*> StmtLists;
+	llvm::DenseSet<SymbolID> GlobalVariables; // global宣言した変数 (変数参照ごとに引くのでハッシュ表)
+	BlockAST *Body;
 
 	public:
-	FunctionStmtAST(){}
-	~FunctionStmtAST();
+	FunctionStmtAST() : Body(NULL){}
 
 	// 関数に変数を追加する
 	bool addVariableDeclaration(VariableDeclAST *vdecl);
 
-	// 関数にステートメントを追加する
-	bool addStatement(BaseAST *stmt){StmtLists.push_back(stmt); return true;}
+	// 関数の文のBlockを設定する
+	bool setBody(BlockAST *body){Body = body; return true;}
 
-	bool addGlobalVariables(std::string str){GlobalVariables.push_back(str); return true;}
+	bool addGlobalVariables(SymbolID symbol){GlobalVariables.insert(symbol); return true;}
 
 	// i番目の変数を取得する
 	VariableDeclAST *getVariableDecl(int i){if(i<VariableDecls.size()) return VariableDecls.at(i); else return NULL;}
 
-	// i番目のステートメントを取得する
-	BaseAST *getStatement(int i){if(i<StmtLists.size()) return StmtLists.at(i); else return NULL;}
+	// 関数の文のBlockを取得する
+	BlockAST *getBody(){return Body;}
 	
-	bool isGlobalVariable(std::string name){
-		for(int i = 0; i < GlobalVariables.size(); i++){
-			if(GlobalVariables.at(i) == name)
-				return true;
-		}
-		return false;
-	}
+	bool isGlobalVariable(SymbolID symbol){return GlobalVariables.count(symbol) != 0;}
+
+	// global宣言した変数を全て取得する
+	const llvm::DenseSet<SymbolID> &getGlobalVariables(){return GlobalVariables;}
 };
 
 /**
@@ -205,16 +312,25 @@ class FunctionStmtAST{
 class VariableDeclAST: public BaseAST{
 	public:
 		typedef enum{ param, local }DeclType;
-		typedef enum{ dint, ddouble, string }IdentifyType;
+		typedef enum{ dint, ddouble, string, dint64 }IdentifyType; // dint64:型推論で整数と分かった変数
 	
 	private:
-		std::string Name;
+		SymbolID Symbol;
 		DeclType Type;
 		IdentifyType Identify;
 
 	public:
 		VariableDeclAST(const std::string &name, const std::string &identify) 
-			: BaseAST(VariableDeclID),Name(name){
+			: BaseAST(VariableDeclID),Symbol(SymbolTable::getInstance().intern(name)){
+			setIdentify(identify);
+		}
+		VariableDeclAST(SymbolID symbol, const std::string &identify) 
+			: BaseAST(VariableDeclID),Symbol(symbol){
+			setIdentify(identify);
+		}
+
+		// 型名から識別を設定する
+		void setIdentify(const std::string &identify){
 			if(identify == "int")
 				Identify = dint;
 			else if(identify == "double")
@@ -235,7 +351,10 @@ class VariableDeclAST: public BaseAST{
 		~VariableDeclAST(){}
 
 		// 変数名を取得する
-		std::string getName(){return Name;}
+		std::string getName(){return SymbolTable::getInstance().getName(Symbol).str();}
+
+		// 変数名の番号を取得する
+		SymbolID getSymbol(){return Symbol;}
 
 		//変数の宣言種別を設定する
 		bool setDeclType(DeclType type){Type = type; return true;}
@@ -243,6 +362,9 @@ class VariableDeclAST: public BaseAST{
 		// 変数の宣下種別を取得する
 		DeclType getType(){return Type;}
 
+		// 変数の識別を設定する (型推論用)
+		bool setIdentifyType(IdentifyType identify){Identify = identify; return true;}
+
 		// 変数の識別を取得する
 		IdentifyType getIdentify(){return Identify;}
 };
@@ -251,19 +373,19 @@ class VariableDeclAST: public BaseAST{
  * 二項演算を表すAST
  */
 class BinaryExprAST : public BaseAST{
-	std::string Op;
+	BinaryOp Op;
 	BaseAST *LHS, *RHS;
 	int Line;
 	std::string Width;
 	std::string Digit;
+	bool Integer; // i64で計算するか (型推論で結果が ±2^53 に収まると分かった時だけtrue)
 
 	public:
-		BinaryExprAST(std::string op, BaseAST *lhs, BaseAST *rhs, int line) 
-			: BaseAST(BinaryExprID),Op(op),LHS(lhs),RHS(rhs),Line(line){
+		BinaryExprAST(BinaryOp op, BaseAST *lhs, BaseAST *rhs, int line) 
+			: BaseAST(BinaryExprID),Op(op),LHS(lhs),RHS(rhs),Line(line),Integer(false){
 			Width = "";
 			Digit = "-2";				
 		}
-		~BinaryExprAST(){SAFE_DELETE(LHS);SAFE_DELETE(RHS);}
 
 		// BinaryExprASTなのでtrueを返す
 		static inline bool classof(BinaryExprAST const* base){return true;}
@@ -286,7 +408,7 @@ class BinaryExprAST : public BaseAST{
 		std::string getDigit(){return Digit;}
 
 		// 演算子を取得する
-		std::string getOp(){return Op;}
+		BinaryOp getOp(){return Op;}
 
 		// 左辺値を取得
 		BaseAST *getLHS(){return LHS;}
@@ -295,6 +417,10 @@ class BinaryExprAST : public BaseAST{
 		BaseAST *getRHS(){return RHS;}
 
 		int getLine(){return Line;}	
+
+		// i64で計算するか
+		bool isInteger(){return Integer;}
+		void setInteger(bool integer){Integer = integer;}
 };
 
 /**
@@ -302,17 +428,23 @@ class BinaryExprAST : public BaseAST{
  */
 class CallExprAST : public BaseAST{
 	std::string Callee;
+	SymbolID CalleeSymbol;
 	std::vector<BaseAST*> Args;
 	std::string Width;
 	std::string Digit;
 
 	public:
 		CallExprAST(const std::string &callee, std::vector<BaseAST*> &args)
-			: BaseAST(CallExprID),Callee(callee),Args(args){
+			: BaseAST(CallExprID),Callee(callee),
+			CalleeSymbol(SymbolTable::getInstance().intern(callee)),Args(args){
+			Width = "";
+			Digit = "-2";
+		}
+		CallExprAST(const std::string &callee, SymbolID callee_symbol, std::vector<BaseAST*> &args)
+			: BaseAST(CallExprID),Callee(callee),CalleeSymbol(callee_symbol),Args(args){
 			Width = "";
 			Digit = "-2";
 		}
-		~CallExprAST();
 
 		// CallExprASTなのでtrueを返す
 		static inline bool classof (CallExprAST const*){return true;}
@@ -337,6 +469,9 @@ class CallExprAST : public BaseAST{
 		// 呼び出す関数名を取得する
 		std::string getCallee(){return Callee;}
 
+		// 呼び出す関数名の番号を取得する
+		SymbolID getCalleeSymbol(){return CalleeSymbol;}
+
 		// i番目の引数を取得する
 		BaseAST *getArgs (int i){if(i<Args.size())return Args.at(i);else return NULL;}
 };
@@ -349,7 +484,6 @@ class ReturnStmtAST : public BaseAST {
 	BaseAST *Expr;
 	public:
 		ReturnStmtAST(BaseAST *expr) : BaseAST(ReturnStmtID),Expr(expr){}
-		~ReturnStmtAST(){SAFE_DELETE(Expr);}
 
 		// ReturnStmtASTなのでtrueを返す
 		static inline bool classof(ReturnStmtAST const*){return true;}
@@ -363,18 +497,48 @@ class ReturnStmtAST : public BaseAST {
 		BaseAST *getExpr(){return Expr;}
 };
 
+/**
+ * { } で囲まれた文の並びを表すAST
+ */
+class BlockAST : public BaseAST{
+	std::vector<BaseAST*> Stmts;
+
+	public:
+	BlockAST() : BaseAST(BlockID){}
+
+	// BlockASTなのでtrueを返す
+	static inline bool classof(BlockAST const*){return true;}
+
+	// 渡されたBaseASTがBlockASTか判定する
+	static inline bool classof(BaseAST const* base){return base->getValueID() == BlockID;}
+
+	// 文を追加する
+	bool addStatement(BaseAST *stmt){Stmts.push_back(stmt); return true;}
+
+	// i番目の文を取得する
+	BaseAST *getStatement(int i){if(i<Stmts.size()) return Stmts.at(i); else return NULL;}
+
+	// 文の数を取得する
+	int getStatementNum(){return Stmts.size();}
+
+	// 最後の文を取得する (空ならNULL)
+	BaseAST *getLastStatement(){return Stmts.empty() ? NULL : Stmts.back();}
+};
+
 /**
  * ifを表すAST
+ * else if, elseは前の節のElseにつなぐ (if -> else if -> ... -> else の連鎖)
  */
 class IfStatementAST : public BaseAST{
-	std::string If;                   // if or else if or else 
+	IfKind If;                        // if or else if or else 
 	std::vector<ComparisonAST*> Coms; // 比較
-	std::vector<std::string> Ops;     // 条件式の結合
-	std::vector<int> Depth;
+	std::vector<LogicalOp> Ops;       // 条件式の結合
+	std::vector<int> Depth;           // 結合の [ ] の深さ
+	BlockAST *Then;                   // 条件式を満たした時の文
+	IfStatementAST *Else;             // 次の else if か else (なければNULL)
 
 	public:
-	IfStatementAST() : BaseAST(IfID){}
-	~IfStatementAST();
+	IfStatementAST(IfKind kind) : BaseAST(IfID), If(kind), Then(NULL), Else(NULL){}
 
 	// IfStatementASTなのでtrueを返す
 	static inline bool classof(IfStatementAST const*){return true;}
@@ -382,14 +546,11 @@ class IfStatementAST : public BaseAST{
 	// 渡されたBaseASTがIfStatementASTか判定する
 	static inline bool classof(BaseAST const* base){return base->getValueID() == IfID;}
 	
-	// if else の文字列を設定する
-	bool setIf(std::string ifelse){If = ifelse;return true;}
-
 	// ifの条件式を追加する
 	bool addComparison(ComparisonAST *com){Coms.push_back(com); return true;}
 	
 	// opを追加する
-	bool addOp(std::string op){Ops.push_back(op);return true;}
+	bool addOp(LogicalOp op){Ops.push_back(op);return true;}
 
 	// depthを追加
 	bool addDepth(int i){Depth.push_back(i);return true;}
@@ -398,10 +559,10 @@ class IfStatementAST : public BaseAST{
 	int getDepth(int i){if(Depth.size() > i) return Depth.at(i);else return 0;}
 
 	// if elseを取得する
-	std::string getIf(){return If;}
+	IfKind getIf(){return If;}
 
-	// i番目の&& ||を取得する
-	std::string getOp(int i){if(i<Ops.size()) return Ops.at(i); else return NULL;}
+	// i番目の&& ||を取得する (範囲外はand)
+	LogicalOp getOp(int i){if(i<Ops.size()) return Ops.at(i); else return LOGICAL_AND;}
 
 	// i番目の比較を取得する
 	ComparisonAST *getComparison(int i){if(i<Coms.size()) return Coms.at(i); else return NULL;}
@@ -411,31 +572,38 @@ class IfStatementAST : public BaseAST{
 	
 	// 結合の個数を取得
 	int getOpsNumber(){return Ops.size();}
-};
 
-/**
- *  ifの終わりを表すAST
- */
-class IfEndAST : public BaseAST {
-	public:
-	IfEndAST() : BaseAST(IfEndID){}
-	static inline bool classof(IfEndAST const*){return true;}
-	static inline bool classof(BaseAST const* base){
-		return base->getValueID() == IfEndID;
-	}
+	// 条件式を満たした時の文を設定する
+	bool setThen(BlockAST *then){Then = then; return true;}
+
+	// 条件式を満たした時の文を取得する
+	BlockAST *getThen(){return Then;}
+
+	// 次の else if か else を設定する
+	bool setElse(IfStatementAST *else_stmt){Else = else_stmt; return true;}
+
+	// 次の else if か else を取得する
+	IfStatementAST *getElse(){return Else;}
 };
 
 /**
  * forを表すAST
+ * for 繰り返し数 { } と 変数 = 始め..終わり step 増分 { } (..< は終わりを含まない) を表す
+ * for 繰り返し数 は変数がなく 1..繰り返し数 step 1 と同じ回数繰り返す
  */
 class ForStatementAST : public BaseAST{
-	BinaryExprAST *BinExpr;
-	VariableAST *Val;
-	BaseAST *EndExpr;
+	VariableAST *Val;    // 繰り返し変数 (for 繰り返し数 ではNULL)
+	BaseAST *StartExpr;  // 範囲の始め (for 繰り返し数 ではNULL)
+	BaseAST *EndExpr;    // 範囲の終わり (繰り返し数)
+	int64_t Step;        // 増分 (0以外の整数の定数, 負なら減らしていく)
+	bool Exclusive;      // 終わりを含まないか
+	BlockAST *Body;
 
 	public:
-		ForStatementAST(VariableAST *val, BinaryExprAST *bin_expr, BaseAST *end_expr)
-		: BaseAST(ForID), Val(val), BinExpr(bin_expr), EndExpr(end_expr){}
+		ForStatementAST(BaseAST *end_expr)
+		: BaseAST(ForID), Val(NULL), StartExpr(NULL), EndExpr(end_expr), Step(1), Exclusive(false), Body(NULL){}
+		ForStatementAST(VariableAST *val, BaseAST *start_expr, BaseAST *end_expr, int64_t step, bool exclusive)
+		: BaseAST(ForID), Val(val), StartExpr(start_expr), EndExpr(end_expr), Step(step), Exclusive(exclusive), Body(NULL){}
 		~ForStatementAST(){}
 		
 		// ForStatementASTなのでtrueを返す
@@ -444,24 +612,26 @@ class ForStatementAST : public BaseAST{
 		// 渡されたASTがForStatementASTか判定する
 		static inline bool classof(BaseAST const* base){return base->getValueID() == ForID;}
 		
-		// Valを取得
+		// 繰り返し変数を取得 (なければNULL)
 		VariableAST *getVal(){return Val;}
 
-		// BinExprを取得
-		BinaryExprAST *getBinExpr(){return BinExpr;}
+		// 範囲の始めを取得 (なければNULL)
+		BaseAST *getStartExpr(){return StartExpr;}
+
+		// 増分を取得
+		int64_t getStep(){return Step;}
 
-		// EndNumberを取得
+		// 終わりを含まないか
+		bool isExclusive(){return Exclusive;}
+
+		// 範囲の終わり (繰り返し数) を取得
 		BaseAST *getEndExpr(){return EndExpr;}
-};
 
-/**
- * forEndを表すAST
- */
-class ForEndAST : public BaseAST {
-	public:
-		ForEndAST() : BaseAST(ForEndID){}
-		static inline bool classof(ForEndAST const*){return true;}
-		static inline bool classof(BaseAST const* base){return base->getValueID() == ForEndID;}
+		// 繰り返す文を設定
+		bool setBody(BlockAST *body){Body = body; return true;}
+
+		// 繰り返す文を取得
+		BlockAST *getBody(){return Body;}
 };
 
 
@@ -469,13 +639,12 @@ class ForEndAST : public BaseAST {
  * 条件式を表すAST
  */
 class ComparisonAST : public BaseAST{
-	std::string Op;
+	CompareOp Op;
 	BaseAST *LHS, *RHS;
 
 	public:
-	ComparisonAST(std::string op, BaseAST *lhs, BaseAST *rhs) 
+	ComparisonAST(CompareOp op, BaseAST *lhs, BaseAST *rhs) 
 		: BaseAST(ComparisonID), Op(op), LHS(lhs), RHS(rhs){}
-	~ComparisonAST(){SAFE_DELETE(LHS);SAFE_DELETE(RHS);}
 
 	// ComparisonASTなのでtrueを返す
 	static inline bool classof(ComparisonAST const* base){return true;}
@@ -484,7 +653,7 @@ class ComparisonAST : public BaseAST{
 	static inline bool classof(BaseAST const* base){return base->getValueID() == ComparisonID;}
 
 	// < > = を取得する
-	std::string getOp(){return Op;}
+	CompareOp getOp(){return Op;}
 
 	// 左辺値を取得する
 	BaseAST *getLHS(){return LHS;}
@@ -497,11 +666,11 @@ class ComparisonAST : public BaseAST{
  * 関数外の変数を宣言するAST
  */
 class GlobalVariableAST : public BaseAST{
-	std::string Name;
+	SymbolID Symbol;
 	int Line;
 
 	public:
-		GlobalVariableAST(const std::string &name, int line) : BaseAST(GlobalVariableID), Name(name), Line(line){}
+		GlobalVariableAST(SymbolID symbol, int line) : BaseAST(GlobalVariableID), Symbol(symbol), Line(line){}
 		~GlobalVariableAST(){}
 
 		// ComparisonASTなのでtrueを返す
@@ -509,7 +678,8 @@ class GlobalVariableAST : public BaseAST{
 		
 		// 渡されたBaseASTがComparisonASTか判定する
 		static inline bool classof(BaseAST const* base){return base->getValueID() == GlobalVariableID;}
-		std::string getName(){return Name;}
+		std::string getName(){return SymbolTable::getInstance().getName(Symbol).str();}
+		SymbolID getSymbol(){return Symbol;}
 		int getLine(){return Line;}
 };
 
@@ -517,14 +687,18 @@ class GlobalVariableAST : public BaseAST{
  * 変数参照を表すAST
  */
 class VariableAST : public BaseAST{
-	//Name
-	std::string Name;
+	SymbolID Symbol;
 	std::string Width;
 	std::string Digit;
 
 	public:
+		VariableAST(SymbolID symbol) : 
+			BaseAST(VariableID),Symbol(symbol){
+			Width = "";
+			Digit = "-2";
+		}
 		VariableAST(const std::string &name) : 
-			BaseAST(VariableID),Name(name){
+			BaseAST(VariableID),Symbol(SymbolTable::getInstance().intern(name)){
 			Width = "";
 			Digit = "-2";
 		}
@@ -551,7 +725,10 @@ class VariableAST : public BaseAST{
 		std::string getDigit(){return Digit;}
 
 		// 変数名を取得
-		std::string getName(){return Name;}
+		std::string getName(){return SymbolTable::getInstance().getName(Symbol).str();}
+
+		// 変数名の番号を取得
+		SymbolID getSymbol(){return Symbol;}
 };
 
 /*
@@ -626,18 +803,23 @@ class StringAST : public BaseAST{
 
 /**
  * breakを表すAST
+ * 抜ける繰り返し構文 (break(n) ならn個外のfor) は構文解析で決める
  */
 class BreakAST : public BaseAST{
 	int Depth;
+	ForStatementAST *Target;
 
 	public:
-		BreakAST(int depth) : BaseAST(BreakID), Depth(depth){}
+		BreakAST(int depth, ForStatementAST *target) : BaseAST(BreakID), Depth(depth), Target(target){}
 		static inline bool classof(BreakAST const*){return true;}
 		static inline bool classof(BaseAST const* base){
 		        return base->getValueID() == BreakID;
 		}
 
 		int getDepth(){return Depth;}
+
+		// 抜けるforを取得
+		ForStatementAST *getTarget(){return Target;}
 };
 
 /**
@@ -645,10 +827,11 @@ class BreakAST : public BaseAST{
  */
 class ContinueAST : public BaseAST{
 	int Depth;
+	ForStatementAST *Target;
 	
 	public:
 		
-		ContinueAST(int depth) : BaseAST(ContinueID), Depth(depth){}
+		ContinueAST(int depth, ForStatementAST *target) : BaseAST(ContinueID), Depth(depth), Target(target){}
 	
 		static inline bool classof(ContinueAST const*){return true;}
 	
@@ -656,6 +839,9 @@ class ContinueAST : public BaseAST{
 			return base->getValueID() == ContinueID;
 		}
 		int getDepth(){return Depth;}
+
+		// 次の繰り返しに進むforを取得
+		ForStatementAST *getTarget(){return Target;}
 };
 
 /**
@@ -0,0 +1,78 @@
+#ifndef CACHE_HPP
+#define CACHE_HPP
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+#include <dirent.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+#include <llvm/ADT/OwningPtr.h>
+#include <llvm/Bitcode/ReaderWriter.h>
+#include <llvm/LLVMContext.h>
+#include <llvm/Module.h>
+#include <llvm/PassManager.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/ToolOutputFile.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Config/llvm-config.h>
+#include "APP.hpp"
+
+/**
+ * コンパイル結果のキャッシュクラス
+ * 入力ファイル、リンクファイル、オプション、コンパイラのバージョンから
+ * キーを作り、最適化済みのbitcode(.bc)とオブジェクトファイル(.o)を保存する
+ * 容量を超えたら最後に使われた時刻が古いものから削除する
+ * 同じキーを複数のプロセス・スレッドが同時に書いても壊れないように
+ * 書き込みは書き込み元ごとの一時ファイルに行い、renameで置き換える
+ */
+class CompileCache{
+	private:
+		std::string CacheDir;          // キャッシュディレクトリ
+		uint64_t SizeLimit;            // キャッシュの最大容量 (バイト)
+		llvm::tool_output_file *BitcodeOut; // 書き込み中のbitcode
+		std::string BitcodeTemp;       // 書き込み中のbitcodeの一時ファイル
+		std::string ObjectTemp;        // 書き込み中のオブジェクトファイルの一時ファイル
+
+	public:
+		CompileCache(std::string dir, uint64_t size_limit)
+			: CacheDir(dir), SizeLimit(size_limit), BitcodeOut(NULL){}
+		~CompileCache();
+
+		static std::string getDefaultDir();
+		bool initialize();
+		std::string computeKey(std::string input_file, std::string link_file,
+				std::string flags, std::string exe_file);
+
+		// キャッシュされたファイルのパス
+		std::string getBitcodePath(std::string key){return CacheDir + "/" + key + ".bc";}
+		std::string getObjectPath(std::string key){return CacheDir + "/" + key + ".o";}
+		std::string createTempObjectPath(std::string key);
+
+		bool hasBitcode(std::string key){return exists(getBitcodePath(key));}
+		bool hasObject(std::string key){return exists(getObjectPath(key));}
+
+		llvm::Module *loadBitcode(std::string key, llvm::LLVMContext &context);
+		bool storeBitcode(std::string key, llvm::Module &mod);
+		bool addBitcodeWriter(std::string key, llvm::PassManager &pm);
+		bool commit(std::string key);
+		bool touch(std::string path);
+		bool evict();
+
+	private:
+		static std::string createTempPath(std::string path);
+		static bool exists(std::string path);
+		static bool readFile(std::string path, std::string &data);
+		static uint64_t hashString(const std::string &data, uint64_t seed);
+};
+
+#endif
@@ -1,63 +1,133 @@
 #ifndef CODEGEN_HPP
 #define CODEGEN_HPP
 
+#include<algorithm>
 #include<cstdio>
 #include<cstdlib>
 #include<map>
-#include<tuple>
+#include<set>
 #include<string>
 #include<vector>
 #include<llvm/ADT/APInt.h>
+#include<llvm/ADT/DenseMap.h>
+#include<llvm/ADT/DenseSet.h>
+#include<llvm/ADT/OwningPtr.h>
+#include<llvm/Bitcode/ReaderWriter.h>
 #include<llvm/Constants.h>
-#include<llvm/ExecutionEngine/ExecutionEngine.h>
-#include<llvm/ExecutionEngine/JIT.h>
 #include<llvm/Linker.h>
 #include<llvm/LLVMContext.h>
 #include<llvm/Module.h>
 #include<llvm/Metadata.h>
 #include<llvm/Support/Casting.h>
+#include<llvm/Support/CFG.h>
 #include<llvm/IRBuilder.h>
 #include<llvm/Support/IRReader.h>
+#include<llvm/Support/MemoryBuffer.h>
+#include<llvm/Support/ValueHandle.h>
 #include<llvm/MDBuilder.h>
 #include<llvm/ValueSymbolTable.h>
 #include"APP.hpp"
 #include"AST.hpp"
+#include"profiler.hpp"
+#include"symbol.hpp"
+#include"typeinfer.hpp"
 
 /**
  * コード生成クラス
  */
 class CodeGen{
 	private:
+		llvm::LLVMContext &Context; // コード生成に使うLLVMContext
 		llvm::Function *CurFunc;    // 現在コード生成中のFunction
 		llvm::Module *Mod;          // 生成したModuleを格納
 		llvm::IRBuilder<> *Builder; // LLVM-IRを生成するIRBuilder
 		llvm::Value *PRINT_STRING;
+		llvm::Module *SharedLinkMod; // 読み込み済みの -l のModule (コンパイルサーバ用, 所有しない)
+
+		// 変数の格納先 (識別子の番号で引く)
+		std::vector<llvm::Value*> GlobalSlots; // mainの変数 (GlobalVariable)
+		std::vector<llvm::Type*> LocalTypes;   // コード生成中の関数の変数の型 (SSAの値で持つ)
+		std::vector<SymbolID> LocalSymbols;    // LocalTypesに設定した番号 (関数ごとに消す)
+		std::vector<llvm::AllocaInst*> LocalAllocas; // -alloca-vars の時の関数の変数の格納先 (関数ごとに消す)
+		bool UseAllocas; // 関数の変数をSSAの値でなくallocaに置く (mem2reg任せの以前の方法と比べる用)
+
+		// mainの変数のうち他の関数からglobal宣言される変数 (これだけGlobalVariableにする)
+		// REPLでは入力の間で引き継ぐのでmainの変数を全てGlobalVariableにする
+		llvm::DenseSet<SymbolID> SharedGlobals;
+		bool KeepMainGlobals;
+		std::vector<SymbolID> PromotedGlobals; // mainでSSAの値で持つGlobalVariable (関数呼び出しの前後で書き戻す)
+
+		// 関数の変数のSSA構築用 (Braun et al. の方法, 関数ごとに消す)
+		// Blockごとの変数の現在の定義と、前のBlockが揃っていないBlockに置いた空のphi
+		typedef llvm::DenseMap<std::pair<llvm::BasicBlock*, SymbolID>, llvm::TrackingVH<llvm::Value> > DefMap;
+		DefMap CurrentDefs;
+		std::map<llvm::BasicBlock*, std::vector<std::pair<SymbolID, llvm::PHINode*> > > IncompletePhis;
+		std::set<llvm::BasicBlock*> SealedBlocks;
+
+		// 生成中のforの飛び先 (continue:for.inc, break:for.end)
+		std::map<ForStatementAST*, std::pair<llvm::BasicBlock*, llvm::BasicBlock*> > LoopTargets;
 	public:
-		CodeGen();
+		CodeGen(llvm::LLVMContext &context);
 		~CodeGen();
-		bool doCodeGen(TranslationUnitAST &tunit, std::string name, std::string link_file, bool with_jit);
+		bool doCodeGen(TranslationUnitAST &tunit, std::string name, std::string link_file);
+		bool beginModule(std::string name);
+		void setSharedLinkModule(llvm::Module *mod){SharedLinkMod = mod;}
+		void setUseAllocas(bool use){UseAllocas = use;}
+		bool addTranslationUnit(TranslationUnitAST &tunit);
 		llvm::Module &getModule();
 		bool CORRECT = true;
 
 	private:
 		bool generateTranslationUnit(TranslationUnitAST &tunit, std::string name);
+		void declareRuntimeFunctions();
+		bool generateFunctions(TranslationUnitAST &tunit);
 		llvm::Function *generateFunctionDefinition(FunctionAST *func, llvm::Module *mod);
 		llvm::Function *generatePrototype(PrototypeAST *proto, llvm::Module *mod);
-		llvm::Value *generateFunctionStatement(FunctionStmtAST *func_stmt, llvm::Function *func);
+		bool generateFunctionStatement(FunctionStmtAST *func_stmt, llvm::Function *func);
+		bool generateBlock(BlockAST *block, FunctionStmtAST *func_stmt);
+		bool generateIfStatement(IfStatementAST *if_expr, FunctionStmtAST *func_stmt);
+		bool generateCondition(IfStatementAST *if_expr, int begin, int end,
+				llvm::BasicBlock *btrue, llvm::BasicBlock *bfalse, FunctionStmtAST *func_stmt);
+		bool generateForStatement(ForStatementAST *for_expr, FunctionStmtAST *func_stmt);
+		llvm::Value *generateLoopCount(BaseAST *end_expr, const char *what, FunctionStmtAST *func_stmt);
+		llvm::Value *generateTripCount(llvm::Value *start_val, llvm::Value *end_val, int64_t step, bool exclusive);
+		bool isLoopInvariant(BaseAST *end_expr, BlockAST *body, FunctionStmtAST *func_stmt);
+		void collectVariables(BaseAST *ast, std::set<SymbolID> &reads, std::set<SymbolID> &writes, bool &has_call);
 		llvm::Value *generateVariableDeclaration(VariableDeclAST *vdecl);
 		llvm::Value *generateStatement(BaseAST *stmt, FunctionStmtAST *func_stmt);
 		llvm::Value *generateBinaryExpression(BinaryExprAST *bin_expr, FunctionStmtAST *func_stmt);
-		bool generateDenominatorCheck(std::string op, BaseAST *rhs, int line, FunctionStmtAST *func_stmt);
+		bool generateDenominatorCheck(std::string op, llvm::Value *rhs_v, int line);
 		llvm::Value *generateCallExpression(CallExprAST *call_expr, FunctionStmtAST *func_stmt);
 		llvm::Value *generateReturnStatement(ReturnStmtAST *jump_stmt, FunctionStmtAST *func_stmt);
 		llvm::Value *generateVariable(VariableAST *var, FunctionStmtAST *func_stmt);
+		llvm::Value *getVariableSlot(SymbolID symbol, FunctionStmtAST *func_stmt);
+		bool isLocalVariable(SymbolID symbol, FunctionStmtAST *func_stmt);
+		void collectSharedGlobals(TranslationUnitAST &tunit);
+		void storePromotedGlobals();
+		void loadPromotedGlobals();
+		llvm::Value *assignVariable(SymbolID symbol, llvm::Value *value, FunctionStmtAST *func_stmt);
+		void writeVariable(SymbolID symbol, llvm::BasicBlock *block, llvm::Value *value);
+		llvm::Value *readVariable(SymbolID symbol, llvm::BasicBlock *block);
+		llvm::AllocaInst *getLocalAlloca(SymbolID symbol);
+		llvm::Value *readVariableRecursive(SymbolID symbol, llvm::BasicBlock *block);
+		llvm::PHINode *createPhi(SymbolID symbol, llvm::BasicBlock *block);
+		llvm::Value *addPhiOperands(SymbolID symbol, llvm::PHINode *phi);
+		llvm::Value *tryRemoveTrivialPhi(llvm::PHINode *phi);
+		void sealBlock(llvm::BasicBlock *block);
+		void setSlot(std::vector<llvm::Value*> &slots, SymbolID symbol, llvm::Value *value);
+		void clearSlots();
 		llvm::Value *generateNumber(double value);
+		llvm::Value *generateConstant(double value);
+		llvm::Value *convertValue(llvm::Value *value, llvm::Type *type);
 		llvm::Value *generateString(std::string str);
 		bool linkModule(llvm::Module *dest, std::string file_name);
+		llvm::Module *loadLinkModule(std::string file_name);
+		bool materializeReferencedFunctions(llvm::Module *dest, llvm::Module *link_mod);
+		void collectReferencedFunctions(llvm::Value *value, std::vector<llvm::Function*> &funcs,
+				std::set<llvm::Value*> &visited);
 
-		llvm::Value *generateComparison(BaseAST *lhs, BaseAST *rhs, std::string op, FunctionStmtAST *func_stmt);
-		llvm::Value *generateForStatement(ForStatementAST *for_expr, llvm::BasicBlock *bcond, llvm::BasicBlock *bbody, FunctionStmtAST *func_stmt);
-		llvm::BasicBlock *generateForEndStatement(llvm::BasicBlock *bcond, llvm::BasicBlock *bbody, llvm::BasicBlock *binc, llvm::BasicBlock *bend, llvm::Value *fcmp, ForStatementAST *for_expr, FunctionStmtAST *func_stmt);
+		llvm::Value *generateComparison(BaseAST *lhs, BaseAST *rhs, CompareOp op, FunctionStmtAST *func_stmt);
+		llvm::Value *generateCompareValues(llvm::Value *lhs_v, llvm::Value *rhs_v, CompareOp op);
 };
 
 #endif
@@ -0,0 +1,64 @@
+#ifndef EMITTER_HPP
+#define EMITTER_HPP
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/Assembly/PrintModulePass.h>
+#include <llvm/Bitcode/ReaderWriter.h>
+#include <llvm/DataLayout.h>
+#include <llvm/MC/SubtargetFeature.h>
+#include <llvm/Module.h>
+#include <llvm/PassManager.h>
+#include <llvm/Support/FormattedStream.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/Program.h>
+#include <llvm/Support/TargetRegistry.h>
+#include <llvm/Support/ToolOutputFile.h>
+#include <llvm/Target/TargetMachine.h>
+#include <llvm/Target/TargetOptions.h>
+#include "APP.hpp"
+#include "profiler.hpp"
+
+/**
+ * 出力ファイルの種別
+ */
+enum OutputType{
+	OUT_EXECUTABLE, // 実行ファイル (デフォルト)
+	OUT_OBJECT,     // オブジェクトファイル (-c)
+	OUT_ASSEMBLY,   // アセンブリ (-S)
+	OUT_LLVM_IR,    // LLVM-IR (-emit-llvm)
+	OUT_BITCODE     // bitcode (-emit-bc)
+};
+
+/**
+ * ネイティブコード出力クラス
+ * TargetMachineを使ってModuleから .o / .s / 実行ファイルを生成する
+ */
+class Emitter{
+	private:
+		llvm::TargetMachine *TM; // 出力先のTargetMachine
+		std::string Triple;      // ターゲットトリプル
+		int OptLevel;            // コード生成時の最適化レベル
+
+	public:
+		Emitter() : TM(NULL), OptLevel(0){}
+		~Emitter(){SAFE_DELETE(TM);}
+		bool initialize(int opt_level, std::string cpu);
+		bool prepareModule(llvm::Module &mod, llvm::PassManager &pm);
+		bool doEmit(llvm::Module &mod, llvm::PassManager &pm, std::string file_name,
+				OutputType type, std::string obj_file = "");
+		bool linkExecutable(std::string obj_file, std::string exe_file);
+
+		static std::string resolveCPU(std::string cpu, std::vector<std::string> &features);
+		static std::string getTargetDescription(std::string cpu);
+
+	private:
+		bool emitFile(llvm::Module &mod, llvm::PassManager &pm, std::string file_name, OutputType type);
+};
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef JIT_HPP
+#define JIT_HPP
+
+#include <cstdio>
+#include <cstdlib>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <llvm/DataLayout.h>
+#include <llvm/ExecutionEngine/ExecutionEngine.h>
+#include <llvm/ExecutionEngine/JIT.h>
+#include <llvm/IRBuilder.h>
+#include <llvm/Instructions.h>
+#include <llvm/LLVMContext.h>
+#include <llvm/Module.h>
+#include <llvm/PassManager.h>
+#include <llvm/Support/TimeValue.h>
+#include <llvm/Transforms/Scalar.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+#include "APP.hpp"
+#include "profiler.hpp"
+
+/**
+ * JIT実行クラス
+ * 関数は呼び出しスタブ経由で最初に呼ばれた時にコンパイルする
+ * HotThresholdが1以上なら、その回数呼ばれた関数を最適化して再コンパイルする
+ * (関数の呼び出しは関数ポインタの表を経由し、ホットになった関数は表を再最適化用のスタブに差し替える
+ *  次の呼び出しでスタブが最適化した関数をコンパイルして表を書き換えるので、実行中の古いコードは書き換えない)
+ */
+class JITRunner{
+	private:
+		llvm::Module *Mod;                     // 実行するModule (所有はCodeGen)
+		llvm::ExecutionEngine *EE;             // JIT
+		llvm::FunctionPassManager *FPM;        // ホットな関数の最適化用
+		int HotThreshold;                      // 再最適化する呼び出し回数 (0なら無効)
+		uint64_t StartTime;                    // JIT生成開始時刻 (マイクロ秒)
+		std::vector<llvm::Function*> Functions; // カウンタ番号 -> 関数
+		std::vector<llvm::CallInst*> Counters;  // カウンタ番号 -> 計測用のcall命令
+		std::vector<llvm::GlobalVariable*> Table; // カウンタ番号 -> 呼び出す関数のポインタ
+		std::vector<llvm::Function*> Stubs;     // カウンタ番号 -> 再最適化用のスタブ
+		std::vector<int> CallCounts;            // カウンタ番号 -> 呼び出し回数
+
+	public:
+		JITRunner(llvm::Module *mod) : Mod(mod), EE(NULL), FPM(NULL), HotThreshold(0), StartTime(0){}
+		~JITRunner();
+		bool initialize(int opt_level, int hot_threshold);
+		int run();
+		void countCall(int id);
+		void *reoptimizeFunction(int id);
+
+	private:
+		bool insertCounters();
+		llvm::Function *createStub(llvm::Function *func, llvm::Function *reopt_hook, int id);
+		void setTableEntry(int id, llvm::Function *func);
+};
+
+#endif
@@ -1,13 +1,23 @@
 #ifndef LEXER_HPP
 #define LEXER_HPP
 
+#include <cctype>
 #include <cstdio>
 #include <cstdlib>
-#include <fstream>
+#include <cstring>
+#include <istream>
+#include <iterator>
 #include <list>
 #include <string>
 #include <vector>
+#include <stdint.h>
+#include <llvm/ADT/OwningPtr.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/system_error.h>
 #include "APP.hpp"
+#include "profiler.hpp"
+#include "symbol.hpp"
 
 /**
  * トークン種別
@@ -31,92 +41,94 @@ enum TokenType{
 	TOK_EOF         // EOF
 };
 
-/**
- * 個別トークン格納クラス
- */
-class Token{
-	private:
-		TokenType Type;
-		std::string TokenString;
-		double Num;     // 値を格納する変数
-		std::string Str; // string型の変数の場合に値を格納する変数
-		int Line;
-	
-	public:
-		Token(std::string string, TokenType type,int line)
-			: TokenString(string),Type(type),Line(line){
-			if(type == TOK_DIGIT)
-				Num = atof(string.c_str());
-			else
-				Num = 0x7fffff;
-			if(type == TOK_STR)
-				Str = string.c_str();
-			else
-				Str = "0x7ffffff";
-		};
-		~Token(){};
-
-		// トークンの種別を取得
-		TokenType getTokenType(){ return Type; }
-
-		// トークンの文字列表現を取得
-		std::string getTokenString() { return TokenString; }
-
-		// トークンの数値を取得
-		double getNumValue(){return Num;}
-
-		// トークンの文字列を取得（種別がstringである場合に使用）
-		std::string getStrValue(){return Str;}
-
-		// トークンの出現した行数を取得
-		int getLine(){ return Line; }
-};
-
-
 /**
  * 切り出したToken格納用クラス
+ * トークンは種別・開始位置・長さ・行・数値・識別子の番号をそれぞれ連続した配列で持つ
+ * 文字列はソースのバッファ(Source)の範囲で、字句解析で補ったトークン(";" や "main" など)は
+ * Extra に追加した文字列の範囲 (位置はソースの長さからの続き) とする
+ * 範囲を切り出したTokenStreamは元の配列を共有し、範囲の終わりから先はTOK_EOFとする
+ * (関数ごとに並列に構文解析するため, 元のTokenStreamより先に破棄すること)
  */
 class TokenStream{
 	private:
-		std::vector<Token*> Tokens;
+		std::vector<unsigned char> Types;
+		std::vector<uint32_t> Offsets;
+		std::vector<uint32_t> Lengths;
+		std::vector<int> Lines;
+		std::vector<double> Nums;  // TOK_DIGIT の値
+		std::vector<SymbolID> Symbols; // TOK_IDENTIFIER の番号
 		int CurIndex;
+		int EndIndex;               // 範囲の終わり
+		llvm::MemoryBuffer *Source; // トークンが指すソース
+		std::string Extra;          // 補ったトークンの文字列
+		TokenStream *Base;          // 配列を持つTokenStream (切り出していなければ自身)
 	
 	public:
-		TokenStream():CurIndex(0){}
+		TokenStream(llvm::MemoryBuffer *source = NULL):CurIndex(0),EndIndex(0),Source(source),Base(this){}
+		TokenStream(TokenStream &base, int begin, int end)
+			:CurIndex(begin),EndIndex(end),Source(NULL),Base(base.Base){}
 		~TokenStream();
 
 		bool ungetToken(int Times=1);
 		bool getNextToken();
 		bool getBackToken();
-		bool pushToken(Token *token){
-			Tokens.push_back(token);
-			return true;
+		bool pushToken(TokenType type, uint32_t offset, uint32_t length, int line);
+		bool pushToken(TokenType type, llvm::StringRef text, int line);
+		bool reorderTokens(const std::vector<int> &order);
+
+		// i番目のトークンの種類を取得
+		TokenType getType(int i){return (TokenType)Base->Types[i];}
+
+		// i番目のトークンの文字列表現を取得 (コピーしない)
+		llvm::StringRef getRef(int i){
+			llvm::MemoryBuffer *source = Base->Source;
+			uint32_t source_size = source ? source->getBufferSize() : 0;
+			uint32_t offset = Base->Offsets[i];
+			if(offset < source_size)
+				return llvm::StringRef(source->getBufferStart() + offset, Base->Lengths[i]);
+			return llvm::StringRef(Base->Extra.data() + (offset - source_size), Base->Lengths[i]);
 		}
-		Token getToken();
+
+		// i番目のトークンの行を取得
+		int getLine(int i){return Base->Lines[i];}
 
 		// トークンの種類を取得
-		TokenType getCurType(){return Tokens[CurIndex]->getTokenType();}
+		TokenType getCurType(){return CurIndex < EndIndex ? getType(CurIndex) : TOK_EOF;}
 		
 		// トークンの文字列表現を取得
-		std::string getCurString(){return Tokens[CurIndex]->getTokenString();}
+		std::string getCurString(){return getCurRef().str();}
+
+		// トークンの文字列表現を取得 (コピーしない)
+		llvm::StringRef getCurRef(){return CurIndex < EndIndex ? getRef(CurIndex) : llvm::StringRef();}
+
+		// k個先のトークンの種類を取得 (先読み, 範囲外ならTOK_EOF)
+		TokenType peekType(int k){
+			int i = CurIndex + k;
+			return (i < EndIndex) ? getType(i) : TOK_EOF;
+		}
+
+		// k個先のトークンの文字列表現を取得 (先読み, 範囲外なら空)
+		llvm::StringRef peekRef(int k){
+			int i = CurIndex + k;
+			return (i < EndIndex) ? getRef(i) : llvm::StringRef();
+		}
+
+		// 識別子の番号を取得 (識別子でなければ SymbolTable::None)
+		SymbolID getCurSymbol(){return CurIndex < EndIndex ? Base->Symbols[CurIndex] : SymbolTable::None;}
 
 		// トークンの数値を取得（double型）
-		double getCurNumVal(){return Tokens[CurIndex]->getNumValue();}
+		double getCurNumVal(){return CurIndex < EndIndex ? Base->Nums[CurIndex] : 0;}
 
 		// トークンんの文字列を取得（string型）
-		std::string getCurStrVal(){return Tokens[CurIndex]->getStrValue();}
+		std::string getCurStrVal(){return getCurType() == TOK_STR ? getCurString() : "0x7ffffff";}
 
 		// 現在のインデックスを取得
 		int getCurIndex(){return CurIndex;}
 
-		// 現在の行を取得
-		int getCurLine(){return Tokens[CurIndex]->getLine();}
-		
-		int getTokensSize(){return Tokens.size();}
+		// 現在の行を取得 (範囲の終わりでは最後のトークンの行)
+		int getCurLine(){return getLine(CurIndex < EndIndex ? CurIndex : EndIndex-1);}
 		
-		bool eraseToken(int i){Tokens.erase(Tokens.begin()+i); return true;}
-
-		Token *getToken(int i){return Tokens.at(i);}
+		int getTokensSize(){return Base->Types.size();}
 
 		bool getNextStatement();
 		bool getNextFunction();
@@ -126,7 +138,8 @@ class TokenStream{
 		bool printTokens();
 };
 
-
 TokenStream *LexicalAnalysis(std::string input_filename);
+TokenStream *LexicalAnalysis(std::istream &ifs, std::string input_name);
+TokenStream *LexicalAnalysis(llvm::MemoryBuffer *buffer, std::string input_name);
 
 #endif
@@ -0,0 +1,59 @@
+#ifndef LTO_HPP
+#define LTO_HPP
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <llvm/Function.h>
+#include <llvm/Instructions.h>
+#include <llvm/Module.h>
+#include <llvm/Pass.h>
+#include <llvm/PassManager.h>
+#include <llvm/Transforms/IPO.h>
+#include <llvm/Transforms/IPO/PassManagerBuilder.h>
+#include "APP.hpp"
+
+/**
+ * Moduleの大きさ
+ */
+struct ModuleStats{
+	int Functions;    // 定義されている関数の数
+	int Instructions; // 命令数
+	int Calls;        // Module内で定義された関数の呼び出し数
+};
+
+/**
+ * Moduleの大きさを数えるパス
+ * IRは変更しない
+ */
+class ModuleStatsPass : public llvm::ModulePass{
+	ModuleStats *Stats;
+	public:
+		static char ID;
+		ModuleStatsPass(ModuleStats *stats) : llvm::ModulePass(ID), Stats(stats){}
+		virtual bool runOnModule(llvm::Module &M);
+		virtual void getAnalysisUsage(llvm::AnalysisUsage &AU) const{AU.setPreservesAll();}
+		virtual const char *getPassName() const{return "Module Statistics";}
+};
+
+/**
+ * リンク時最適化クラス
+ * -l で結合したModuleを含めて、main以外を内部リンケージにして
+ * プログラム全体でインライン展開, globalopt, IPSCCP, 未使用関数の削除を行う
+ */
+class LTOOptimizer{
+	private:
+		ModuleStats Before; // 通常の最適化後
+		ModuleStats After;  // LTO後
+
+	public:
+		LTOOptimizer(){
+			Before.Functions = Before.Instructions = Before.Calls = 0;
+			After = Before;
+		}
+		void addPasses(llvm::PassManagerBase &pm, int opt_level);
+		void printReport(std::string file_name);
+};
+
+#endif
@@ -2,34 +2,77 @@
 #define PARSER_HPP
 
 #include <algorithm>
+#include <atomic>
+#include <cstdarg>
 #include <cstdio>
 #include <cstdlib>
 #include <map>
+#include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
+#include <llvm/ADT/DenseMap.h>
 #include "APP.hpp"
 #include "AST.hpp"
 #include "lexer.hpp"
+#include "profiler.hpp"
+#include "symbol.hpp"
+
+/**
+ * トップレベルの関数1つ分の範囲
+ * 字句解析で関数の終わりに ]] を置いているので、先に境界を探して関数ごとに解析する
+ */
+struct FunctionUnit{
+	int Begin;               // 先頭のトークン
+	int End;                 // 最後のトークン(]] かEOF)の次
+	int Body;                // 本体の { のトークン (プロトタイプ宣言だけなら-1)
+	int Line;                // 関数の行
+	PrototypeAST *Proto;     // プロトタイプ (解析失敗:NULL)
+	FunctionAST *Function;   // 関数定義 (解析失敗:NULL)
+	std::string Diagnostics; // エラーメッセージ (最後にソースの順に出力する)
+
+	FunctionUnit(int begin, int end)
+		: Begin(begin), End(end), Body(-1), Line(0), Proto(NULL), Function(NULL){}
+};
 
 /**
  * 構文解析・意味解析クラス
+ * 関数の本体はJobs個のスレッドで並列に解析できる
+ * (スレッドごとに作るParserは表のコピーとアリーナを持つ)
  */
 class Parser{
 	private:
 		TokenStream *Tokens;
 		TranslationUnitAST *TU;
+		ASTArena *Arena; // ASTのノードを確保するTUのアリーナ
+		std::string *Diagnostics; // エラーメッセージの出力先 (NULLならstderr)
+		int Jobs; // 関数の本体を並列に解析するスレッド数
 		
-		// 意味解析用各種識別子標
-		std::vector<std::string> VariableTable;
-		std::map<std::string, int> PrototypeTable;
-		std::map<std::string, int> FunctionTable;
+		// 意味解析用各種識別子標 (識別子の番号で引くハッシュ表)
+		ScopedSymbolTable VariableTable; // 関数ごとにスコープを作る
+		llvm::DenseMap<SymbolID, int> PrototypeTable;
+		llvm::DenseMap<SymbolID, int> FunctionTable;
+
+		// 解析中の文を囲んでいる if, for (break, continue の飛び先を決める)
+		std::vector<BaseAST*> Enclosing;
+
+		// REPL用 (入力ごとに解析するので、mainの変数と関数表を引き継ぐ)
+		bool Incremental;
+		std::vector<SymbolID> MainVariableTable;
+		std::vector<SymbolID> SavedMainVariableTable;
+		llvm::DenseMap<SymbolID, int> SavedPrototypeTable;
+		llvm::DenseMap<SymbolID, int> SavedFunctionTable;
 	public:
 		Parser(std::string filename);
+		Parser() : Tokens(NULL), TU(NULL), Arena(NULL), Diagnostics(NULL), Jobs(1), Incremental(true){}
 		~Parser() {
 			SAFE_DELETE(TU);
 			SAFE_DELETE(Tokens);
 		}
+		void setJobs(int jobs){Jobs = jobs > 0 ? jobs : 1;}
 		bool doParse();
+		bool parseSource(std::string source);
+		void rollback();
 		bool CORRECT = true;
 		TranslationUnitAST &getAST();
 
@@ -37,12 +80,19 @@ class Parser{
 		/**
 		 * 各種構文解析メソッド
 		 */
+		Parser(Parser &parent, ASTArena *arena);
+		void printError(const char *format, ...);
+
 		bool visitTranslationUnit();
-		bool visitExternalDeclaration(TranslationUnitAST *tunit);
+		void scanFunctionUnits(std::vector<FunctionUnit> &units);
+		void visitFunctionUnitDeclaration(FunctionUnit &unit);
+		void visitFunctionUnitBody(TokenStream &tokens, FunctionUnit &unit);
+		bool parseFunctionUnitsInParallel(std::vector<FunctionUnit> &units);
 		PrototypeAST *visitFunctionDeclaration();
-		FunctionAST *visitFunctionDefinition();
+		FunctionAST *visitFunctionDefinition(PrototypeAST *proto, int line);
 		PrototypeAST *visitPrototype();
 		FunctionStmtAST *visitFunctionStatement(PrototypeAST *proto);
+		BlockAST *visitBlock(FunctionStmtAST *func_stmt);
 		VariableDeclAST *visitVariableDeclaration();
 		BaseAST *visitStatement(FunctionStmtAST *func_stmt);
 		BaseAST *visitExpressionStatement(FunctionStmtAST *func_stmt);
@@ -54,9 +104,10 @@ class Parser{
 		BaseAST *visitPrimaryExpression(FunctionStmtAST *func_stmt);
 		BaseAST *visitGlobalStatement(FunctionStmtAST *func_stmt);
 		BaseAST *visitIfStatement(FunctionStmtAST *func_stmt);
-		BaseAST *visitIfEndStatement();
-		ForStatementAST *visitForStatement(FunctionStmtAST *func_stmt, int id);
-		BaseAST *visitForEndStatement();
+		bool visitIfCondition(IfStatementAST *if_expr, FunctionStmtAST *func_stmt);
+		ForStatementAST *visitForStatement(FunctionStmtAST *func_stmt);
+		bool isRangeStatement();
+		ForStatementAST *findEnclosingLoop(int depth);
 		BaseAST *visitBreakStatement();
 		BaseAST *visitContinueStatement();
 };
@@ -0,0 +1,50 @@
+#ifndef PGO_HPP
+#define PGO_HPP
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/Attributes.h>
+#include <llvm/Constants.h>
+#include <llvm/DerivedTypes.h>
+#include <llvm/Function.h>
+#include <llvm/GlobalVariable.h>
+#include <llvm/IRBuilder.h>
+#include <llvm/Instructions.h>
+#include <llvm/LLVMContext.h>
+#include <llvm/MDBuilder.h>
+#include <llvm/Metadata.h>
+#include <llvm/Module.h>
+#include "APP.hpp"
+
+/**
+ * プロファイルによる最適化 (PGO) クラス
+ * -fprofile-generate : 基本ブロックごとにカウンタを埋め込み、終了時にファイルに書き出す
+ * -fprofile-use      : 書き出したカウンタを読み込み、分岐の重みと関数の呼び出し回数を付ける
+ * どちらもコード生成の直後、最適化の前のModuleに対して行う
+ * ブロックの番号は関数と基本ブロックの並び順なので、同じソースでないと使えない
+ * (Moduleの形のハッシュ値で確認する)
+ */
+class PGO{
+	private:
+		std::string ProfileFile; // プロファイルのファイル名
+
+	public:
+		PGO(std::string file_name) : ProfileFile(file_name){}
+		bool instrumentModule(llvm::Module &mod);
+		bool applyProfile(llvm::Module &mod);
+
+	private:
+		static uint64_t computeShapeHash(llvm::Module &mod, uint64_t &block_num);
+		static llvm::BasicBlock::iterator getCounterInsertPoint(llvm::BasicBlock &bb);
+		static llvm::Function *createDumpFunction(llvm::Module &mod, llvm::GlobalVariable *header,
+				llvm::GlobalVariable *counters, uint64_t block_num, std::string file_name);
+		static uint32_t scaleWeight(uint64_t count, uint64_t max_count);
+};
+
+#endif
@@ -0,0 +1,188 @@
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <llvm/Analysis/CallGraphSCCPass.h>
+#include <llvm/Analysis/LoopPass.h>
+#include <llvm/Function.h>
+#include <llvm/Module.h>
+#include <llvm/Pass.h>
+#include <llvm/PassManager.h>
+#include <llvm/PassRegistry.h>
+#include "APP.hpp"
+
+/**
+ * 時間計測クラス
+ * -time-report でフェーズ・関数・LLVMパスごとの実時間, CPU時間, 最大RSSを表示し
+ * -trace で Chrome trace 形式(chrome://tracing)のJSONを出力する
+ * 複数スレッドから呼ばれるので記録はLockで保護する
+ */
+class Profiler{
+	public:
+		/**
+		 * 計測した区間
+		 */
+		struct Event{
+			std::string Category; // phase, function, pass
+			std::string Name;     // 区間名 (フェーズ名, パス名)
+			std::string Detail;   // 対象 (関数名など)
+			uint64_t Start;       // 開始時刻 (マイクロ秒)
+			uint64_t Wall;        // 実時間 (マイクロ秒)
+			uint64_t CPU;         // CPU時間 (マイクロ秒)
+			long PeakRSS;         // 区間終了時の最大RSS (KB)
+			int Tid;              // スレッド番号
+		};
+
+	private:
+		bool Enabled;
+		bool Report;
+		std::string TraceFile;
+		uint64_t BaseTime;
+		std::vector<Event> Events;
+		std::map<std::thread::id, int> ThreadIds;
+		std::mutex Lock;
+
+		Profiler() : Enabled(false), Report(false), BaseTime(0){}
+
+	public:
+		static Profiler &getInstance();
+		bool initialize(bool report, std::string trace_file);
+		bool isEnabled(){return Enabled;}
+		void addEvent(std::string category, std::string name, std::string detail,
+				uint64_t start, uint64_t wall, uint64_t cpu);
+		bool finish();
+
+		static uint64_t getWallTime();
+		static uint64_t getCPUTime();
+		static long getPeakRSS();
+
+	private:
+		void printReport();
+		bool writeTrace();
+		static std::string escapeJSON(std::string str);
+};
+
+/**
+ * スコープ内の時間を計測するクラス
+ * 計測が無効な場合は何もしない
+ */
+class ProfileScope{
+	std::string Category;
+	std::string Name;
+	std::string Detail;
+	uint64_t StartWall;
+	uint64_t StartCPU;
+	bool Active;
+
+	public:
+		ProfileScope(std::string category, std::string name, std::string detail = "");
+		~ProfileScope();
+
+		// 計測対象を設定 (関数名などが後から分かる場合)
+		void setDetail(std::string detail){Detail = detail;}
+};
+
+/**
+ * LLVMパスの区間
+ * 開始マーカーと終了マーカーで共有し、IRの単位(関数, ループなど)ごとに開始時刻を持つ
+ */
+class PassSpan{
+	std::string Name;
+	std::map<const void*, std::pair<uint64_t, uint64_t>> Starts;
+
+	public:
+		PassSpan(std::string name) : Name(name){}
+		void begin(const void *unit);
+		void end(const void *unit, std::string detail);
+};
+
+/**
+ * 計測用マーカーパス
+ * 計測対象のパスと同じ種類のパスにして、パスマネージャの構成を変えないようにする
+ * 解析結果は全て保存する
+ */
+class TraceModuleMarker : public llvm::ModulePass{
+	PassSpan *Span;
+	bool IsBegin;
+	public:
+		static char ID;
+		TraceModuleMarker(PassSpan *span, bool is_begin) : llvm::ModulePass(ID), Span(span), IsBegin(is_begin){}
+		virtual bool runOnModule(llvm::Module &M);
+		virtual void getAnalysisUsage(llvm::AnalysisUsage &AU) const{AU.setPreservesAll();}
+		virtual const char *getPassName() const{return "Trace Module Marker";}
+};
+
+class TraceSCCMarker : public llvm::CallGraphSCCPass{
+	PassSpan *Span;
+	bool IsBegin;
+	public:
+		static char ID;
+		TraceSCCMarker(PassSpan *span, bool is_begin) : llvm::CallGraphSCCPass(ID), Span(span), IsBegin(is_begin){}
+		virtual bool runOnSCC(llvm::CallGraphSCC &SCC);
+		virtual void getAnalysisUsage(llvm::AnalysisUsage &AU) const{
+			llvm::CallGraphSCCPass::getAnalysisUsage(AU);
+			AU.setPreservesAll();
+		}
+		virtual const char *getPassName() const{return "Trace SCC Marker";}
+};
+
+class TraceFunctionMarker : public llvm::FunctionPass{
+	PassSpan *Span;
+	bool IsBegin;
+	public:
+		static char ID;
+		TraceFunctionMarker(PassSpan *span, bool is_begin) : llvm::FunctionPass(ID), Span(span), IsBegin(is_begin){}
+		virtual bool runOnFunction(llvm::Function &F);
+		virtual void getAnalysisUsage(llvm::AnalysisUsage &AU) const{AU.setPreservesAll();}
+		virtual const char *getPassName() const{return "Trace Function Marker";}
+};
+
+class TraceLoopMarker : public llvm::LoopPass{
+	PassSpan *Span;
+	bool IsBegin;
+	public:
+		static char ID;
+		TraceLoopMarker(PassSpan *span, bool is_begin) : llvm::LoopPass(ID), Span(span), IsBegin(is_begin){}
+		virtual bool runOnLoop(llvm::Loop *L, llvm::LPPassManager &LPM);
+		virtual void getAnalysisUsage(llvm::AnalysisUsage &AU) const{AU.setPreservesAll();}
+		virtual const char *getPassName() const{return "Trace Loop Marker";}
+};
+
+/**
+ * 追加されたパスの前後にマーカーを挿入するPassManager
+ * 計測が無効な場合は通常のPassManagerと同じ
+ */
+class TracingPassManager : public llvm::PassManager{
+	std::vector<PassSpan*> Spans;
+	bool Tracing;
+
+	public:
+		TracingPassManager() : Tracing(Profiler::getInstance().isEnabled()){}
+		~TracingPassManager();
+		virtual void add(llvm::Pass *P);
+
+		// コード生成パスなど、計測しないパスを追加する前にfalseにする
+		void setTracing(bool tracing){Tracing = tracing && Profiler::getInstance().isEnabled();}
+};
+
+class TracingFunctionPassManager : public llvm::FunctionPassManager{
+	std::vector<PassSpan*> Spans;
+	bool Tracing;
+
+	public:
+		TracingFunctionPassManager(llvm::Module *mod)
+			: llvm::FunctionPassManager(mod), Tracing(Profiler::getInstance().isEnabled()){}
+		~TracingFunctionPassManager();
+		virtual void add(llvm::Pass *P);
+};
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef REPL_HPP
+#define REPL_HPP
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <stdint.h>
+#include <llvm/ExecutionEngine/ExecutionEngine.h>
+#include <llvm/ExecutionEngine/JIT.h>
+#include <llvm/LLVMContext.h>
+#include <llvm/Module.h>
+#include "APP.hpp"
+#include "AST.hpp"
+#include "parser.hpp"
+#include "codegen.hpp"
+#include "profiler.hpp"
+
+/**
+ * 対話実行クラス (dcc -i)
+ * Module, JIT, Parserの関数表とmainの変数を入力の間で引き継ぎ
+ * 入力ごとに追加された関数だけをコンパイルして実行する
+ * 入力の文はmainとしてコード生成し、名前を変えて実行した後に削除する
+ */
+class REPL{
+	private:
+		Parser *InputParser;      // 関数表とmainの変数を保持するParser
+		CodeGen *Generator;       // Moduleを保持するCodeGen
+		llvm::ExecutionEngine *EE; // JIT
+		int Count;                // 実行した入力の数
+
+	public:
+		REPL(llvm::LLVMContext &context);
+		~REPL();
+		bool initialize();
+		int run();
+
+	private:
+		bool readInput(std::string &source);
+		bool evaluate(std::string source);
+		static int countBraces(std::string line);
+};
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef SERVER_HPP
+#define SERVER_HPP
+
+#include <cerrno>
+#include <climits>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <llvm/LLVMContext.h>
+#include <llvm/Module.h>
+#include <llvm/ADT/OwningPtr.h>
+#include <llvm/Support/IRReader.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/SourceMgr.h>
+#include <llvm/Support/system_error.h>
+#include "APP.hpp"
+
+class CompileServer;
+
+/**
+ * 1リクエストの処理関数
+ * @param 引数(dccに渡すオプションと入力ファイル) サーバ
+ * @return 終了コード
+ */
+typedef int (*RequestHandler)(std::vector<std::string> &args, CompileServer &server);
+
+/**
+ * コンパイルサーバクラス (dcc --serve)
+ * Unixソケットでリクエストを待ち、ターゲットの初期化と -l のファイルの読み込みを
+ * リクエストの間で使い回す
+ * -l のModuleは1つのLLVMContextに読み込んだまま持ち、各リクエストはそのLLVMContextでコンパイルする
+ * LLVMContextには型や定数が溜まり続けるので、RecycleRequests回のリクエストか
+ * メモリ使用量がRecycleRSSを超えたら-l のModuleごと作り直す
+ * クライアントの標準入出力をソケットで受け取って差し替えるので
+ * コンパイルエラーの出力はクライアント側に出る
+ * リクエストは1つずつ順に処理する
+ */
+class CompileServer{
+	private:
+		std::string SocketPath; // ソケットのパス
+		std::string ExeFile;    // dccの実行ファイル名 (キャッシュのキー用)
+		int ListenFd;           // 待ち受けソケット
+		llvm::LLVMContext *Context; // -l のModuleを読み込んだLLVMContext (作り直すまで使い回す)
+		std::map<std::string, std::pair<time_t, llvm::Module*>> LinkModules; // 読み込み済みの -l のModule (更新時刻)
+		int ContextRequests;        // Contextで処理したリクエスト数
+
+		static const int RecycleRequests = 100;       // この回数処理したらContextを作り直す
+		static const long RecycleRSS = 512 * 1024;    // メモリ使用量(KB)がこれを超えたらContextを作り直す
+
+	public:
+		CompileServer(std::string socket_path, std::string exe_file)
+			: SocketPath(socket_path), ExeFile(exe_file), ListenFd(-1), Context(NULL), ContextRequests(0){}
+		~CompileServer();
+		bool initialize();
+		int run(RequestHandler handler);
+
+		std::string getExeFile(){return ExeFile;}
+		llvm::LLVMContext &getContext();
+		llvm::Module *getLinkModule(std::string file_name);
+		void finishRequest();
+
+		static std::string getDefaultSocketPath();
+		static int sendRequest(std::string socket_path, int argc, char **argv);
+
+	private:
+		bool handleConnection(int fd, RequestHandler handler);
+		void recycleContext();
+		static long getCurrentRSS();
+		static void closeReceivedFds(struct msghdr *msg);
+		static bool writeAll(int fd, const void *data, size_t size);
+		static bool readAll(int fd, void *data, size_t size);
+};
+
+#endif
@@ -0,0 +1,110 @@
+#ifndef SYMBOL_HPP
+#define SYMBOL_HPP
+
+#include <mutex>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/ADT/StringRef.h>
+#include "APP.hpp"
+
+/**
+ * 識別子の番号
+ * 同じ名前には同じ番号が振られ、0から連続する
+ */
+typedef int SymbolID;
+
+/**
+ * 識別子のインターン表
+ * 字句解析で識別子を登録し、以降の構文解析・コード生成では番号で比較する
+ * 表は翻訳単位(入力ファイル)ごとに作り、Bindingでスレッドに結び付ける
+ * (getInstanceはスレッドに結び付けた表を返し、なければREPL用のプロセスの表を返す)
+ * 1つの表は1つのスレッドで使うのでLockはいらない
+ * 関数の本体を並列に構文解析する間だけsetConcurrentでLockを使う
+ */
+class SymbolTable{
+	private:
+		llvm::StringMap<SymbolID> IDs;
+		std::vector<llvm::StringMapEntry<SymbolID>*> Entries; // 番号から名前を引く
+		std::mutex Lock;
+		bool Concurrent; // 複数スレッドから使っている間はtrue
+
+		SymbolTable(const SymbolTable&);
+		SymbolTable &operator=(const SymbolTable&);
+
+	public:
+		static const SymbolID None = -1;
+
+		/**
+		 * 表を現在のスレッドに結び付ける (スコープを抜けると前の表に戻す)
+		 */
+		class Binding{
+			SymbolTable *Previous;
+			public:
+				Binding(SymbolTable &table);
+				~Binding();
+		};
+
+		SymbolTable() : Concurrent(false){}
+		static SymbolTable &getInstance();
+		SymbolID intern(llvm::StringRef name);
+		llvm::StringRef getName(SymbolID symbol);
+		int size();
+
+		// 複数スレッドから使う間だけLockを使う (切り替えは1スレッドだけの時に行う)
+		void setConcurrent(bool concurrent){Concurrent = concurrent;}
+};
+
+/**
+ * 識別子の番号をキーにしたスコープ付きのハッシュ表
+ * オープンアドレス法(線形探索)で、容量は2のべき乗
+ * スコープを抜ける時はそのスコープで追加したものを追加と逆順に消すので
+ * 削除済みの印はいらず、消した位置を空にするだけでよい
+ */
+class ScopedSymbolTable{
+	private:
+		struct Slot{
+			SymbolID Symbol; // 空なら SymbolTable::None
+			int Value;
+		};
+		std::vector<Slot> Slots;
+		std::vector<SymbolID> Log;    // 追加した番号 (追加順)
+		std::vector<int> ScopeStarts; // 各スコープの開始時のLogの長さ
+		uint64_t Finds;  // 探索回数 (-time-report 用)
+		uint64_t Probes; // 探索で見た位置の数
+		uint64_t Grows;  // 容量を2倍にした回数
+
+	public:
+		ScopedSymbolTable() : Finds(0), Probes(0), Grows(0){clear();}
+
+		void pushScope(){ScopeStarts.push_back(Log.size());}
+		void popScope();
+		void clear();
+
+		bool insert(SymbolID symbol, int value = 0);
+		bool contains(SymbolID symbol){return find(symbol) >= 0;}
+		int lookup(SymbolID symbol, int default_value = -1);
+
+		// 現在のスコープで追加した番号を追加順に取得する
+		std::vector<SymbolID> getScopeSymbols();
+
+		// 統計 (clearでは消さない)
+		uint64_t getFinds(){return Finds;}
+		uint64_t getProbes(){return Probes;}
+		uint64_t getGrows(){return Grows;}
+		void addStats(ScopedSymbolTable &other){
+			Finds += other.Finds;
+			Probes += other.Probes;
+			Grows += other.Grows;
+		}
+
+	private:
+		int find(SymbolID symbol);
+		int getHome(SymbolID symbol){
+			return ((unsigned)symbol * 2654435761u) & (Slots.size() - 1);
+		}
+		void grow();
+};
+
+#endif
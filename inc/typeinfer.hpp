@@ -0,0 +1,64 @@
+#ifndef TYPEINFER_HPP
+#define TYPEINFER_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/DenseSet.h>
+#include <llvm/Support/Casting.h>
+#include "APP.hpp"
+#include "AST.hpp"
+#include "symbol.hpp"
+
+/**
+ * 数値の型推論クラス
+ * 関数の変数のうち、代入される値が常に整数になる変数を調べてdint64にする
+ * (コード生成では整数と推論した + - * % // をi64のまま計算し、doubleとの演算や / の時だけ変換する)
+ * 整数になる式 : 整数の定数, 整数の変数, 整数同士の + - * %, //
+ * ただし値の範囲が ±2^53 に収まると分かる場合だけ (doubleで計算した時と結果が同じになる)
+ * 範囲は変数ごとに代入される値の範囲を合わせて求め、広がり続ける変数(繰り返しで足していく変数など)は無限とする
+ * 引数, 関数の戻り値, global宣言した変数, inputで読む変数はdoubleとする
+ */
+class TypeInference{
+	private:
+		/**
+		 * 値の範囲 (両端を含む, 分からなければ無限)
+		 */
+		struct Range{
+			double Low;
+			double High;
+		};
+
+		llvm::DenseSet<SymbolID> Integers;   // 整数と推論している変数
+		llvm::DenseMap<SymbolID, Range> Ranges; // ローカル変数の値の範囲
+		llvm::DenseMap<SymbolID, int> Widens;   // 範囲が広がった周回の数 (多ければ無限にする)
+		llvm::DenseSet<SymbolID> Grown;         // この周回で範囲が広がった変数
+		bool Changed;                        // 推論を1周する間に整数から外した変数か広がった範囲があるか
+
+	public:
+		TypeInference() : Changed(false){}
+		int inferFunction(FunctionStmtAST *func_stmt, const llvm::DenseSet<SymbolID> &doubles);
+
+		// i64で正確に表せる整数の定数か判定する
+		static bool isIntegerNumber(double value){
+			return value == std::floor(value) && std::fabs(value) <= 9007199254740992.0;
+		}
+
+	private:
+		void visitBlock(BlockAST *block);
+		void visitStatement(BaseAST *stmt);
+		bool visitExpression(BaseAST *expr, Range &range);
+		void setDouble(SymbolID symbol);
+		void widenRange(SymbolID symbol, Range range);
+
+		static Range getUnknownRange();
+		static bool isExactRange(Range range);
+		static Range getBinaryRange(BinaryOp op, Range lhs, Range rhs);
+		static double multiplyBound(double lhs, double rhs);
+};
+
+#endif
@@ -0,0 +1,49 @@
+#!/bin/sh
+# 式の多い .gd を生成して構文解析とコード生成の時間を測る
+#   sh gen_exprs.sh <n>            : 二項演算と比較を多く含む関数をn個, 標準出力に書く
+#   sh gen_exprs.sh -bench [dcc]   : n = 100, 1000, 10000 で -time-report の構文解析とコード生成の実時間を表示
+# 1関数あたり二項演算 約200個, 比較 12個 (全ての演算子と and, or を使う)
+
+gen(){
+	awk -v n="$1" 'BEGIN{
+		for(i = 0; i < n; i++){
+			printf "f%d(a, b){\n", i
+			print "\tx = 0"
+			for(j = 0; j < 8; j++){
+				print "\tx = (a + b) * (a - b) // 3 + a % 7 - b * 2 + (x + 1) / 4 - (a * b + x) % 11"
+				print "\ty = (x + a) * 2 - b // 5 + (y - x) * 3 % 13 + a / 2"
+			}
+			print "\tif x == y or x != a and y < b{"
+			print "\t\tx += y * 2 - 1"
+			print "\t}"
+			print "\tif x > y and [x <= a or y >= b]{"
+			print "\t\ty -= x // 2 + 1"
+			print "\t}"
+			print "\tif a < b and b <= x and x > y or y >= a and a != x and x == b{"
+			print "\t\tx = x % 7 + y % 5"
+			print "\t}"
+			print "\treturn x + y"
+			print "}"
+		}
+		print ""
+		print "print(f0(3, 4))"
+	}'
+}
+
+if [ "$1" = "-bench" ]; then
+	DCC=${2:-dcc}
+	TMP=${TMPDIR:-/tmp}/dcc-exprs-$$
+	mkdir -p "$TMP" || exit 1
+	for n in 100 1000 10000; do
+		gen $n > "$TMP/exprs$n.gd"
+		"$DCC" "$TMP/exprs$n.gd" -emit-llvm -o "$TMP/exprs$n.ll" -j 1 -time-report 2>&1 |
+			awk -v n=$n '$5 == "構文解析"{parse += $1} $5 == "コード生成"{codegen += $1}
+				END{printf "n = %d : 構文解析 %.1f ms, コード生成 %.1f ms\n", n, parse, codegen}'
+	done
+	rm -rf "$TMP"
+elif [ -n "$1" ]; then
+	gen "$1"
+else
+	echo "usage: $0 <n> | -bench [dcc]" >&2
+	exit 1
+fi
@@ -0,0 +1,73 @@
+#!/bin/sh
+# 変数の多いループと分岐の .gd を生成して, SSA構築と -alloca-vars (allocaに置いてmem2reg任せ) を比べる
+#   sh gen_ssa.sh <n>            : ループと分岐の中で変数を書き換える関数をn個, 標準出力に書く
+#   sh gen_ssa.sh -bench [dcc]   : n = 100, 1000 で -O0 と -O2 のコード生成・最適化の実時間と,
+#                                  f0(2000000) を実行する実行ファイルの実行時間を両方の方法で表示
+
+gen(){
+	awk -v n="$1" 'BEGIN{
+		for(i = 0; i < n; i++){
+			printf "f%d(n){\n", i
+			print "\ts = 0"
+			print "\tt = 1"
+			print "\tu = 2"
+			print "\tv = 3"
+			print "\tk = 0..<n{"
+			print "\t\tif k % 3 == 0{"
+			print "\t\t\ts += k"
+			print "\t\t\tt = t + u % 7"
+			print "\t\t}"
+			print "\t\telse{"
+			print "\t\t\tif s > t and u < v{"
+			print "\t\t\t\tu = u + 1"
+			print "\t\t\t}"
+			print "\t\t\tv = (v + s) % 1000"
+			print "\t\t}"
+			print "\t\tj = 0..<4{"
+			print "\t\t\tu = (u + j * v) % 997"
+			print "\t\t\tif u > 500{"
+			print "\t\t\t\tt = t + 1"
+			print "\t\t\t}"
+			print "\t\t}"
+			print "\t}"
+			print "\treturn s + t + u + v"
+			print "}"
+		}
+		print ""
+		print "print(f0(2000000))"
+	}'
+}
+
+# 実行時間 (ms)
+run_ms(){
+	start=$(date +%s%N)
+	"$1" > /dev/null
+	end=$(date +%s%N)
+	echo $(( (end - start) / 1000000 ))
+}
+
+if [ "$1" = "-bench" ]; then
+	DCC=${2:-dcc}
+	TMP=${TMPDIR:-/tmp}/dcc-ssa-$$
+	mkdir -p "$TMP" || exit 1
+	for n in 100 1000; do
+		gen $n > "$TMP/ssa$n.gd"
+		for O in -O0 -O2; do
+			for mode in ssa alloca; do
+				flag=
+				[ $mode = alloca ] && flag=-alloca-vars
+				"$DCC" "$TMP/ssa$n.gd" $O $flag -o "$TMP/ssa$n" -j 1 -time-report 2>&1 |
+					awk -v n=$n -v O=$O -v mode=$mode '$5 == "コード生成"{codegen += $1}
+						$5 == "関数単位の最適化"{fopt += $1} $5 == "最適化・コード出力"{emit += $1}
+						END{printf "n = %d %s %-6s : コード生成 %.1f ms, 関数単位の最適化 %.1f ms, 最適化・コード出力 %.1f ms", n, O, mode, codegen, fopt, emit}'
+				echo ", 実行 $(run_ms "$TMP/ssa$n") ms"
+			done
+		done
+	done
+	rm -rf "$TMP"
+elif [ -n "$1" ]; then
+	gen "$1"
+else
+	echo "usage: $0 <n> | -bench [dcc]" >&2
+	exit 1
+fi
@@ -0,0 +1,45 @@
+#!/bin/sh
+# 関数の数を変えた .gd を生成して字句解析・構文解析のスループット(トークン/秒)を測る
+#   sh gen_tokens.sh <n>           : n個の関数(ループ, 条件分岐, 式を含む)を標準出力に書く
+#   sh gen_tokens.sh -bench [dcc]  : n = 1000, 10000, 100000 で -time-report からトークン/秒を表示 (-j 1, 1スレッドで解析)
+# トークン数は構文解析の行の "N tokens", 時間は字句解析と構文解析の実時間の合計
+
+gen(){
+	awk -v n="$1" 'BEGIN{
+		for(i = 0; i < n; i++){
+			printf "f%d(a, b){\n", i
+			print "\tc = a * 2 + b // 3 - a % 5"
+			print "\ti = 1..10{"
+			print "\t\tif c > i and [a < b or b == 0]{"
+			print "\t\t\tc += i"
+			print "\t\t}"
+			print "\t}"
+			print "\treturn c"
+			print "}"
+		}
+		print ""
+		print "print(f0(1, 2))"
+	}'
+}
+
+if [ "$1" = "-bench" ]; then
+	DCC=${2:-dcc}
+	TMP=${TMPDIR:-/tmp}/dcc-tokens-$$
+	mkdir -p "$TMP" || exit 1
+	for n in 1000 10000 100000; do
+		gen $n > "$TMP/tokens$n.gd"
+		"$DCC" "$TMP/tokens$n.gd" -emit-llvm -o "$TMP/tokens$n.ll" -j 1 -time-report 2>&1 |
+			awk -v n=$n '$5 == "字句解析"{lex += $1} $5 == "構文解析"{parse += $1; tokens = $6}
+				END{
+					if(tokens == "" || lex + parse <= 0){print "n = " n " : -time-report の結果がありません"; exit}
+					printf "n = %d : %d tokens, 字句解析 %.1f ms, 構文解析 %.1f ms, %.0f tokens/s\n",
+						n, tokens, lex, parse, tokens / ((lex + parse) / 1000.0)
+				}'
+	done
+	rm -rf "$TMP"
+elif [ -n "$1" ]; then
+	gen "$1"
+else
+	echo "usage: $0 <n> | -bench [dcc]" >&2
+	exit 1
+fi
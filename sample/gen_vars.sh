@@ -0,0 +1,35 @@
+#!/bin/sh
+# 変数の数を変えた .gd を生成して構文解析の時間を測る
+#   sh gen_vars.sh <n>             : n個の変数を使う関数を標準出力に書く
+#   sh gen_vars.sh -bench [dcc]    : n = 1000, 10000, 100000 で -time-report の構文解析の行を表示
+# 変数表の探索1回あたりの probes と時間が n に比例して伸びていれば線形
+
+gen(){
+	awk -v n="$1" 'BEGIN{
+		print "f(){"
+		print "\tv0 = 1"
+		for(i = 1; i < n; i++)
+			printf "\tv%d = v%d + 1\n", i, i - 1
+		printf "\tprint(v%d)\n", n - 1
+		print "}"
+		print ""
+		print "f()"
+	}'
+}
+
+if [ "$1" = "-bench" ]; then
+	DCC=${2:-dcc}
+	TMP=${TMPDIR:-/tmp}/dcc-vars-$$
+	mkdir -p "$TMP" || exit 1
+	for n in 1000 10000 100000; do
+		gen $n > "$TMP/vars$n.gd"
+		echo "n = $n"
+		"$DCC" "$TMP/vars$n.gd" -emit-llvm -o "$TMP/vars$n.ll" -time-report 2>&1 | grep "構文解析"
+	done
+	rm -rf "$TMP"
+elif [ -n "$1" ]; then
+	gen "$1"
+else
+	echo "usage: $0 <n> | -bench [dcc]" >&2
+	exit 1
+fi
@@ -0,0 +1,44 @@
+# 範囲の繰り返し (期待する出力をコメントに書く)
+
+# 終わりを含む : 1 2 3 4 5
+i = 1..5{
+	print(i)
+}
+
+# ..< は終わりを含まない : 0 1 2 3
+i = 0..<4{
+	print(i)
+}
+
+# step : 0 3 6 9
+i = 0..10 step 3{
+	print(i)
+}
+
+# 減らしていく : 5 4 3 2 1
+i = 5..1 step -1{
+	print(i)
+}
+
+# 減らしていく, 終わりを含まない : 10 8 6
+i = 10..<4 step -2{
+	print(i)
+}
+
+# 範囲は最初に1回だけ計算する : 1 2 3
+n = 3
+i = 1..n{
+	n = n + 1
+	print(i)
+}
+
+# 空の範囲は1回も繰り返さない : 何も出力しない
+i = 5..1{
+	print("empty")
+}
+i = 1..<1{
+	print("empty")
+}
+i = 1..5 step -1{
+	print("empty")
+}
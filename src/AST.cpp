@@ -1,15 +1,22 @@
 #include "AST.hpp"
+/**
+ * アリーナのノードを確保と逆順に破棄し、スラブをまとめて解放する
+ */
+void ASTArena::reset(){
+	for(size_t i = Nodes.size(); i > 0; i--)
+		Nodes[i-1].second(Nodes[i-1].first);
+	Nodes.clear();
+	Allocator.Reset();
+	BytesUsed = 0;
+}
+
 /*
  * デストラクタ
  */
 TranslationUnitAST::~TranslationUnitAST(){
-	for(int i = 0; i < Prototypes.size(); i++)
-		SAFE_DELETE(Prototypes[i]);
-	
-	for(int i = 0; i < Functions.size(); i++)
-		SAFE_DELETE(Functions[i]);
-	Prototypes.clear();
-	Functions.clear();
+	for(int i = 0; i < Arenas.size(); i++)
+		SAFE_DELETE(Arenas[i]);
+	Arenas.clear();
 }
 
 /**
@@ -40,29 +47,6 @@ bool TranslationUnitAST::empty(){
 	}
 }
 
-/**
- * デストラクタ
- */
-FunctionAST::~FunctionAST(){
-	SAFE_DELETE(Proto);
-	SAFE_DELETE(Body);
-}
-
-/*
- * デストラクタ
- */
-FunctionStmtAST::~FunctionStmtAST(){
-	for(int i = 0; i < VariableDecls.size(); i++){
-		SAFE_DELETE(VariableDecls[i]);
-	}
-	VariableDecls.clear();
-
-	for(int i = 0; i < StmtLists.size(); i++){
-		SAFE_DELETE(StmtLists[i]);
-	}
-	StmtLists.clear();
-}
-
 /*
  * VariableDeclAST（変数宣言追加）メソッド
  * @param VariableDeclAST
@@ -72,21 +56,3 @@ bool FunctionStmtAST::addVariableDeclaration(VariableDeclAST *vdecl){
 	VariableDecls.push_back(vdecl);
 	return true;
 }
-
-/*
- * デストラクタ
- */
-CallExprAST::~CallExprAST(){
-	for(int i = 0;i < Args.size(); i++){
-		SAFE_DELETE(Args[i]);
-	}
-}
-
-/**
- * デストラクタ
- */
-IfStatementAST::~IfStatementAST(){
-	for(int i = 0; i < Coms.size(); i++)
-		SAFE_DELETE(Coms[i]);
-	Coms.clear();
-}
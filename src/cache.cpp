@@ -0,0 +1,321 @@
+#include "cache.hpp"
+
+/**
+ * デフォルトのキャッシュディレクトリを取得する
+ * $DCC_CACHE_DIR か $HOME/.cache/dcc
+ * @return キャッシュディレクトリ
+ */
+std::string CompileCache::getDefaultDir(){
+	const char *dir = getenv("DCC_CACHE_DIR");
+	if(dir && dir[0] != '\0')
+		return dir;
+	const char *home = getenv("HOME");
+	if(home && home[0] != '\0')
+		return std::string(home) + "/.cache/dcc";
+	return "/tmp/dcc-cache";
+}
+
+/**
+ * デストラクタ
+ * commitしなかった一時ファイルを削除する
+ */
+CompileCache::~CompileCache(){
+	SAFE_DELETE(BitcodeOut);
+	if(!BitcodeTemp.empty())
+		unlink(BitcodeTemp.c_str());
+	if(!ObjectTemp.empty())
+		unlink(ObjectTemp.c_str());
+}
+
+/**
+ * キャッシュディレクトリを作成する
+ * @return 成功時:true 失敗時:false
+ */
+bool CompileCache::initialize(){
+	std::string error;
+	llvm::sys::Path dir(CacheDir);
+	if(dir.createDirectoryOnDisk(true, &error)){
+		fprintf(stderr, "キャッシュディレクトリ %s が作成できません : %s\n", CacheDir.c_str(), error.c_str());
+		return false;
+	}
+	return true;
+}
+
+/**
+ * キャッシュのキーを計算する
+ * 入力ファイル、リンクファイルの内容、オプション、コンパイラのバージョンと
+ * dcc自身の更新時刻からハッシュ値を計算する
+ * @param 入力ファイル名 リンクファイル名 オプション文字列 dccの実行ファイル名
+ * @return キー(16進数) 失敗時:空文字列
+ */
+std::string CompileCache::computeKey(std::string input_file, std::string link_file,
+		std::string flags, std::string exe_file){
+	std::string data;
+	std::string contents;
+
+	data += DCC_VERSION;
+	data += '\0';
+#ifdef LLVM_VERSION_MAJOR
+	data += "llvm-" + std::to_string(LLVM_VERSION_MAJOR) + "." + std::to_string(LLVM_VERSION_MINOR);
+	data += '\0';
+#endif
+
+	// dcc自身が再ビルドされたらキーを変える
+	struct stat st;
+	if(!exe_file.empty() && stat(exe_file.c_str(), &st) == 0){
+		data += std::to_string((long long)st.st_mtime) + ":" + std::to_string((long long)st.st_size);
+		data += '\0';
+	}
+
+	data += flags;
+	data += '\0';
+
+	if(!readFile(input_file, contents))
+		return "";
+	data += std::to_string((long long)contents.size()) + ":" + contents;
+
+	if(!link_file.empty()){
+		if(!readFile(link_file, contents))
+			return "";
+		data += std::to_string((long long)contents.size()) + ":" + contents;
+	}
+
+	char key[33];
+	snprintf(key, sizeof(key), "%016llx%016llx",
+			(unsigned long long)hashString(data, 14695981039346656037ULL),
+			(unsigned long long)hashString(data, 0x9e3779b97f4a7c15ULL));
+	return key;
+}
+
+/**
+ * キャッシュしたbitcodeを読み込む
+ * @param キー LLVMContext
+ * @return 成功時:Module 失敗時:NULL
+ */
+llvm::Module *CompileCache::loadBitcode(std::string key, llvm::LLVMContext &context){
+	std::string path = getBitcodePath(key);
+	llvm::OwningPtr<llvm::MemoryBuffer> buffer;
+	if(llvm::MemoryBuffer::getFile(path, buffer))
+		return NULL;
+
+	std::string error;
+	llvm::Module *mod = llvm::ParseBitcodeFile(buffer.get(), context, &error);
+	if(!mod){
+		// 壊れたキャッシュは削除する
+		fprintf(stderr, "キャッシュ %s が読み込めません : %s\n", path.c_str(), error.c_str());
+		unlink(path.c_str());
+		return NULL;
+	}
+	touch(path);
+	return mod;
+}
+
+/**
+ * Moduleをbitcodeとしてキャッシュに保存する
+ * @param キー Module
+ * @return 成功時:true 失敗時:false
+ */
+bool CompileCache::storeBitcode(std::string key, llvm::Module &mod){
+	std::string error;
+	std::string tmp = createTempPath(getBitcodePath(key));
+	if(tmp.empty())
+		return false;
+	{
+		llvm::tool_output_file out(tmp.c_str(), error, llvm::raw_fd_ostream::F_Binary);
+		if(!error.empty()){
+			unlink(tmp.c_str());
+			return false;
+		}
+		llvm::WriteBitcodeToFile(&mod, out.os());
+		out.keep();
+	}
+	if(rename(tmp.c_str(), getBitcodePath(key).c_str()) != 0){
+		unlink(tmp.c_str());
+		return false;
+	}
+	return evict();
+}
+
+/**
+ * PassManagerにbitcode出力パスを追加する
+ * 最適化パスの後、コード生成パスの前に呼ぶ
+ * 保存はcommitで確定する
+ * @param キー PassManager
+ * @return 成功時:true 失敗時:false
+ */
+bool CompileCache::addBitcodeWriter(std::string key, llvm::PassManager &pm){
+	std::string error;
+	SAFE_DELETE(BitcodeOut);
+	if(!BitcodeTemp.empty())
+		unlink(BitcodeTemp.c_str());
+	BitcodeTemp = createTempPath(getBitcodePath(key));
+	if(BitcodeTemp.empty())
+		return false;
+	BitcodeOut = new llvm::tool_output_file(BitcodeTemp.c_str(), error, llvm::raw_fd_ostream::F_Binary);
+	if(!error.empty()){
+		SAFE_DELETE(BitcodeOut);
+		unlink(BitcodeTemp.c_str());
+		BitcodeTemp.clear();
+		return false;
+	}
+	pm.add(llvm::createBitcodeWriterPass(BitcodeOut->os()));
+	return true;
+}
+
+/**
+ * オブジェクトファイルを書き込む一時ファイルを作る
+ * 保存はcommitで確定する
+ * @param キー
+ * @return 一時ファイル名 失敗時:空文字列
+ */
+std::string CompileCache::createTempObjectPath(std::string key){
+	if(!ObjectTemp.empty())
+		unlink(ObjectTemp.c_str());
+	ObjectTemp = createTempPath(getObjectPath(key));
+	return ObjectTemp;
+}
+
+/**
+ * 書き込んだbitcodeとオブジェクトファイルをキャッシュに確定する
+ * 同じキーを別の書き込み元が先に確定していても、renameで丸ごと置き換えるので壊れない
+ * @param キー
+ * @return 成功時:true 失敗時:false
+ */
+bool CompileCache::commit(std::string key){
+	bool result = true;
+	if(BitcodeOut){
+		BitcodeOut->keep();
+		SAFE_DELETE(BitcodeOut);
+		if(rename(BitcodeTemp.c_str(), getBitcodePath(key).c_str()) != 0){
+			unlink(BitcodeTemp.c_str());
+			result = false;
+		}
+		BitcodeTemp.clear();
+	}
+	if(!ObjectTemp.empty()){
+		struct stat st;
+		// 空なら書き込まれていない
+		if(stat(ObjectTemp.c_str(), &st) != 0 || st.st_size == 0 ||
+				rename(ObjectTemp.c_str(), getObjectPath(key).c_str()) != 0){
+			unlink(ObjectTemp.c_str());
+			result = false;
+		}
+		ObjectTemp.clear();
+	}
+	return evict() && result;
+}
+
+/**
+ * 最終使用時刻を更新する
+ * @param ファイル名
+ * @return 成功時:true 失敗時:false
+ */
+bool CompileCache::touch(std::string path){
+	return utime(path.c_str(), NULL) == 0;
+}
+
+/**
+ * 容量を超えていたら最終使用時刻が古いものから削除する
+ * @return 成功時:true 失敗時:false
+ */
+bool CompileCache::evict(){
+	DIR *dir = opendir(CacheDir.c_str());
+	if(!dir)
+		return false;
+
+	// (最終使用時刻, パス, サイズ)
+	std::vector<std::tuple<time_t, std::string, uint64_t>> entries;
+	uint64_t total = 0;
+	struct dirent *ent;
+	time_t now = time(NULL);
+	while((ent = readdir(dir)) != NULL){
+		std::string name = ent->d_name;
+		int len = name.length();
+
+		// 異常終了した書き込み元の一時ファイルは1日経ったら消す
+		if(name.find(".tmp.") != std::string::npos){
+			std::string path = CacheDir + "/" + name;
+			struct stat st;
+			if(stat(path.c_str(), &st) == 0 && now - st.st_mtime > 24 * 60 * 60)
+				unlink(path.c_str());
+			continue;
+		}
+		if(!(len > 3 && name.compare(len-3, 3, ".bc") == 0) &&
+				!(len > 2 && name.compare(len-2, 2, ".o") == 0))
+			continue;
+
+		std::string path = CacheDir + "/" + name;
+		struct stat st;
+		if(stat(path.c_str(), &st) != 0)
+			continue;
+		entries.emplace_back(st.st_mtime, path, st.st_size);
+		total += st.st_size;
+	}
+	closedir(dir);
+
+	if(total <= SizeLimit)
+		return true;
+
+	std::sort(entries.begin(), entries.end());
+	for(int i = 0; i < entries.size() && total > SizeLimit; i++){
+		if(unlink(std::get<1>(entries.at(i)).c_str()) == 0)
+			total -= std::get<2>(entries.at(i));
+	}
+	return true;
+}
+
+/**
+ * 書き込み元ごとに別の一時ファイルを作る
+ * (<path>.tmp.XXXXXX を mkstemp で作るので、同時に書いても同じファイルにならない)
+ * @param 最終的なファイル名
+ * @return 一時ファイル名 失敗時:空文字列
+ */
+std::string CompileCache::createTempPath(std::string path){
+	std::string templ = path + ".tmp.XXXXXX";
+	std::vector<char> name(templ.begin(), templ.end());
+	name.push_back('\0');
+	int fd = mkstemp(&name[0]);
+	if(fd < 0){
+		fprintf(stderr, "キャッシュの一時ファイル %s が作成できません\n", templ.c_str());
+		return "";
+	}
+	close(fd);
+	return &name[0];
+}
+
+/**
+ * ファイルの存在確認
+ */
+bool CompileCache::exists(std::string path){
+	struct stat st;
+	return stat(path.c_str(), &st) == 0;
+}
+
+/**
+ * ファイルの内容を全て読み込む
+ * @param ファイル名 読み込み先
+ * @return 成功時:true 失敗時:false
+ */
+bool CompileCache::readFile(std::string path, std::string &data){
+	std::ifstream ifs(path.c_str(), std::ios::in | std::ios::binary);
+	if(!ifs)
+		return false;
+	std::ostringstream oss;
+	oss << ifs.rdbuf();
+	data = oss.str();
+	return true;
+}
+
+/**
+ * FNV-1aハッシュ
+ * @param データ 初期値
+ * @return ハッシュ値
+ */
+uint64_t CompileCache::hashString(const std::string &data, uint64_t seed){
+	uint64_t hash = seed;
+	for(int i = 0; i < data.size(); i++){
+		hash ^= (unsigned char)data[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
@@ -2,10 +2,14 @@
 
 /**
  * コンストラクタ
+ * @param コード生成に使うLLVMContext (ファイルごとに別のContextを使えば並列にコード生成できる)
  */
-CodeGen::CodeGen(){
-	Builder = new llvm::IRBuilder<>(llvm::getGlobalContext());
+CodeGen::CodeGen(llvm::LLVMContext &context) : Context(context){
+	Builder = new llvm::IRBuilder<>(Context);
 	Mod = NULL;
+	SharedLinkMod = NULL;
+	KeepMainGlobals = false;
+	UseAllocas = false;
 }
 
 /**
@@ -18,10 +22,12 @@ CodeGen::~CodeGen(){
 
 /**
  * コード生成実行
- * @param TranslationUnitAST Module名（入力ファイル名）
+ * @param TranslationUnitAST Module名（入力ファイル名） リンクファイル名
  * @return 成功時:true 失敗時:false
  */
-bool CodeGen::doCodeGen(TranslationUnitAST &tunit, std::string name, std::string link_file, bool with_jit = false){
+bool CodeGen::doCodeGen(TranslationUnitAST &tunit, std::string name, std::string link_file){
+	ProfileScope prof("phase", "コード生成", name);
+
 	// Module生成に失敗したら終了
 	if(!generateTranslationUnit(tunit, name))
 		return false;
@@ -30,20 +36,6 @@ bool CodeGen::doCodeGen(TranslationUnitAST &tunit, std::string name, std::string
 	if(!link_file.empty() && !linkModule(Mod, link_file))
 		return false;
 
-	// JITのフラグふぁ立っていたらJIT
-	if(with_jit){
-		// ExecutionEngine生成
-		llvm::ExecutionEngine *EE = llvm::EngineBuilder(Mod).create();
-		
-		// 実行したいFunctionのポインタを渡す（main関数へのポインタを取得）
-		llvm::Function *F;
-		if(!(F = Mod->getFunction("main")))
-			return false;
-
-		// JIT済みのmain関数のポインタを取得
-		int (*fp)() = (int (*)())EE->getPointerToFunction(F);
-		fprintf(stderr,"%d\n",fp());
-	}
 	return true;
 }
 
@@ -54,7 +46,55 @@ llvm::Module &CodeGen::getModule(){
 	if(Mod)
 		return *Mod;
 	else
-		return *(new llvm::Module("null", llvm::getGlobalContext()));
+		return *(new llvm::Module("null", Context));
+}
+
+/**
+ * REPL用のModule生成
+ * 以降の入力はaddTranslationUnitでこのModuleに追加する
+ * @param Module名
+ * @return 成功時:true 失敗時:false
+ */
+bool CodeGen::beginModule(std::string name){
+	SAFE_DELETE(Mod);
+	Mod = new llvm::Module(name, Context);
+	clearSlots();
+	KeepMainGlobals = true;
+	declareRuntimeFunctions();
+	return true;
+}
+
+/**
+ * 既存のModuleに関数を追加する (REPL用)
+ * 失敗した場合は追加しかけた関数を削除してModuleを元に戻す
+ * @param TranslationUnitAST
+ * @return 成功時:true 失敗時:false
+ */
+bool CodeGen::addTranslationUnit(TranslationUnitAST &tunit){
+	if(!Mod)
+		return false;
+	CORRECT = true;
+
+	std::set<llvm::Function*> existing;
+	for(llvm::Module::iterator func = Mod->begin(); func != Mod->end(); func++)
+		existing.insert(func);
+
+	if(generateFunctions(tunit) && CORRECT)
+		return true;
+
+	// 追加した関数を削除 (互いに参照しているので先に参照を外す)
+	std::vector<llvm::Function*> added;
+	for(llvm::Module::iterator func = Mod->begin(); func != Mod->end(); func++){
+		if(existing.find(func) == existing.end())
+			added.push_back(func);
+	}
+	for(int i = 0; i < added.size(); i++)
+		added[i]->dropAllReferences();
+	for(int i = 0; i < added.size(); i++){
+		added[i]->replaceAllUsesWith(llvm::UndefValue::get(added[i]->getType()));
+		added[i]->eraseFromParent();
+	}
+	return false;
 }
 
 /**
@@ -64,14 +104,28 @@ llvm::Module &CodeGen::getModule(){
  */
 bool CodeGen::generateTranslationUnit(TranslationUnitAST &tunit, std::string name){
 	// Moduleを生成
-	Mod = new llvm::Module(name, llvm::getGlobalContext());
-	
+	Mod = new llvm::Module(name, Context);
+	clearSlots();
+	KeepMainGlobals = false;
+	declareRuntimeFunctions();
+
+	if(!generateFunctions(tunit)){
+		SAFE_DELETE(Mod);
+		return false;
+	}
+	return true;
+}
+
+/**
+ * printf, scanfなどの宣言を生成する
+ */
+void CodeGen::declareRuntimeFunctions(){
 	// printのFunction/////////////////////////////////////////////////
 	std::vector<llvm::Type*> printFuncArgs;
-	printFuncArgs.push_back(llvm::Type::getInt8PtrTy(llvm::getGlobalContext()));
+	printFuncArgs.push_back(llvm::Type::getInt8PtrTy(Context));
 
 	llvm::FunctionType *printFuncType = llvm::FunctionType::get(
-			llvm::Type::getDoubleTy(llvm::getGlobalContext()),
+			llvm::Type::getDoubleTy(Context),
 			printFuncArgs,
 			true
 	);
@@ -87,10 +141,10 @@ bool CodeGen::generateTranslationUnit(TranslationUnitAST &tunit, std::string nam
 	
 	// scanfのFunction//////////////////////////////////////////////////
 	std::vector<llvm::Type*> scanFuncArgs;
-	scanFuncArgs.push_back(llvm::Type::getInt8PtrTy(llvm::getGlobalContext()));
+	scanFuncArgs.push_back(llvm::Type::getInt8PtrTy(Context));
 
 	llvm::FunctionType *scanFuncType = llvm::FunctionType::get(
-			llvm::Type::getDoubleTy(llvm::getGlobalContext()),
+			llvm::Type::getDoubleTy(Context),
 			scanFuncArgs,
 			true
 	);
@@ -106,11 +160,11 @@ bool CodeGen::generateTranslationUnit(TranslationUnitAST &tunit, std::string nam
 	
 	// sprintfのfunction ///////////////////////////////////////////////
 	std::vector<llvm::Type*> sprintFuncArgs;
-	sprintFuncArgs.push_back(llvm::Type::getInt8PtrTy(llvm::getGlobalContext()));
-	sprintFuncArgs.push_back(llvm::Type::getInt8PtrTy(llvm::getGlobalContext()));
+	sprintFuncArgs.push_back(llvm::Type::getInt8PtrTy(Context));
+	sprintFuncArgs.push_back(llvm::Type::getInt8PtrTy(Context));
 
 	llvm::FunctionType *sprintFuncType = llvm::FunctionType::get(
-			llvm::Type::getDoubleTy(llvm::getGlobalContext()),
+			llvm::Type::getDoubleTy(Context),
 			sprintFuncArgs,
 			true
 	);
@@ -126,13 +180,13 @@ bool CodeGen::generateTranslationUnit(TranslationUnitAST &tunit, std::string nam
 
 	// memsetのfunction ////////////////////////////////////////////////
 	std::vector<llvm::Type*> memsetFuncArgs;
-	memsetFuncArgs.push_back(llvm::Type::getInt8PtrTy(llvm::getGlobalContext()));
-	memsetFuncArgs.push_back(llvm::Type::getInt8Ty(llvm::getGlobalContext()));
-	memsetFuncArgs.push_back(llvm::Type::getInt64Ty(llvm::getGlobalContext()));
-	memsetFuncArgs.push_back(llvm::Type::getInt32Ty(llvm::getGlobalContext()));
-	memsetFuncArgs.push_back(llvm::Type::getInt1Ty(llvm::getGlobalContext()));
+	memsetFuncArgs.push_back(llvm::Type::getInt8PtrTy(Context));
+	memsetFuncArgs.push_back(llvm::Type::getInt8Ty(Context));
+	memsetFuncArgs.push_back(llvm::Type::getInt64Ty(Context));
+	memsetFuncArgs.push_back(llvm::Type::getInt32Ty(Context));
+	memsetFuncArgs.push_back(llvm::Type::getInt1Ty(Context));
 	llvm::FunctionType *memsetFuncType = llvm::FunctionType::get(
-			llvm::Type::getDoubleTy(llvm::getGlobalContext()),
+			llvm::Type::getDoubleTy(Context),
 	                memsetFuncArgs,
 			false
 	);
@@ -145,30 +199,34 @@ bool CodeGen::generateTranslationUnit(TranslationUnitAST &tunit, std::string nam
 	);
 	memsetFunc->setCallingConv(llvm::CallingConv::C);
 	////////////////////////////////////////////////////////////////////
+}
 
-
+/**
+ * 関数宣言と関数定義の生成
+ * @param TranslationUnitAST
+ * @return 成功時:true 失敗時:false
+ */
+bool CodeGen::generateFunctions(TranslationUnitAST &tunit){
 	// function declaration
 	for(int i = 0; ; i++){
 		PrototypeAST *proto = tunit.getPrototype(i);
 		if(!proto){
 			break;
 		}else if(!generatePrototype(proto, Mod)){
-			SAFE_DELETE(Mod);
 			return false;
 		}
 	}
 
 	// function definition
-	// main最初
+	// main最初 (他の関数がglobal宣言するmainの変数を先に調べる)
+	collectSharedGlobals(tunit);
 	for(int i = 0; ;i++){
 		FunctionAST *func = tunit.getFunction(i);
 		if(!func)
 			break;
 		if(func->getPrototype()->getName() == "main"){
-			if(!generateFunctionDefinition(func, Mod)){
-				SAFE_DELETE(Mod);
+			if(!generateFunctionDefinition(func, Mod))
 				return false;
-			}
 		}
 	}
 	for(int i = 0; ;i++){
@@ -177,15 +235,31 @@ bool CodeGen::generateTranslationUnit(TranslationUnitAST &tunit, std::string nam
 		if(!func)
 			break;
 		if(func->getPrototype()->getName() != "main"){
-			if(!generateFunctionDefinition(func, Mod)){
-				SAFE_DELETE(Mod);
+			if(!generateFunctionDefinition(func, Mod))
 				return false;
-			}
 		}
 	}
 	return true;
 }
 
+/**
+ * main以外の関数がglobal宣言している変数を集める
+ * @param TranslationUnitAST
+ */
+void CodeGen::collectSharedGlobals(TranslationUnitAST &tunit){
+	SharedGlobals.clear();
+	for(int i = 0; ;i++){
+		FunctionAST *func = tunit.getFunction(i);
+		if(!func)
+			break;
+		if(func->getPrototype()->getName() == "main")
+			continue;
+		const llvm::DenseSet<SymbolID> &globals = func->getBody()->getGlobalVariables();
+		for(llvm::DenseSet<SymbolID>::const_iterator it = globals.begin(); it != globals.end(); ++it)
+			SharedGlobals.insert(*it);
+	}
+}
+
 /**
  * 関数宣言生成メソッド
  * @param PrototypeAST, Module
@@ -206,11 +280,11 @@ llvm::Function *CodeGen::generatePrototype(PrototypeAST *proto, llvm::Module *mo
 	std::vector<llvm::Type*> arg_types;
 	for(int i=0; i < proto->getParamNum(); i++){
 		if(proto->getParamIdentify(i) == "int")
-			arg_types.push_back(llvm::Type::getInt32Ty(llvm::getGlobalContext()));
+			arg_types.push_back(llvm::Type::getInt32Ty(Context));
 		else if(proto->getParamIdentify(i) == "double")
-			arg_types.push_back(llvm::Type::getDoubleTy(llvm::getGlobalContext()));
+			arg_types.push_back(llvm::Type::getDoubleTy(Context));
 		else if(proto->getParamIdentify(i) == "string")
-			arg_types.push_back(llvm::Type::getInt8PtrTy(llvm::getGlobalContext()));
+			arg_types.push_back(llvm::Type::getInt8PtrTy(Context));
 		else
 			return NULL;
 	}	
@@ -218,10 +292,10 @@ llvm::Function *CodeGen::generatePrototype(PrototypeAST *proto, llvm::Module *mo
 	llvm::FunctionType *func_type;
 	if(proto->getIdentify() == "double")
 		func_type = llvm::FunctionType::get(
-				llvm::Type::getDoubleTy(llvm::getGlobalContext()),arg_types,false);
+				llvm::Type::getDoubleTy(Context),arg_types,false);
 	else if(proto->getIdentify() == "int")
 		func_type = llvm::FunctionType::get(
-				llvm::Type::getInt32Ty(llvm::getGlobalContext()),arg_types,false);
+				llvm::Type::getInt32Ty(Context),arg_types,false);
 	// create function
 	func = llvm::Function::Create(func_type, llvm::Function::ExternalLinkage, proto->getName(), mod);
 	// set names
@@ -239,15 +313,35 @@ llvm::Function *CodeGen::generatePrototype(PrototypeAST *proto, llvm::Module *mo
  * @return 生成したFunctionのポインタ
  */
 llvm::Function *CodeGen::generateFunctionDefinition(FunctionAST *func_ast, llvm::Module *mod){
+	ProfileScope prof("function", "コード生成", func_ast->getPrototype()->getName());
 	llvm::Function *func = generatePrototype(func_ast->getPrototype(), mod);
 	if(!func){ return NULL; }
 	CurFunc = func;
+	// 前の関数の変数を消す
+	for(int i = 0; i < LocalSymbols.size(); i++){
+		LocalTypes[LocalSymbols[i]] = NULL;
+		if(LocalSymbols[i] < LocalAllocas.size())
+			LocalAllocas[LocalSymbols[i]] = NULL;
+	}
+	LocalSymbols.clear();
+	CurrentDefs.clear();
+	IncompletePhis.clear();
+	SealedBlocks.clear();
+	PromotedGlobals.clear();
 	//FuncName = func_ast->getPrototype()->getName();
-	llvm::BasicBlock *bblock = llvm::BasicBlock::Create(llvm::getGlobalContext(), "entry", func);
+
+	// 整数になる変数をi64にする (REPLのmainの変数は入力の間で引き継ぐのでdoubleのまま)
+	bool is_main = func_ast->getPrototype()->getName() == "main";
+	if(!(is_main && KeepMainGlobals)){
+		TypeInference infer;
+		llvm::DenseSet<SymbolID> none;
+		infer.inferFunction(func_ast->getBody(), is_main ? SharedGlobals : none);
+	}
+	llvm::BasicBlock *bblock = llvm::BasicBlock::Create(Context, "entry", func);
+	sealBlock(bblock);
 	Builder->SetInsertPoint(bblock);
 	// Functionのボディを生成
-	llvm::Value *f = generateFunctionStatement(func_ast->getBody(), func);
-	if(!f)
+	if(!generateFunctionStatement(func_ast->getBody(), func))
 		return NULL;
 	return func;
 }
@@ -256,12 +350,11 @@ llvm::Function *CodeGen::generateFunctionDefinition(FunctionAST *func_ast, llvm:
  * 関数生成メソッド
  * 変数宣言、ステートメントの順に生成
  * @param FunctionStmtAST
- * @return 最後に生成した
+ * @return 成功時:true 失敗時:false
  */
-llvm::Value *CodeGen::generateFunctionStatement(FunctionStmtAST *func_stmt, llvm::Function *func){
+bool CodeGen::generateFunctionStatement(FunctionStmtAST *func_stmt, llvm::Function *func){
 	// inser variable decls
 	VariableDeclAST *vdecl;
-	llvm::Value *v = NULL;
 	for(int i = 0; ;i++){
 		// 最後まで見たら終了
 		if(!func_stmt->getVariableDecl(i))
@@ -269,422 +362,217 @@ llvm::Value *CodeGen::generateFunctionStatement(FunctionStmtAST *func_stmt, llvm
 
 		//create alloca
 		vdecl = llvm::dyn_cast<VariableDeclAST>(func_stmt->getVariableDecl(i));
-		v = generateVariableDeclaration(vdecl);
+		generateVariableDeclaration(vdecl);
 	}
-	// ifに対応する変数など
+	LoopTargets.clear();
+	return generateBlock(func_stmt->getBody(), func_stmt);
+}
+
+/**
+ * Block生成メソッド
+ * 文を順に生成し、if, forは入れ子のBlockを再帰して生成する
+ * @param BlockAST FunctionStmtAST
+ * @return 成功時:true 失敗時:false
+ */
+bool CodeGen::generateBlock(BlockAST *block, FunctionStmtAST *func_stmt){
 	BaseAST *stmt;
-	llvm::BasicBlock *bblock;// Blockの生成と判定式が正の時格納
-	llvm::BasicBlock *bend;  // ifの最後
-	llvm::BasicBlock *bcur;  // ポイント設定
-	llvm::BasicBlock *bbfr;  // 1つ前のBlock
-	llvm::BasicBlock *bago;  // 2つ前のBlock
-	std::vector<llvm::BasicBlock*> bor;  // True or の次にどこに行くか
-	std::vector<llvm::BasicBlock*> band; // False and の次にどこに行くか
-	llvm::BasicBlock *bfr;
-	llvm::Value *fcmp;
-	IfStatementAST *ifs;
-	ComparisonAST *com;
-	std::string ifStr;
-	static llvm::IRBuilderBase::InsertPoint ip;
-	// 1:判定方法if, else if, else  2:brを生成するBlock 
-	// 3:条件式を満たした際に分岐するBlock 4:比較結果
-	std::vector<
-		std::tuple<std::string, llvm::BasicBlock*, llvm::BasicBlock*, llvm::Value*, int>
-		> blocks;
-	int depth;
-	std::vector<
-		std::tuple<llvm::BasicBlock*, llvm::BasicBlock*, llvm::Value*, ForStatementAST*> 
-		> forVals;
-	std::map<ForStatementAST*, std::vector<std::tuple<llvm::BasicBlock*, llvm::BasicBlock::iterator>>> breakVals;
-	std::map<ForStatementAST*, std::vector<std::tuple<llvm::BasicBlock*, llvm::BasicBlock::iterator>>> continueVals;
 	for(int i = 0; ;i++){
 		// 最後まで見たら終了
-		stmt = func_stmt->getStatement(i);
+		stmt = block->getStatement(i);
 		if(!stmt)
 			break;
-		else if(llvm::isa<IfStatementAST>(stmt)){
-			if(llvm::dyn_cast<IfStatementAST>(stmt)->getIf() == "if"){
-				// 条件式の生成 （まだand or出来ない）
-				ifs = llvm::dyn_cast<IfStatementAST>(stmt);
-				for(int j = 0; j < ifs->getComparisonNumber(); j++){
-					com = ifs->getComparison(j);
-					fcmp = generateComparison(com->getLHS(), com->getRHS(), com->getOp(), func_stmt);
-					
-					// もしand orがあったらBlockとbrを設定する
-					if(j < ifs->getOpsNumber()){
-						if(ifs->getOp(j) == "or"){
-							bblock = llvm::BasicBlock::Create(
-									llvm::getGlobalContext(), 
-									"or.lhs.false", func);
-							
-							// lhs or rhs のlhsがtrueならif.thenへ
-							// lhs or rhs のlhsがfalseならrhsへ
-							blocks.emplace_back("or", 
-									Builder->GetInsertBlock(), 
-									bblock, fcmp,ifs->getDepth(j));
-							
-							Builder->SetInsertPoint(bblock);
-						}
-						else if(ifs->getOp(j) == "and"){
-							bblock = llvm::BasicBlock::Create(
-									llvm::getGlobalContext(), 
-									"and.lhs.true", func);
-							
-							// lhs and rhsのlhsがtrueならrhsへ
-							// lhs and rhsのlhsがfalseならorのrhsへ
-							blocks.emplace_back("and", 
-									Builder->GetInsertBlock(), 
-									bblock, fcmp,ifs->getDepth(j));
-							
-							Builder->SetInsertPoint(bblock);
-						}
-					}
-				}
-				// 条件式を満たした先のBlockを生成
-				bblock = llvm::BasicBlock::Create(
-						llvm::getGlobalContext(), "if.then", func);
-				
-				// br情報　
-                                blocks.emplace_back("to if", Builder->GetInsertBlock(), bblock, fcmp,
-						ifs->getDepth(ifs->getOpsNumber()));
-				
-				// 条件式が正の場合のBlockにポイントを合わせる
-				Builder->SetInsertPoint(bblock);
-			}
-			else if(llvm::dyn_cast<IfStatementAST>(stmt)->getIf() == "else if"){
-				// br情報　if か else if の内部にいる
-				blocks.emplace_back("to end", Builder->GetInsertBlock(), bblock, fcmp,0);
-				
-				// 条件式を評価するBlockを生成
-				bblock = llvm::BasicBlock::Create(
-						llvm::getGlobalContext(), "if.else", func);
-
-				// if.elseにポイントを合わせる
-				Builder->SetInsertPoint(bblock);
-
-				// ifの条件分岐からif.elseに分岐する
-				blocks.emplace_back("come if else", 
-						Builder->GetInsertBlock(), bblock, fcmp, 0);
-				
-				// 条件式を生成　（まだand or出来ない）
-				ifs = llvm::dyn_cast<IfStatementAST>(stmt);
-				for(int j = 0; j < ifs->getComparisonNumber(); j++){
-					com = ifs->getComparison(j);
-					fcmp = generateComparison(com->getLHS(), com->getRHS(), com->getOp(), func_stmt);
-					
-					// もしand orがあったらBlockとbrを設定する
-					if(j < ifs->getOpsNumber()){
-						if(ifs->getOp(j) == "or"){
-							bblock = llvm::BasicBlock::Create(
-									llvm::getGlobalContext(),
-								       	"or.lhs.false",	func);
-					
-							// lhs or rhs のlhsがtrueならif.thenへ
-							// lhs or rhs のlhsがfalseならrhsへ
-							blocks.emplace_back("or", 
-									Builder->GetInsertBlock(), 
-									bblock, fcmp, 
-									ifs->getDepth(j));
-					
-							Builder->SetInsertPoint(bblock);
-						}
-						else if(ifs->getOp(j) == "and"){
-							bblock = llvm::BasicBlock::Create(
-									llvm::getGlobalContext(), 
-									"and.lhs.true", func);
-					
-							// lhs and rhsのlhsがtrueならrhsへ
-							// lhs and rhsのlhsがfalseならorのrhsへ
-							blocks.emplace_back("and", 
-									Builder->GetInsertBlock(), 
-									bblock, fcmp,
-									ifs->getDepth(j));
-					
-							Builder->SetInsertPoint(bblock);
-						}
-					}
-				}
-				
-				// 条件式が正を満たした先のBlockを生成
-				bblock = llvm::BasicBlock::Create(
-						llvm::getGlobalContext(), "if.then", func);
-				
-				// br情報
-				blocks.emplace_back("to else if", Builder->GetInsertBlock(), bblock, fcmp, ifs->getDepth(ifs->getOpsNumber()));
-
-				// 条件が正の場合のBlockにポイントを合わせる
-				Builder->SetInsertPoint(bblock);
-			}
-			else if(llvm::dyn_cast<IfStatementAST>(stmt)->getIf() == "else"){
-				// br情報　ifかelse ifにポイントが合っている
-				blocks.emplace_back("to end", Builder->GetInsertBlock(), bblock, fcmp, 0);
-				
-				// elseのBlockを生成
-				bblock = llvm::BasicBlock::Create(
-						llvm::getGlobalContext(), "if.else", func);
 
-				// elseのBlockにポイントを合わせる
-				Builder->SetInsertPoint(bblock);
-				
-				blocks.emplace_back("come else", 
-						Builder->GetInsertBlock(), bblock, fcmp, 0);
-			}
+		// return, break, continue の後の文は到達しないBlockに生成する
+		if(Builder->GetInsertBlock()->getTerminator()){
+			llvm::BasicBlock *bdead = llvm::BasicBlock::Create(Context, "unreachable", CurFunc);
+			sealBlock(bdead);
+			Builder->SetInsertPoint(bdead);
 		}
-		else if(llvm::isa<IfEndAST>(stmt)){
-			// 現在のポイントからif.endにbrする
-			bend = llvm::BasicBlock::Create(llvm::getGlobalContext(), "if.end", func);
-			Builder->CreateBr(bend);
-
-			// brを生成
-			bbfr = bend;
-			bago = NULL;
-			bcur = Builder->GetInsertBlock();
-			bfr = bend;
-			//bor = Builder->GetInsertBlock();
-			//band = bend;
-			bor.clear();
-			bor.push_back(bend);
-			band.clear();
-			band.push_back(bend);
-			while(true){
-				ifStr = std::get<0>(blocks.at(blocks.size()-1));
-				bblock = std::get<2>(blocks.at(blocks.size()-1));
-				fcmp = std::get<3>(blocks.at(blocks.size()-1));
-				depth = std::get<4>(blocks.at(blocks.size()-1));
-				if(ifStr == "or"){
-					//band = bfr;	
-					while(depth >= band.size())
-						band.push_back(band.at(band.size()-1));
-					
-					for(int j = depth; band.size() > j; j++)
-						band.at(j) = bfr;
-					
-					Builder->SetInsertPoint(
-							std::get<1>(blocks.at(blocks.size()-1)));
-
-					while(bor.size() <= depth)
-						bor.push_back(bor.at(bor.size()-1));
-					
-					Builder->CreateCondBr(fcmp, bor.at(depth), bblock);
-				}
-				else if(ifStr == "and"){
-					while(depth+1 >= bor.size())
-						bor.push_back(bor.at(bor.size()-1));
-					
-					for(int j = depth+1; bor.size() > j; j++)
-						bor.at(j) = bfr;
-
-					Builder->SetInsertPoint(
-							std::get<1>(blocks.at(blocks.size()-1)));
-					
-					while(band.size() <= depth)
-						band.push_back(band.at(band.size()-1));
-
-					Builder->CreateCondBr(fcmp, bblock, band.at(depth));
-				}
-				else{
-					bago = bbfr;
-					bbfr = bcur;
-					bcur = std::get<1>(blocks.at(blocks.size()-1));
-					if(ifStr == "to if" || ifStr == "to else if"){
-						Builder->SetInsertPoint(bcur);
-						Builder->CreateCondBr(fcmp, bblock, bago);
-						//bor = bblock;
-						bor.clear();
-						bor.push_back(bblock);
-					}
-					else if(ifStr == "come if else" || ifStr == "come else"){
-						//band = bcur;
-						band.clear();
-						band.push_back(bcur);
-					}
-					else if(ifStr == "to end"){
-						Builder->SetInsertPoint(bcur);
-						Builder->CreateBr(bend);
-					}
-				}
-				bfr = std::get<1>(blocks.at(blocks.size()-1));
-				blocks.pop_back();
-				if(ifStr == "to if")
-					break;
-			}
-			while(blocks.size() > 0 && (std::get<0>(blocks.at(blocks.size()-1)) == "or" 
-						|| std::get<0>(blocks.at(blocks.size()-1)) == "and")){
-				ifStr = std::get<0>(blocks.at(blocks.size()-1));
-				bblock = std::get<2>(blocks.at(blocks.size()-1));
-				fcmp = std::get<3>(blocks.at(blocks.size()-1));
-				depth = std::get<4>(blocks.at(blocks.size()-1));
-				if(ifStr == "or"){
-					//band = bfr;
-					while(depth >= band.size())
-						band.push_back(band.at(band.size()-1));
-
-					for(int j = depth; band.size() > j; j++)
-						band.at(j) = bfr;
-					
-					Builder->SetInsertPoint(
-							std::get<1>(blocks.at(blocks.size()-1)));
-					
-					while(bor.size() <= depth)
-						bor.push_back(bor.at(bor.size()-1));
-					
-					Builder->CreateCondBr(fcmp, bor.at(depth), bblock);
-				}
-				else if(ifStr == "and"){
-					while(depth+1 >= bor.size())
-						bor.push_back(bor.at(bor.size()-1));
-
-					for(int j = depth+1; bor.size() > j; j++)
-						bor.at(j) = bfr;
-					
-					Builder->SetInsertPoint(
-							std::get<1>(blocks.at(blocks.size()-1)));
-					
-					while(band.size() <= depth)
-						band.push_back(band.at(band.size()-1));
-
-					Builder->CreateCondBr(fcmp, bblock, band.at(depth));
-				}
-				bfr = std::get<1>(blocks.at(blocks.size()-1));
-				blocks.pop_back();
-			}
 
-			Builder->SetInsertPoint(bend);
+		if(llvm::isa<IfStatementAST>(stmt)){
+			if(!generateIfStatement(llvm::dyn_cast<IfStatementAST>(stmt), func_stmt))
+				return false;
 		}
 		else if(llvm::isa<ForStatementAST>(stmt)){
-			ForStatementAST *for_expr = llvm::dyn_cast<ForStatementAST>(stmt);
-			llvm::BasicBlock *bcond = llvm::BasicBlock::Create(
-					llvm::getGlobalContext(), "for.cond", CurFunc);
-			llvm::BasicBlock *bbody = llvm::BasicBlock::Create(
-					llvm::getGlobalContext(), "for.body", CurFunc);
-			llvm::Value *fcmp = generateForStatement(for_expr, bcond, bbody, func_stmt);
-			forVals.emplace_back(bcond, bbody, fcmp, for_expr);
-		}
-		else if(llvm::isa<ForEndAST>(stmt)){
-			llvm::BasicBlock *bcond = std::get<0>(forVals.at(forVals.size()-1));
-			llvm::BasicBlock *bbody = std::get<1>(forVals.at(forVals.size()-1));
-			llvm::Value *fcmp = std::get<2>(forVals.at(forVals.size()-1));
-			ForStatementAST *for_expr = std::get<3>(forVals.at(forVals.size()-1));
-			llvm::BasicBlock *binc = llvm::BasicBlock::Create(llvm::getGlobalContext(), "for.inc", CurFunc);
-			llvm::BasicBlock *bend = llvm::BasicBlock::Create(llvm::getGlobalContext(), "for.end", CurFunc);
-			generateForEndStatement(bcond, bbody, binc, bend, fcmp, for_expr, func_stmt);
-			llvm::BasicBlock *temp = Builder->GetInsertBlock();
-			forVals.pop_back();
-
-			if(breakVals.find(for_expr) != breakVals.end()){
-				for(int i = 0; i < breakVals[for_expr].size(); i++){
-					Builder->SetInsertPoint(std::get<0>(breakVals[for_expr].at(i)),	++std::get<1>(breakVals[for_expr].at(i)));
-					Builder->CreateBr(bend);
-				}
-				breakVals[for_expr].clear();
-			}
-
-			if(continueVals.find(for_expr) != continueVals.end()){
-				for(int i = 0; i < continueVals[for_expr].size(); i++){
-					Builder->SetInsertPoint(std::get<0>(continueVals[for_expr].at(i)), ++std::get<1>(continueVals[for_expr].at(i)));
-					Builder->CreateBr(binc);
-				}
-				continueVals[for_expr].clear();
-			}
-			Builder->SetInsertPoint(temp);
+			if(!generateForStatement(llvm::dyn_cast<ForStatementAST>(stmt), func_stmt))
+				return false;
 		}
 		else if(llvm::isa<BreakAST>(stmt)){
-			BreakAST *break_expr = llvm::dyn_cast<BreakAST>(stmt);
-			llvm::BasicBlock *bcur = Builder->GetInsertBlock();
-			ForStatementAST *for_expr;
-			if(break_expr->getDepth() <= 0 || forVals.size() < break_expr->getDepth()){
-				fprintf(stderr, "break文のカッコの中の数を確認してください\n");
-				return NULL;
-			}
-			else
-				for_expr = std::get<3>(forVals.at(forVals.size()-break_expr->getDepth()));
-			if(breakVals.find(for_expr) == breakVals.end()){
-				std::vector<std::tuple<llvm::BasicBlock*, llvm::BasicBlock::iterator>> temp;
-				breakVals[for_expr] = temp;
-			}
-			
-			if(bcur->empty())
-				breakVals[for_expr].emplace_back(bcur, bcur->begin());
-			else{
-				llvm::BasicBlock::iterator iter = bcur->begin();
-				for(int i = 0; i < bcur->size()-1; i++)
-					iter++;
-				
-				breakVals[for_expr].emplace_back(bcur, iter);
-			}
+			// for.endへ
+			ForStatementAST *for_expr = llvm::dyn_cast<BreakAST>(stmt)->getTarget();
+			Builder->CreateBr(LoopTargets[for_expr].second);
 		}
 		else if(llvm::isa<ContinueAST>(stmt)){
-			ContinueAST *continue_expr = llvm::dyn_cast<ContinueAST>(stmt);
-			llvm::BasicBlock *bcur = Builder->GetInsertBlock();
-			ForStatementAST *for_expr;
-			if(continue_expr->getDepth() <= 0 || forVals.size() < continue_expr->getDepth()){
-				fprintf(stderr, "continue文のカッコの中の数を確認してください.\n");
-				return NULL;
-			}
-			else
-				for_expr = std::get<3>(forVals.at(forVals.size()-continue_expr->getDepth()));
-
-			if(continueVals.find(for_expr) == continueVals.end()){
-				std::vector<std::tuple<llvm::BasicBlock*, llvm::BasicBlock::iterator>> temp;
-				continueVals[for_expr] = temp;
-			}
-
-			if(bcur->empty())
-				continueVals[for_expr].emplace_back(bcur, bcur->begin());
-			else{
-				llvm::BasicBlock::iterator iter = bcur->begin();
-				for(int i = 0; i < bcur->size()-1; i++)
-					iter++;
-
-				continueVals[for_expr].emplace_back(bcur, iter);
-			}
-			
+			// for.incへ
+			ForStatementAST *for_expr = llvm::dyn_cast<ContinueAST>(stmt)->getTarget();
+			Builder->CreateBr(LoopTargets[for_expr].first);
 		}
 		else if(llvm::isa<GlobalVariableAST>(stmt)){
 			GlobalVariableAST *gVar = llvm::dyn_cast<GlobalVariableAST>(stmt);
-			llvm::Value *check = Mod->getNamedGlobal(gVar->getName());
+			SymbolID symbol = gVar->getSymbol();
+			llvm::Value *check = symbol < GlobalSlots.size() ? GlobalSlots[symbol] : NULL;
 			if(!check){
 				fprintf(stderr, "%d行目 : global で宣言された変数 %s はありません.\n", gVar->getLine(), gVar->getName().c_str());
 				CORRECT = false;
 			}
-		}else if(!llvm::isa<NullExprAST>(stmt))
-			v = generateStatement(stmt, func_stmt);
+		}
+		else if(llvm::isa<ReturnStmtAST>(stmt)){
+			if(!generateStatement(stmt, func_stmt))
+				return false;
+		}
+		else if(!llvm::isa<NullExprAST>(stmt))
+			generateStatement(stmt, func_stmt);
+	}
+	return true;
+}
+
+/**
+ * if生成メソッド
+ * if -> else if -> ... -> else の節を順に生成し、最後に if.end へ合流する
+ * @param IfStatementAST FunctionStmtAST
+ * @return 成功時:true 失敗時:false
+ */
+bool CodeGen::generateIfStatement(IfStatementAST *if_expr, FunctionStmtAST *func_stmt){
+	// if.endは節を全て生成した後に関数の最後に置く
+	llvm::BasicBlock *bend = llvm::BasicBlock::Create(Context, "if.end");
+	for(IfStatementAST *clause = if_expr; clause; clause = clause->getElse()){
+		if(clause->getIf() != IF_ELSE){
+			llvm::BasicBlock *bthen = llvm::BasicBlock::Create(Context, "if.then", CurFunc);
+			llvm::BasicBlock *belse = clause->getElse() ? 
+				llvm::BasicBlock::Create(Context, "if.else") : bend;
+			if(!generateCondition(clause, 0, clause->getComparisonNumber()-1, bthen, belse, func_stmt))
+				return false;
+			// 条件式の分岐を全て張ったので前のBlockが揃う
+			sealBlock(bthen);
+			if(belse != bend)
+				sealBlock(belse);
+			Builder->SetInsertPoint(bthen);
+			if(!generateBlock(clause->getThen(), func_stmt))
+				return false;
+			if(!Builder->GetInsertBlock()->getTerminator())
+				Builder->CreateBr(bend);
+			if(belse != bend){
+				CurFunc->getBasicBlockList().push_back(belse);
+				Builder->SetInsertPoint(belse);
+			}
+		}
+		else{
+			if(!generateBlock(clause->getThen(), func_stmt))
+				return false;
+			if(!Builder->GetInsertBlock()->getTerminator())
+				Builder->CreateBr(bend);
+		}
+	}
+	CurFunc->getBasicBlockList().push_back(bend);
+	sealBlock(bend);
+	Builder->SetInsertPoint(bend);
+	return true;
+}
+
+/**
+ * ifの条件式生成メソッド
+ * begin番目からend番目の比較を and or で短絡評価し、結果でbtrueかbfalseへ分岐する
+ * 一番浅い [ ] の結合で左右に分ける (同じ深さでは and が強く結合するので or から分ける)
+ * @param IfStatementAST 比較の範囲 真の時の飛び先 偽の時の飛び先 FunctionStmtAST
+ * @return 成功時:true 失敗時:false
+ */
+bool CodeGen::generateCondition(IfStatementAST *if_expr, int begin, int end, 
+		llvm::BasicBlock *btrue, llvm::BasicBlock *bfalse, FunctionStmtAST *func_stmt){
+	// 条件式がない
+	if(begin > end){
+		Builder->CreateBr(btrue);
+		return true;
+	}
+
+	// 比較1つ
+	if(begin == end){
+		ComparisonAST *com = if_expr->getComparison(begin);
+		llvm::Value *fcmp = generateComparison(com->getLHS(), com->getRHS(), com->getOp(), func_stmt);
+		if(!fcmp)
+			return false;
+		Builder->CreateCondBr(fcmp, btrue, bfalse);
+		return true;
 	}
-	return v;
+
+	// 分ける結合を探す
+	int split = begin;
+	for(int i = begin+1; i < end; i++){
+		int depth = if_expr->getDepth(i);
+		int split_depth = if_expr->getDepth(split);
+		if(depth < split_depth || (depth == split_depth && 
+					if_expr->getOp(split) == LOGICAL_AND && if_expr->getOp(i) == LOGICAL_OR))
+			split = i;
+	}
+
+	llvm::BasicBlock *brhs;
+	if(if_expr->getOp(split) == LOGICAL_OR){
+		// lhs or rhs のlhsがtrueならbtrueへ, falseならrhsへ
+		brhs = llvm::BasicBlock::Create(Context, "or.lhs.false", CurFunc);
+		if(!generateCondition(if_expr, begin, split, btrue, brhs, func_stmt))
+			return false;
+	}
+	else{
+		// lhs and rhs のlhsがtrueならrhsへ, falseならbfalseへ
+		brhs = llvm::BasicBlock::Create(Context, "and.lhs.true", CurFunc);
+		if(!generateCondition(if_expr, begin, split, brhs, bfalse, func_stmt))
+			return false;
+	}
+	sealBlock(brhs);
+	Builder->SetInsertPoint(brhs);
+	return generateCondition(if_expr, split+1, end, btrue, bfalse, func_stmt);
 }
 
 /**
- * 変数宣言(alloca命令)生成メソッド
+ * 変数宣言生成メソッド
+ * 変数はallocaを作らずSSAの値で持つ
+ * mainの変数のうち他の関数からglobal宣言される変数はGlobalVariableも作る
  * @param VariableDeclAST
  * @return 生成したValueのポインタ
  */
 llvm::Value *CodeGen::generateVariableDeclaration(VariableDeclAST *vdecl){
-	if(CurFunc->getName().str() == "main"){
-		Mod->getOrInsertGlobal(vdecl->getName(), llvm::Type::getDoubleTy(llvm::getGlobalContext()));
+	SymbolID symbol = vdecl->getSymbol();
+	bool is_main = CurFunc->getName().str() == "main";
+	if(is_main && (KeepMainGlobals || SharedGlobals.count(symbol))){
+		Mod->getOrInsertGlobal(vdecl->getName(), llvm::Type::getDoubleTy(Context));
 		llvm::GlobalVariable *gvar = Mod->getNamedGlobal(vdecl->getName());
-		gvar->setLinkage(llvm::GlobalValue::CommonLinkage);
-		gvar->setInitializer(llvm::ConstantFP::get(llvm::Type::getDoubleTy(llvm::getGlobalContext()), 0));
-		return gvar;
+		gvar->setLinkage(KeepMainGlobals ? 
+				llvm::GlobalValue::CommonLinkage : llvm::GlobalValue::InternalLinkage);
+		gvar->setInitializer(llvm::ConstantFP::get(llvm::Type::getDoubleTy(Context), 0));
+		setSlot(GlobalSlots, symbol, gvar);
+		if(KeepMainGlobals)
+			return gvar;
+
+		// mainの中ではSSAの値で持ち、他の関数を呼ぶ前後で書き戻す
+		PromotedGlobals.push_back(symbol);
 	}
-	else{
-		// create alloca
-		llvm::AllocaInst *alloca = NULL;
-		
-		if(vdecl->getIdentify() == VariableDeclAST::dint)
-			alloca = Builder->CreateAlloca(llvm::Type::getInt32Ty(
-				llvm::getGlobalContext()), 0, vdecl->getName());
-		if(vdecl->getIdentify() == VariableDeclAST::ddouble)
-			alloca = Builder->CreateAlloca(llvm::Type::getDoubleTy(
-				llvm::getGlobalContext()), 0, vdecl->getName());
-
-		// if args alloca
-		if(vdecl->getType() == VariableDeclAST::param){
-			// store args
-			llvm::ValueSymbolTable &vs_table = CurFunc->getValueSymbolTable();
-			Builder->CreateStore(vs_table.lookup(vdecl->getName().append("_arg")), alloca);
-		}
-		return alloca;
+
+	llvm::Type *type = NULL;
+	if(vdecl->getIdentify() == VariableDeclAST::dint)
+		type = llvm::Type::getInt32Ty(Context);
+	if(vdecl->getIdentify() == VariableDeclAST::ddouble)
+		type = llvm::Type::getDoubleTy(Context);
+	if(vdecl->getIdentify() == VariableDeclAST::dint64)
+		type = llvm::Type::getInt64Ty(Context);
+	if(!type)
+		return NULL;
+
+	// 最初の定義 (引数は引数の値, それ以外は0)
+	// (mainは一度しか実行しないのでGlobalVariableの初期値0と同じ)
+	llvm::Value *init;
+	if(vdecl->getType() == VariableDeclAST::param){
+		llvm::ValueSymbolTable &vs_table = CurFunc->getValueSymbolTable();
+		init = vs_table.lookup(vdecl->getName().append("_arg"));
 	}
+	else
+		init = llvm::Constant::getNullValue(type);
+
+	if(LocalTypes.size() <= symbol)
+		LocalTypes.resize(SymbolTable::getInstance().size(), NULL);
+	if(!LocalTypes[symbol])
+		LocalSymbols.push_back(symbol);
+	LocalTypes[symbol] = type;
+	writeVariable(symbol, Builder->GetInsertBlock(), init);
+	return init;
 }
 
 /**
@@ -714,24 +602,16 @@ llvm::Value *CodeGen::generateBinaryExpression(BinaryExprAST *bin_expr, Function
 	BaseAST *lhs = bin_expr->getLHS();
 	BaseAST *rhs = bin_expr->getRHS();
 	
-	llvm::Value *lhs_v;
-	llvm::Value *rhs_v;
+	llvm::Value *lhs_v = NULL;
+	llvm::Value *rhs_v = NULL;
 
-	// = の場合に代入先に指定するValueを格納する
-	llvm::Value *assigned_v;
+	// = の場合の代入先
 	VariableAST *lhs_var;
 	
 	// assignment
-	if(bin_expr->getOp() == "="){
+	if(bin_expr->getOp() == BOP_ASSIGN){
 		// lhs is variable
 		lhs_var = llvm::dyn_cast<VariableAST>(lhs);
-		if(CurFunc->getName().str() == "main" || func_stmt->isGlobalVariable(lhs_var->getName()))
-			assigned_v = Mod->getNamedGlobal(lhs_var->getName());
-		else{
-			llvm::ValueSymbolTable &vs_table = CurFunc->getValueSymbolTable();
-			assigned_v = vs_table.lookup(lhs_var->getName());
-		}
-		lhs_v = generateVariable(lhs_var, func_stmt);
 
 	// other operand
 	}else{
@@ -751,7 +631,7 @@ llvm::Value *CodeGen::generateBinaryExpression(BinaryExprAST *bin_expr, Function
 		// Number?
 		}else if(llvm::isa<NumberAST>(lhs)){
 			NumberAST *num = llvm::dyn_cast<NumberAST>(lhs);
-			lhs_v = generateNumber(num->getNumberValue());
+			lhs_v = generateConstant(num->getNumberValue());
 		}
 	}
 
@@ -770,50 +650,77 @@ llvm::Value *CodeGen::generateBinaryExpression(BinaryExprAST *bin_expr, Function
 	// Number?
 	}else if(llvm::isa<NumberAST>(rhs)){
 		NumberAST *num = llvm::dyn_cast<NumberAST>(rhs);
-		rhs_v = generateNumber(num->getNumberValue());
+		rhs_v = generateConstant(num->getNumberValue());
 	}
 	
+	// 代入
+	if(bin_expr->getOp() == BOP_ASSIGN)
+		// 変数の定義を更新 (mainの変数とglobal宣言した変数はstore)
+		return assignVariable(lhs_var->getSymbol(), rhs_v, func_stmt);
+	if(!lhs_v || !rhs_v)
+		return NULL;
+
+	// 型推論で結果が ±2^53 に収まると分かった式は、両辺が整数ならi64で計算する (/ 以外)
+	// それ以外はdoubleにそろえる (オーバーフローせず、doubleで計算した時と同じ値になる)
+	llvm::Type *i64_type = llvm::Type::getInt64Ty(Context);
+	llvm::Type *double_type = llvm::Type::getDoubleTy(Context);
+	bool is_int = bin_expr->isInteger() &&
+		lhs_v->getType()->isIntegerTy() && rhs_v->getType()->isIntegerTy() &&
+		bin_expr->getOp() != BOP_DIV;
+	lhs_v = convertValue(lhs_v, is_int ? i64_type : double_type);
+	rhs_v = convertValue(rhs_v, is_int ? i64_type : double_type);
+
 	// コード生成
-	if(bin_expr->getOp() == "="){
-		// store
-		return Builder->CreateStore(rhs_v, assigned_v);
-	
-	}
-	
-	if(bin_expr->getOp() == "+"){
-		// add 
-		return Builder->CreateFAdd(lhs_v, rhs_v, "add_tmp");
-		
-	}else if(bin_expr->getOp() == "-"){
-		// sub
-		return Builder->CreateFSub(lhs_v, rhs_v, "sub_tmp");
-		
-	}else if(bin_expr->getOp() == "*"){
-		// mul
-		return Builder->CreateFMul(lhs_v, rhs_v, "mul_tmp");
-		
-	}else if(bin_expr->getOp() == "/"){
-		generateDenominatorCheck("割り算", rhs, bin_expr->getLine(), func_stmt);
-		
-		// div
-		return Builder->CreateFDiv(lhs_v, rhs_v,"div_tmp");
-	}
-	else if(bin_expr->getOp() == "//"){
-		generateDenominatorCheck("割り切り算", rhs, bin_expr->getLine(), func_stmt);
-		
-		// div
-		llvm::Value *div_tmp = Builder->CreateFDiv(lhs_v, rhs_v, "div_tmp");
-		div_tmp = Builder->CreateCast(llvm::Instruction::FPToSI, div_tmp,
-				llvm::Type::getInt32Ty(llvm::getGlobalContext()));
-		div_tmp = Builder->CreateCast(llvm::Instruction::SIToFP, div_tmp,
-				llvm::Type::getDoubleTy(llvm::getGlobalContext()));
-		return div_tmp;
-	}
-	else if(bin_expr->getOp() == "%"){
-		generateDenominatorCheck("余り演算", rhs, bin_expr->getLine(), func_stmt);
-		
-		// rem
-		return Builder->CreateFRem(lhs_v, rhs_v, "rem_tmp");
+	switch(bin_expr->getOp()){
+		case BOP_ASSIGN:
+			return NULL;
+
+		case BOP_ADD:
+			// add 
+			if(is_int)
+				return Builder->CreateAdd(lhs_v, rhs_v, "add_tmp");
+			return Builder->CreateFAdd(lhs_v, rhs_v, "add_tmp");
+
+		case BOP_SUB:
+			// sub
+			if(is_int)
+				return Builder->CreateSub(lhs_v, rhs_v, "sub_tmp");
+			return Builder->CreateFSub(lhs_v, rhs_v, "sub_tmp");
+
+		case BOP_MUL:
+			// mul
+			if(is_int)
+				return Builder->CreateMul(lhs_v, rhs_v, "mul_tmp");
+			return Builder->CreateFMul(lhs_v, rhs_v, "mul_tmp");
+
+		case BOP_DIV:
+			generateDenominatorCheck("割り算", rhs_v, bin_expr->getLine());
+
+			// div
+			return Builder->CreateFDiv(lhs_v, rhs_v,"div_tmp");
+
+		case BOP_FLOOR_DIV:{
+			generateDenominatorCheck("割り切り算", rhs_v, bin_expr->getLine());
+
+			// div (0の方へ切り捨てる)
+			if(is_int)
+				return Builder->CreateSDiv(lhs_v, rhs_v, "div_tmp");
+			llvm::Value *div_tmp = Builder->CreateFDiv(lhs_v, rhs_v, "div_tmp");
+			// 範囲が分かっていればi64に変換できる
+			if(bin_expr->isInteger())
+				return Builder->CreateCast(llvm::Instruction::FPToSI, div_tmp, i64_type, "int_tmp");
+			// 分からなければdoubleのまま小数部分を引く (商 - fmod(商, 1))
+			llvm::Value *frac_tmp = Builder->CreateFRem(div_tmp, generateNumber(1.0), "frac_tmp");
+			return Builder->CreateFSub(div_tmp, frac_tmp, "int_tmp");
+		}
+
+		case BOP_REM:
+			generateDenominatorCheck("余り演算", rhs_v, bin_expr->getLine());
+
+			// rem
+			if(is_int)
+				return Builder->CreateSRem(lhs_v, rhs_v, "rem_tmp");
+			return Builder->CreateFRem(lhs_v, rhs_v, "rem_tmp");
 	}
 	return NULL;
 }
@@ -836,7 +743,10 @@ llvm::Value *CodeGen::generateCallExpression(CallExprAST *call_expr, FunctionStm
 	
 	if(call_expr->getCallee() == "input"){
 		VariableAST *var;
-		llvm::ValueSymbolTable &vs_table = CurFunc->getValueSymbolTable();
+		// SSAの値で持つ変数はscanfに渡す領域をentryに確保し、読んだ後に定義を更新する
+		std::vector<std::pair<SymbolID, llvm::AllocaInst*> > input_vars;
+		llvm::BasicBlock &entry = CurFunc->getEntryBlock();
+		llvm::IRBuilder<> entry_builder(&entry, entry.begin());
 		for(int i = 0; ; i++){
 			if(!(arg = call_expr->getArgs(i)))
 				break;
@@ -846,17 +756,25 @@ llvm::Value *CodeGen::generateCallExpression(CallExprAST *call_expr, FunctionStm
 				return NULL;
 			}
 			var = llvm::dyn_cast<VariableAST>(arg);
-			if(CurFunc->getName().str() == "main" || func_stmt->isGlobalVariable(var->getName()))
-					arg_vec.push_back(Mod->getNamedGlobal(var->getName()));
+			if(isLocalVariable(var->getSymbol(), func_stmt)){
+				llvm::AllocaInst *slot = entry_builder.CreateAlloca(
+						LocalTypes[var->getSymbol()], 0, var->getName() + "_input");
+				input_vars.push_back(std::make_pair(var->getSymbol(), slot));
+				arg_vec.push_back(slot);
+			}
 			else
-				arg_vec.push_back(vs_table.lookup(var->getName()));
+				arg_vec.push_back(getVariableSlot(var->getSymbol(), func_stmt));
 		}
 
 		Str = "%lf";
 		for(int i = 0; i < arg_vec.size()-2; i++)
 			Str += " %lf";
 		arg_vec.at(0) = generateString(Str);
-		return Builder->CreateCall(Mod->getFunction("__isoc99_scanf"), arg_vec, "call_temp");
+		llvm::Value *call_v = Builder->CreateCall(Mod->getFunction("__isoc99_scanf"), arg_vec, "call_temp");
+		for(int i = 0; i < input_vars.size(); i++)
+			writeVariable(input_vars[i].first, Builder->GetInsertBlock(), 
+					Builder->CreateLoad(input_vars[i].second, "var_temp"));
+		return call_v;
 	}
 
 	for(int i = 0; ;i++){
@@ -871,7 +789,7 @@ llvm::Value *CodeGen::generateCallExpression(CallExprAST *call_expr, FunctionStm
 		}else if(llvm::isa<BinaryExprAST>(arg)){
 			BinaryExprAST *bin_expr = llvm::dyn_cast<BinaryExprAST>(arg);
 			arg_v = generateBinaryExpression(llvm::dyn_cast<BinaryExprAST>(arg), func_stmt);
-			if(bin_expr->getOp() == "="){
+			if(bin_expr->getOp() == BOP_ASSIGN){
 				VariableAST *var = llvm::dyn_cast<VariableAST>(bin_expr->getLHS());
 				arg_v = generateVariable(var, func_stmt);
 			}
@@ -883,7 +801,7 @@ llvm::Value *CodeGen::generateCallExpression(CallExprAST *call_expr, FunctionStm
 		// isNumber
 		}else if(llvm::isa<NumberAST>(arg)){
 			NumberAST *num = llvm::dyn_cast<NumberAST>(arg);
-			arg_v = generateNumber(num->getNumberValue());
+			arg_v = generateConstant(num->getNumberValue());
 	
 		// string
 		}else if(llvm::isa<StringAST>(arg)){
@@ -894,18 +812,21 @@ llvm::Value *CodeGen::generateCallExpression(CallExprAST *call_expr, FunctionStm
 		}else if(llvm::isa<NewLineAST>(arg)){}
 
 		if(call_expr->getCallee() == "print"){
+			// 整数はdoubleにして表示する
+			if(!llvm::isa<StringAST>(arg) && !llvm::isa<NewLineAST>(arg))
+				arg_v = convertValue(arg_v, llvm::Type::getDoubleTy(Context));
 			llvm::Value *print_string;
 			std::vector<llvm::Value*> print_vec;
 			std::vector<llvm::Value*> indices;
 			std::vector<llvm::Value*> memset_vec;
-			indices.push_back(llvm::ConstantInt::get(llvm::Type::getInt32Ty(llvm::getGlobalContext()), 0));
-			indices.push_back(llvm::ConstantInt::get(llvm::Type::getInt32Ty(llvm::getGlobalContext()), 0));
-			llvm::AllocaInst *print_str = Builder->CreateAlloca(llvm::ArrayType::get(llvm::Type::getInt8Ty(llvm::getGlobalContext()), 1));
-			memset_vec.push_back(Builder->CreatePointerCast(print_str, llvm::Type::getInt8PtrTy(llvm::getGlobalContext()), "print_str_temp"));
-			memset_vec.push_back(llvm::ConstantInt::get(llvm::Type::getInt8Ty(llvm::getGlobalContext()), 0));
-			memset_vec.push_back(llvm::ConstantInt::get(llvm::Type::getInt64Ty(llvm::getGlobalContext()), 1));
-			memset_vec.push_back(llvm::ConstantInt::get(llvm::Type::getInt32Ty(llvm::getGlobalContext()), 1));
-			memset_vec.push_back(llvm::ConstantInt::get(llvm::Type::getInt1Ty(llvm::getGlobalContext()), false));
+			indices.push_back(llvm::ConstantInt::get(llvm::Type::getInt32Ty(Context), 0));
+			indices.push_back(llvm::ConstantInt::get(llvm::Type::getInt32Ty(Context), 0));
+			llvm::AllocaInst *print_str = Builder->CreateAlloca(llvm::ArrayType::get(llvm::Type::getInt8Ty(Context), 1));
+			memset_vec.push_back(Builder->CreatePointerCast(print_str, llvm::Type::getInt8PtrTy(Context), "print_str_temp"));
+			memset_vec.push_back(llvm::ConstantInt::get(llvm::Type::getInt8Ty(Context), 0));
+			memset_vec.push_back(llvm::ConstantInt::get(llvm::Type::getInt64Ty(Context), 1));
+			memset_vec.push_back(llvm::ConstantInt::get(llvm::Type::getInt32Ty(Context), 1));
+			memset_vec.push_back(llvm::ConstantInt::get(llvm::Type::getInt1Ty(Context), false));
 			Builder->CreateCall(Mod->getFunction("llvm.memset.p0i8.i64"), memset_vec, "call_temp");
 			if(llvm::isa<StringAST>(arg)){
 				print_vec.push_back(generateString("%s "));
@@ -953,10 +874,12 @@ llvm::Value *CodeGen::generateCallExpression(CallExprAST *call_expr, FunctionStm
 				else if(digit == "-2"){
 					llvm::Value *mod = Builder->CreateFRem(arg_v, generateNumber(1), "rem_temp");
 					llvm::Value *fcmp = Builder->CreateFCmpOEQ(mod, generateNumber(0), "cmp");
-					llvm::BasicBlock *integer = llvm::BasicBlock::Create(llvm::getGlobalContext(), "int_arg", CurFunc);
-					llvm::BasicBlock *decimal = llvm::BasicBlock::Create(llvm::getGlobalContext(), "dec_arg", CurFunc);
-					llvm::BasicBlock *end = llvm::BasicBlock::Create(llvm::getGlobalContext(), "end_arg", CurFunc);
+					llvm::BasicBlock *integer = llvm::BasicBlock::Create(Context, "int_arg", CurFunc);
+					llvm::BasicBlock *decimal = llvm::BasicBlock::Create(Context, "dec_arg", CurFunc);
+					llvm::BasicBlock *end = llvm::BasicBlock::Create(Context, "end_arg", CurFunc);
 					Builder->CreateCondBr(fcmp, integer, decimal);
+					sealBlock(integer);
+					sealBlock(decimal);
 					Builder->SetInsertPoint(integer);
 					
 					
@@ -990,6 +913,7 @@ llvm::Value *CodeGen::generateCallExpression(CallExprAST *call_expr, FunctionStm
 					val = Builder->CreateCall(Mod->getFunction("printf"), print_vec, "call_temp");
 					Builder->CreateBr(end);
 
+					sealBlock(end);
 					Builder->SetInsertPoint(end);
 				}else{
 					val = Builder->CreateInBoundsGEP(print_str,indices, "print_array");
@@ -1006,6 +930,10 @@ llvm::Value *CodeGen::generateCallExpression(CallExprAST *call_expr, FunctionStm
 			}
 		}
 		else {
+			// 呼ぶ関数の引数の型に合わせる
+			llvm::Function *callee = Mod->getFunction(call_expr->getCallee());
+			if(callee && i < callee->arg_size())
+				arg_v = convertValue(arg_v, callee->getFunctionType()->getParamType(i));
 			arg_vec.push_back(arg_v);
 		}
 
@@ -1013,8 +941,12 @@ llvm::Value *CodeGen::generateCallExpression(CallExprAST *call_expr, FunctionStm
 	if(call_expr->getCallee() == "print"){
 		return val;
 	}
-	else
-		return Builder->CreateCall(Mod->getFunction(call_expr->getCallee()), arg_vec, "call_temp");
+
+	// 呼んだ関数がglobal宣言した変数を読み書きできるように書き戻す
+	storePromotedGlobals();
+	llvm::Value *call_v = Builder->CreateCall(Mod->getFunction(call_expr->getCallee()), arg_vec, "call_temp");
+	loadPromotedGlobals();
+	return call_v;
 }
 
 /**
@@ -1036,36 +968,264 @@ llvm::Value *CodeGen::generateReturnStatement(ReturnStmtAST *jump_stmt, Function
 		ret_v = generateVariable(var, func_stmt);
 	}else if(llvm::isa<NumberAST>(expr)){
 		NumberAST *num = llvm::dyn_cast<NumberAST>(expr);
-		ret_v = generateNumber(num->getNumberValue());
+		ret_v = generateConstant(num->getNumberValue());
 	}
 	if(!ret_v)
 		return NULL;
 	else{
-		if(CurFunc->getReturnType()->isIntegerTy() && ret_v->getType()->isDoubleTy())
-			ret_v = Builder->CreateCast(llvm::Instruction::FPToSI, ret_v,
-					llvm::Type::getInt32Ty(llvm::getGlobalContext()), "int_tmp");
-		else if(CurFunc->getReturnType()->isDoubleTy() && ret_v->getType()->isIntegerTy())
-			ret_v = Builder->CreateCast(llvm::Instruction::SIToFP, ret_v,
-					llvm::Type::getDoubleTy(llvm::getGlobalContext()), "double_tmp");
+		ret_v = convertValue(ret_v, CurFunc->getReturnType());
+		storePromotedGlobals();
 		Builder->CreateRet(ret_v);
 		return ret_v;
 	}
 }
 
 /**
- * 変数参照（load命令）生成メソッド
+ * 変数参照生成メソッド
+ * 関数の変数は現在の定義 (SSAの値)、mainの変数とglobal宣言した変数はload命令
  * @param VariableAST
  * @return 生成したValueのポインタ
  */
 llvm::Value *CodeGen::generateVariable(VariableAST *var, FunctionStmtAST *func_stmt){
+	if(isLocalVariable(var->getSymbol(), func_stmt))
+		return readVariable(var->getSymbol(), Builder->GetInsertBlock());
+	llvm::Value *value = getVariableSlot(var->getSymbol(), func_stmt);
+	return Builder->CreateLoad(value, "var_temp");
+}
+
+/**
+ * 変数の格納先を取得する
+ * 他の関数と共有するmainの変数とglobal宣言した変数のGlobalVariable (それ以外はSSAの値で持つので格納先はない)
+ * @param 変数名の番号 FunctionStmtAST
+ * @return 格納先 (宣言されていなければNULL)
+ */
+llvm::Value *CodeGen::getVariableSlot(SymbolID symbol, FunctionStmtAST *func_stmt){
+	if(CurFunc->getName().str() == "main" || func_stmt->isGlobalVariable(symbol))
+		return symbol < GlobalSlots.size() ? GlobalSlots[symbol] : NULL;
+	return NULL;
+}
+
+/**
+ * SSAの値で持つ関数の変数か判定する
+ * @param 変数名の番号 FunctionStmtAST
+ * @return 関数の変数:true それ以外:false
+ */
+bool CodeGen::isLocalVariable(SymbolID symbol, FunctionStmtAST *func_stmt){
+	if(func_stmt->isGlobalVariable(symbol))
+		return false;
+	return symbol < LocalTypes.size() && LocalTypes[symbol];
+}
+
+/**
+ * mainでSSAの値で持っているGlobalVariableを書き戻す (他の関数を呼ぶ前, return の前)
+ */
+void CodeGen::storePromotedGlobals(){
+	for(int i = 0; i < PromotedGlobals.size(); i++){
+		SymbolID symbol = PromotedGlobals[i];
+		Builder->CreateStore(readVariable(symbol, Builder->GetInsertBlock()), GlobalSlots[symbol]);
+	}
+}
+
+/**
+ * mainでSSAの値で持っているGlobalVariableを読み直す (他の関数を呼んだ後)
+ */
+void CodeGen::loadPromotedGlobals(){
+	for(int i = 0; i < PromotedGlobals.size(); i++){
+		SymbolID symbol = PromotedGlobals[i];
+		writeVariable(symbol, Builder->GetInsertBlock(), 
+				Builder->CreateLoad(GlobalSlots[symbol], "var_temp"));
+	}
+}
+
+/**
+ * 変数への代入を生成する
+ * 関数の変数は現在のBlockの定義を更新し、それ以外はstore命令
+ * @param 変数名の番号 代入する値 FunctionStmtAST
+ * @return 代入した値
+ */
+llvm::Value *CodeGen::assignVariable(SymbolID symbol, llvm::Value *value, FunctionStmtAST *func_stmt){
+	if(!value)
+		return NULL;
+	// 変数の型に合わせる (GlobalVariableはdouble)
+	if(!isLocalVariable(symbol, func_stmt)){
+		value = convertValue(value, llvm::Type::getDoubleTy(Context));
+		Builder->CreateStore(value, getVariableSlot(symbol, func_stmt));
+		return value;
+	}
+
+	value = convertValue(value, LocalTypes[symbol]);
+	writeVariable(symbol, Builder->GetInsertBlock(), value);
+	return value;
+}
+
+/**
+ * 変数の定義を記録する
+ * @param 変数名の番号 定義したBlock 定義した値
+ */
+void CodeGen::writeVariable(SymbolID symbol, llvm::BasicBlock *block, llvm::Value *value){
+	if(UseAllocas){
+		Builder->CreateStore(value, getLocalAlloca(symbol));
+		return;
+	}
+	CurrentDefs[std::make_pair(block, symbol)] = value;
+}
+
+/**
+ * Blockでの変数の定義を取得する
+ * Blockで定義していなければ前のBlockから探し、合流する所にはphiを置く
+ * @param 変数名の番号 読むBlock
+ * @return 変数の値
+ */
+llvm::Value *CodeGen::readVariable(SymbolID symbol, llvm::BasicBlock *block){
+	if(UseAllocas)
+		return Builder->CreateLoad(getLocalAlloca(symbol), "var_temp");
+	DefMap::iterator it = CurrentDefs.find(std::make_pair(block, symbol));
+	if(it != CurrentDefs.end())
+		return it->second;
+	return readVariableRecursive(symbol, block);
+}
+
+/**
+ * -alloca-vars の時の変数の格納先を取得する (無ければentryの先頭にallocaを作る)
+ * @param 変数名の番号
+ * @return 変数のalloca
+ */
+llvm::AllocaInst *CodeGen::getLocalAlloca(SymbolID symbol){
+	if(LocalAllocas.size() <= symbol)
+		LocalAllocas.resize(SymbolTable::getInstance().size(), NULL);
+	llvm::AllocaInst *slot = LocalAllocas[symbol];
+	// 型を変えて宣言し直した変数は別のallocaにする
+	if(!slot || slot->getAllocatedType() != LocalTypes[symbol]){
+		llvm::BasicBlock &entry = CurFunc->getEntryBlock();
+		llvm::IRBuilder<> entry_builder(&entry, entry.begin());
+		slot = entry_builder.CreateAlloca(LocalTypes[symbol], 0, 
+				SymbolTable::getInstance().getName(symbol));
+		LocalAllocas[symbol] = slot;
+	}
+	return slot;
+}
+
+llvm::Value *CodeGen::readVariableRecursive(SymbolID symbol, llvm::BasicBlock *block){
 	llvm::Value *value;
-	if(CurFunc->getName().str() == "main" || func_stmt->isGlobalVariable(var->getName())){
-		value = Mod->getNamedGlobal(var->getName());
-	}else{
-		llvm::ValueSymbolTable &vs_table = CurFunc->getValueSymbolTable();
-		value = vs_table.lookup(var->getName());
+	if(!SealedBlocks.count(block)){
+		// 前のBlockが揃っていないので空のphiを置き、sealBlockで引数を埋める
+		llvm::PHINode *phi = createPhi(symbol, block);
+		IncompletePhis[block].push_back(std::make_pair(symbol, phi));
+		value = phi;
 	}
-	return Builder->CreateLoad(value, "var_temp");
+	else if(llvm::BasicBlock *pred = block->getSinglePredecessor()){
+		value = readVariable(symbol, pred);
+	}
+	else if(llvm::pred_begin(block) == llvm::pred_end(block)){
+		// 到達しないBlock
+		value = llvm::UndefValue::get(LocalTypes[symbol]);
+	}
+	else{
+		// ループで自身に戻ってきた時のために先にphiを定義にしておく
+		llvm::PHINode *phi = createPhi(symbol, block);
+		writeVariable(symbol, block, phi);
+		value = addPhiOperands(symbol, phi);
+	}
+	writeVariable(symbol, block, value);
+	return value;
+}
+
+/**
+ * Blockの先頭に変数のphiを置く
+ * @param 変数名の番号 置くBlock
+ * @return 引数が空のphi
+ */
+llvm::PHINode *CodeGen::createPhi(SymbolID symbol, llvm::BasicBlock *block){
+	llvm::Type *type = LocalTypes[symbol];
+	std::string name = SymbolTable::getInstance().getName(symbol).str();
+	if(block->empty())
+		return llvm::PHINode::Create(type, 2, name, block);
+	return llvm::PHINode::Create(type, 2, name, &block->front());
+}
+
+/**
+ * 前のBlockそれぞれの定義をphiの引数にする
+ * @param 変数名の番号 phi
+ * @return 変数の値 (phiが不要なら置き換えた値)
+ */
+llvm::Value *CodeGen::addPhiOperands(SymbolID symbol, llvm::PHINode *phi){
+	llvm::BasicBlock *block = phi->getParent();
+	std::vector<llvm::BasicBlock*> preds(llvm::pred_begin(block), llvm::pred_end(block));
+	for(int i = 0; i < preds.size(); i++)
+		phi->addIncoming(readVariable(symbol, preds[i]), preds[i]);
+	return tryRemoveTrivialPhi(phi);
+}
+
+/**
+ * 引数が自身ともう1つの値だけのphiを取り除く
+ * phiを使っていたphiも不要になることがあるので続けて調べる
+ * @param phi
+ * @return 変数の値 (取り除いた場合は置き換えた値)
+ */
+llvm::Value *CodeGen::tryRemoveTrivialPhi(llvm::PHINode *phi){
+	llvm::Value *same = NULL;
+	for(unsigned i = 0; i < phi->getNumIncomingValues(); i++){
+		llvm::Value *op = phi->getIncomingValue(i);
+		if(op == same || op == phi)
+			continue;
+		// 2つ以上の値が合流する
+		if(same)
+			return phi;
+		same = op;
+	}
+	if(!same)
+		same = llvm::UndefValue::get(phi->getType());
+
+	std::vector<llvm::WeakVH> users;
+	for(llvm::Value::use_iterator it = phi->use_begin(); it != phi->use_end(); ++it)
+		if(*it != phi && llvm::isa<llvm::PHINode>(*it))
+			users.push_back(*it);
+
+	// 置き換えた先も取り除かれることがあるので追跡する
+	llvm::TrackingVH<llvm::Value> result(same);
+	phi->replaceAllUsesWith(same);
+	phi->eraseFromParent();
+	for(int i = 0; i < users.size(); i++)
+		if(llvm::PHINode *user = llvm::dyn_cast_or_null<llvm::PHINode>((llvm::Value*)users[i]))
+			tryRemoveTrivialPhi(user);
+	return result;
+}
+
+/**
+ * 前のBlockが全て揃ったBlockを確定する
+ * 置いておいた空のphiの引数を埋める
+ * @param BasicBlock
+ */
+void CodeGen::sealBlock(llvm::BasicBlock *block){
+	std::vector<std::pair<SymbolID, llvm::PHINode*> > phis;
+	std::map<llvm::BasicBlock*, std::vector<std::pair<SymbolID, llvm::PHINode*> > >::iterator it = IncompletePhis.find(block);
+	if(it != IncompletePhis.end()){
+		phis.swap(it->second);
+		IncompletePhis.erase(it);
+	}
+	for(int i = 0; i < phis.size(); i++)
+		addPhiOperands(phis[i].first, phis[i].second);
+	SealedBlocks.insert(block);
+}
+
+/**
+ * 変数の格納先を設定する
+ * @param 格納先の表 変数名の番号 格納先
+ */
+void CodeGen::setSlot(std::vector<llvm::Value*> &slots, SymbolID symbol, llvm::Value *value){
+	if(slots.size() <= symbol)
+		slots.resize(SymbolTable::getInstance().size(), NULL);
+	slots[symbol] = value;
+}
+
+/**
+ * 変数の格納先を全て消す (Moduleを作り直した時)
+ */
+void CodeGen::clearSlots(){
+	GlobalSlots.clear();
+	LocalTypes.clear();
+	LocalSymbols.clear();
+	LocalAllocas.clear();
 }
 
 /**
@@ -1074,7 +1234,37 @@ llvm::Value *CodeGen::generateVariable(VariableAST *var, FunctionStmtAST *func_s
  * @return 生成したValueのポインタ
  */
 llvm::Value *CodeGen::generateNumber(double value){
-	return llvm::ConstantFP::get(llvm::Type::getDoubleTy(llvm::getGlobalContext()), value);
+	return llvm::ConstantFP::get(llvm::Type::getDoubleTy(Context), value);
+}
+
+/**
+ * 数値の定数生成メソッド
+ * i64で表せる整数はi64, それ以外はdoubleの定数にする
+ * @param 生成する定数の値
+ * @return 生成したValueのポインタ
+ */
+llvm::Value *CodeGen::generateConstant(double value){
+	if(TypeInference::isIntegerNumber(value))
+		return llvm::ConstantInt::get(llvm::Type::getInt64Ty(Context), (int64_t)value, true);
+	return generateNumber(value);
+}
+
+/**
+ * 値の型変換
+ * 整数とdoubleの間、整数の幅の違いを変換する
+ * @param 変換する値 変換先の型
+ * @return 変換したValueのポインタ
+ */
+llvm::Value *CodeGen::convertValue(llvm::Value *value, llvm::Type *type){
+	if(!value || value->getType() == type)
+		return value;
+	if(type->isIntegerTy() && value->getType()->isDoubleTy())
+		return Builder->CreateCast(llvm::Instruction::FPToSI, value, type, "int_tmp");
+	if(type->isDoubleTy() && value->getType()->isIntegerTy())
+		return Builder->CreateCast(llvm::Instruction::SIToFP, value, type, "double_tmp");
+	if(type->isIntegerTy() && value->getType()->isIntegerTy())
+		return Builder->CreateIntCast(value, type, true, "int_tmp");
+	return value;
 }
 
 /**
@@ -1090,12 +1280,29 @@ llvm::Value *CodeGen::generateString(std::string str){
  * Module結合用メソッド
  */
 bool CodeGen::linkModule(llvm::Module *dest, std::string file_name){
-	llvm::SMDiagnostic err;
+	ProfileScope prof("phase", "リンク(-l)", file_name);
+
+	// 読み込み済みのModuleは変更しないように複製して結合
+	if(SharedLinkMod){
+		std::string err_msg;
+		if(llvm::Linker::LinkModules(dest, SharedLinkMod, llvm::Linker::PreserveSource, &err_msg)){
+			fprintf(stderr, "%s がリンクできません : %s\n", file_name.c_str(), err_msg.c_str());
+			return false;
+		}
+		return true;
+	}
+
 	// Moduleの読み込み
-	llvm::Module *link_mod = llvm::ParseIRFile(file_name, err, llvm::getGlobalContext());
+	llvm::Module *link_mod = loadLinkModule(file_name);
 	if(!link_mod)
 		return false;
 
+	// bitcodeの場合は使う関数だけ読み込む
+	if(link_mod->getMaterializer() && !materializeReferencedFunctions(dest, link_mod)){
+		SAFE_DELETE(link_mod);
+		return false;
+	}
+
 	// Moduleの結合
 	std::string err_msg;
 	if(llvm::Linker::LinkModules(dest, link_mod, llvm::Linker::DestroySource, &err_msg))
@@ -1106,6 +1313,112 @@ bool CodeGen::linkModule(llvm::Module *dest, std::string file_name){
 	return true;
 }
 
+/**
+ * リンクするModuleの読み込み
+ * bitcodeの場合は関数の本体を読み込まずに遅延読み込みにする
+ * LLVM-IR(テキスト)の場合は全て読み込む
+ * @param ファイル名
+ * @return 成功時:Module 失敗時:NULL
+ */
+llvm::Module *CodeGen::loadLinkModule(std::string file_name){
+	llvm::OwningPtr<llvm::MemoryBuffer> buffer;
+	if(llvm::MemoryBuffer::getFile(file_name, buffer)){
+		fprintf(stderr, "リンクファイル %s が開けません\n", file_name.c_str());
+		return NULL;
+	}
+
+	const unsigned char *start = (const unsigned char*)buffer->getBufferStart();
+	const unsigned char *end = (const unsigned char*)buffer->getBufferEnd();
+	if(llvm::isBitcode(start, end)){
+		std::string error;
+		// 成功した場合はbufferの所有権はModuleに移る
+		llvm::Module *mod = llvm::getLazyBitcodeModule(buffer.get(), Context, &error);
+		if(!mod){
+			fprintf(stderr, "リンクファイル %s が読み込めません : %s\n", file_name.c_str(), error.c_str());
+			return NULL;
+		}
+		buffer.take();
+		return mod;
+	}
+
+	llvm::SMDiagnostic err;
+	llvm::Module *mod = llvm::ParseIR(buffer.take(), err, Context);
+	if(!mod)
+		fprintf(stderr, "リンクファイル %s が読み込めません : %s\n", file_name.c_str(), err.getMessage().c_str());
+	return mod;
+}
+
+/**
+ * destから参照される関数とそこから辿れる関数だけを読み込む
+ * 参照されない関数は削除して、Linkerが読み込まないようにする
+ * @param リンク先Module リンクするModule(遅延読み込み)
+ * @return 成功時:true 失敗時:false
+ */
+bool CodeGen::materializeReferencedFunctions(llvm::Module *dest, llvm::Module *link_mod){
+	std::vector<llvm::Function*> worklist;
+	std::set<llvm::Value*> visited;
+
+	// destで宣言だけされている関数
+	for(llvm::Module::iterator func = dest->begin(); func != dest->end(); func++){
+		if(!func->isDeclaration())
+			continue;
+		llvm::Function *link_func = link_mod->getFunction(func->getName());
+		if(link_func && visited.insert(link_func).second)
+			worklist.push_back(link_func);
+	}
+	// グローバル変数の初期値から参照される関数 (Linkerが全て結合するため)
+	for(llvm::Module::global_iterator gv = link_mod->global_begin(); gv != link_mod->global_end(); gv++){
+		if(gv->hasInitializer())
+			collectReferencedFunctions(gv->getInitializer(), worklist, visited);
+	}
+
+	while(!worklist.empty()){
+		llvm::Function *func = worklist.back();
+		worklist.pop_back();
+
+		std::string error;
+		if(func->isMaterializable() && func->Materialize(&error)){
+			fprintf(stderr, "関数 %s が読み込めません : %s\n", func->getName().str().c_str(), error.c_str());
+			return false;
+		}
+		for(llvm::Function::iterator bb = func->begin(); bb != func->end(); bb++){
+			for(llvm::BasicBlock::iterator inst = bb->begin(); inst != bb->end(); inst++){
+				for(unsigned i = 0; i < inst->getNumOperands(); i++)
+					collectReferencedFunctions(inst->getOperand(i), worklist, visited);
+			}
+		}
+	}
+
+	// 使わない関数を削除
+	for(llvm::Module::iterator func = link_mod->begin(); func != link_mod->end(); ){
+		llvm::Function *cur = func++;
+		if(cur->isMaterializable() && cur->use_empty())
+			cur->eraseFromParent();
+	}
+	return true;
+}
+
+/**
+ * 値から参照される関数を集める
+ * 定数式(bitcastなど)の中も辿る
+ * @param 値 関数の格納先 訪問済みの値
+ */
+void CodeGen::collectReferencedFunctions(llvm::Value *value, std::vector<llvm::Function*> &funcs,
+		std::set<llvm::Value*> &visited){
+	if(llvm::Function *func = llvm::dyn_cast<llvm::Function>(value)){
+		if(visited.insert(func).second)
+			funcs.push_back(func);
+		return;
+	}
+	if(llvm::isa<llvm::GlobalValue>(value) || !llvm::isa<llvm::Constant>(value))
+		return;
+	if(!visited.insert(value).second)
+		return;
+	llvm::Constant *constant = llvm::cast<llvm::Constant>(value);
+	for(unsigned i = 0; i < constant->getNumOperands(); i++)
+		collectReferencedFunctions(constant->getOperand(i), funcs, visited);
+}
+
 
 
 
@@ -1113,7 +1426,7 @@ bool CodeGen::linkModule(llvm::Module *dest, std::string file_name){
 //////////////////////////////////////////////////////
 //比較を生成
 //////////////////////////////////////////////////////
-llvm::Value *CodeGen::generateComparison(BaseAST *lhs, BaseAST *rhs, std::string op, FunctionStmtAST *func_stmt){
+llvm::Value *CodeGen::generateComparison(BaseAST *lhs, BaseAST *rhs, CompareOp op, FunctionStmtAST *func_stmt){
 	llvm::Value *lhs_v;
 	llvm::Value *rhs_v;
 	
@@ -1125,7 +1438,7 @@ llvm::Value *CodeGen::generateComparison(BaseAST *lhs, BaseAST *rhs, std::string
 	}else if(llvm::isa<VariableAST>(lhs)){
 		lhs_v = generateVariable(llvm::dyn_cast<VariableAST>(lhs), func_stmt);
 	}else if(llvm::isa<NumberAST>(lhs)){
-		lhs_v = generateNumber(llvm::dyn_cast<NumberAST>(lhs)->getNumberValue());
+		lhs_v = generateConstant(llvm::dyn_cast<NumberAST>(lhs)->getNumberValue());
 	}else{
 		fprintf(stderr, "タイプ%dの左辺値が取得できません\n", lhs->getValueID());
 		return NULL;
@@ -1139,107 +1452,298 @@ llvm::Value *CodeGen::generateComparison(BaseAST *lhs, BaseAST *rhs, std::string
 	}else if(llvm::isa<VariableAST>(rhs)){
 		rhs_v = generateVariable(llvm::dyn_cast<VariableAST>(rhs), func_stmt);
 	}else if(llvm::isa<NumberAST>(rhs)){
-		rhs_v = generateNumber(llvm::dyn_cast<NumberAST>(rhs)->getNumberValue());
+		rhs_v = generateConstant(llvm::dyn_cast<NumberAST>(rhs)->getNumberValue());
 	}else{
 		fprintf(stderr, "右辺値が取得できません\n");
 		return NULL;
 	}
 	
-	// コード生成
-	if(op == "==")
-		return Builder->CreateFCmpOEQ(lhs_v, rhs_v, "cmp");
-	else if(op == ">=")
-		return Builder->CreateFCmpOGE(lhs_v, rhs_v, "cmp");
-	else if(op == ">")
-		return Builder->CreateFCmpOGT(lhs_v, rhs_v, "cmp");
-	else if(op == "<=")
-		return Builder->CreateFCmpOLE(lhs_v, rhs_v, "cmp");
-	else if(op == "<")
-		return Builder->CreateFCmpOLT(lhs_v, rhs_v, "cmp");
-	else if(op == "!=")
-		return Builder->CreateFCmpONE(lhs_v, rhs_v, "cmp");
-	else
+	return generateCompareValues(lhs_v, rhs_v, op);
+}
+
+/**
+ * 比較命令生成メソッド
+ * 両辺が整数ならicmp, どちらかがdoubleならdoubleにそろえてfcmp
+ * @param 左辺値 右辺値 比較演算子
+ * @return 生成したValueのポインタ
+ */
+llvm::Value *CodeGen::generateCompareValues(llvm::Value *lhs_v, llvm::Value *rhs_v, CompareOp op){
+	if(!lhs_v || !rhs_v)
+		return NULL;
+	if(lhs_v->getType()->isIntegerTy() && rhs_v->getType()->isIntegerTy()){
+		llvm::Type *i64_type = llvm::Type::getInt64Ty(Context);
+		lhs_v = convertValue(lhs_v, i64_type);
+		rhs_v = convertValue(rhs_v, i64_type);
+		switch(op){
+			case CMP_EQ:
+				return Builder->CreateICmpEQ(lhs_v, rhs_v, "cmp");
+			case CMP_GE:
+				return Builder->CreateICmpSGE(lhs_v, rhs_v, "cmp");
+			case CMP_GT:
+				return Builder->CreateICmpSGT(lhs_v, rhs_v, "cmp");
+			case CMP_LE:
+				return Builder->CreateICmpSLE(lhs_v, rhs_v, "cmp");
+			case CMP_LT:
+				return Builder->CreateICmpSLT(lhs_v, rhs_v, "cmp");
+			case CMP_NE:
+				return Builder->CreateICmpNE(lhs_v, rhs_v, "cmp");
+		}
 		return NULL;
+	}
+
+	lhs_v = convertValue(lhs_v, llvm::Type::getDoubleTy(Context));
+	rhs_v = convertValue(rhs_v, llvm::Type::getDoubleTy(Context));
+	switch(op){
+		case CMP_EQ:
+			return Builder->CreateFCmpOEQ(lhs_v, rhs_v, "cmp");
+		case CMP_GE:
+			return Builder->CreateFCmpOGE(lhs_v, rhs_v, "cmp");
+		case CMP_GT:
+			return Builder->CreateFCmpOGT(lhs_v, rhs_v, "cmp");
+		case CMP_LE:
+			return Builder->CreateFCmpOLE(lhs_v, rhs_v, "cmp");
+		case CMP_LT:
+			return Builder->CreateFCmpOLT(lhs_v, rhs_v, "cmp");
+		case CMP_NE:
+			return Builder->CreateFCmpONE(lhs_v, rhs_v, "cmp");
+	}
+	return NULL;
 }
 
 // forを表すllvmirを生成
-llvm::Value *CodeGen::generateForStatement(ForStatementAST *for_expr, llvm::BasicBlock *bcond, llvm::BasicBlock *bbody, FunctionStmtAST *func_stmt){
-	// 繰り返し変数の設定
-	if(!llvm::isa<BinaryExprAST>(for_expr->getBinExpr()) && for_expr->getBinExpr()->getOp() == "="){
-		fprintf(stderr, "for 繰り返し数 である必要があります。\n");
-		SAFE_DELETE(bcond);
-		SAFE_DELETE(bbody);
-		return NULL;
+// for.cond -> for.body -> for.inc -> for.cond と回し、条件を満たさなくなったらfor.endへ
+// 繰り返し回数はi64の誘導変数 (for.condのphi, 0から1ずつ増やす) で数える
+// 範囲の繰り返し変数は for.body の最初で 始め + 誘導変数 * 増分 にする
+bool CodeGen::generateForStatement(ForStatementAST *for_expr, FunctionStmtAST *func_stmt){
+	llvm::Type *i64_type = llvm::Type::getInt64Ty(Context);
+	llvm::Value *start_val = NULL;
+	llvm::Value *end_val = NULL;
+	bool invariant;
+
+	if(for_expr->getVal()){
+		// 範囲は始めと終わりを1回だけ計算し、繰り返し回数を先に求める
+		invariant = true;
+		if(!(start_val = generateLoopCount(for_expr->getStartExpr(), "範囲の始め", func_stmt)) ||
+				!(end_val = generateLoopCount(for_expr->getEndExpr(), "範囲の終わり", func_stmt)))
+			return false;
+		end_val = generateTripCount(start_val, end_val, for_expr->getStep(), for_expr->isExclusive());
 	}
-	generateBinaryExpression(for_expr->getBinExpr(), func_stmt);
-	
+	else{
+		// 繰り返し数が本体で変わらなければfor.condの前で1回だけ計算する
+		invariant = isLoopInvariant(for_expr->getEndExpr(), for_expr->getBody(), func_stmt);
+		if(invariant && !(end_val = generateLoopCount(for_expr->getEndExpr(), "for の繰り返し数", func_stmt)))
+			return false;
+	}
+
 	// to for.condへ
+	llvm::BasicBlock *bpreheader = Builder->GetInsertBlock();
+	llvm::BasicBlock *bcond = llvm::BasicBlock::Create(Context, "for.cond", CurFunc);
 	Builder->CreateBr(bcond);
 	Builder->SetInsertPoint(bcond);
 
-	// for cond
-	llvm::Value *roop_variable = generateVariable(for_expr->getVal(), func_stmt);
-	llvm::Value *end_val;
-       	if(llvm::isa<BinaryExprAST>(for_expr->getEndExpr()))
-		end_val = generateBinaryExpression(llvm::dyn_cast<BinaryExprAST>(for_expr->getEndExpr()), func_stmt);	
-	else if(llvm::isa<VariableAST>(for_expr->getEndExpr()))
-		end_val = generateVariable(llvm::dyn_cast<VariableAST>(for_expr->getEndExpr()), func_stmt);
-	else if(llvm::isa<NumberAST>(for_expr->getEndExpr()))
-		end_val = generateNumber(llvm::dyn_cast<NumberAST>(for_expr->getEndExpr())->getNumberValue());
+	// for cond (誘導変数 < 繰り返し数)
+	llvm::PHINode *iv = Builder->CreatePHI(i64_type, 2, "for.iv");
+	iv->addIncoming(llvm::ConstantInt::get(i64_type, 0), bpreheader);
+	if(!invariant && !(end_val = generateLoopCount(for_expr->getEndExpr(), "for の繰り返し数", func_stmt)))
+		return false;
+	llvm::Value *icmp = Builder->CreateICmpSLT(iv, end_val, "cmp");
+
+	// for.inc, for.end はbodyの後に置く
+	llvm::BasicBlock *bbody = llvm::BasicBlock::Create(Context, "for.body", CurFunc);
+	llvm::BasicBlock *binc = llvm::BasicBlock::Create(Context, "for.inc");
+	llvm::BasicBlock *bend = llvm::BasicBlock::Create(Context, "for.end");
+	Builder->CreateCondBr(icmp, bbody, bend);
+
+	// for.body (continueはfor.incへ, breakはfor.endへ)
+	sealBlock(bbody);
+	Builder->SetInsertPoint(bbody);
+	if(for_expr->getVal()){
+		// 繰り返し変数は範囲の中なのでオーバーフローしない (nsw)
+		llvm::Value *offset = Builder->CreateMul(iv, 
+				llvm::ConstantInt::get(i64_type, for_expr->getStep(), true), "mul_tmp", false, true);
+		llvm::Value *value = Builder->CreateAdd(start_val, offset, "add_tmp", false, true);
+		assignVariable(for_expr->getVal()->getSymbol(), value, func_stmt);
+	}
+	LoopTargets[for_expr] = std::make_pair(binc, bend);
+	if(!generateBlock(for_expr->getBody(), func_stmt))
+		return false;
+	LoopTargets.erase(for_expr);
+	if(!Builder->GetInsertBlock()->getTerminator())
+		Builder->CreateBr(binc);
+
+	// for.incの生成 (bodyの終わりとcontinueから来る)
+	// 誘導変数は繰り返し数より小さいのでオーバーフローしない (nsw)
+	CurFunc->getBasicBlockList().push_back(binc);
+	sealBlock(binc);
+	Builder->SetInsertPoint(binc);
+	llvm::Value *iv_next = Builder->CreateAdd(iv, llvm::ConstantInt::get(i64_type, 1), "for.iv.next", false, true);
+	Builder->CreateBr(bcond);
+	iv->addIncoming(iv_next, binc);
+	// for.condは前とfor.incから来る
+	sealBlock(bcond);
+
+	// for.endにpointを設定 (for.condとbreakから来る)
+	CurFunc->getBasicBlockList().push_back(bend);
+	sealBlock(bend);
+	Builder->SetInsertPoint(bend);
+	return true;
+}
+
+/**
+ * forの繰り返し数, 範囲の始めと終わりの生成メソッド
+ * i64にする (小数は0の方へ切り捨てる)
+ * 繰り返し数は1からの回数と比べるので、切り捨てても繰り返す回数は同じ (1未満は繰り返さない)
+ * @param 式 エラーメッセージでの式の呼び方 FunctionStmtAST
+ * @return 生成したValueのポインタ
+ */
+llvm::Value *CodeGen::generateLoopCount(BaseAST *end_expr, const char *what, FunctionStmtAST *func_stmt){
+	llvm::Value *end_val = NULL;
+	if(llvm::isa<BinaryExprAST>(end_expr))
+		end_val = generateBinaryExpression(llvm::dyn_cast<BinaryExprAST>(end_expr), func_stmt);
+	else if(llvm::isa<CallExprAST>(end_expr))
+		end_val = generateCallExpression(llvm::dyn_cast<CallExprAST>(end_expr), func_stmt);
+	else if(llvm::isa<VariableAST>(end_expr))
+		end_val = generateVariable(llvm::dyn_cast<VariableAST>(end_expr), func_stmt);
+	else if(llvm::isa<NumberAST>(end_expr))
+		end_val = generateConstant(llvm::dyn_cast<NumberAST>(end_expr)->getNumberValue());
 	if(!end_val){
-		fprintf(stderr, "for 繰り返し数  である必要があります\n");
+		fprintf(stderr, "%s は数値である必要があります\n", what);
 		return NULL;
 	}
-	llvm::Value *fcmp = Builder->CreateFCmpOLE(roop_variable, end_val, "cmp");
-	
-	// for.bodyにbr for.incに設定
-	Builder->SetInsertPoint(bbody);
-	return fcmp;
+	return convertValue(end_val, llvm::Type::getInt64Ty(Context));
 }
 
-// forEndを表すllvmirを生成
-llvm::BasicBlock *CodeGen::generateForEndStatement(llvm::BasicBlock *bcond, llvm::BasicBlock *bbody, llvm::BasicBlock *binc, llvm::BasicBlock *bend, llvm::Value *fcmp, ForStatementAST *for_expr, FunctionStmtAST *func_stmt){
-	// for.bodyからfor.incへ
-	Builder->CreateBr(binc);
-	Builder->SetInsertPoint(binc);
+/**
+ * 範囲の繰り返し回数生成メソッド
+ * 増やす場合は (終わり - 始め) / 増分 + 1, 減らす場合は (始め - 終わり) / -増分 + 1
+ * ..< は終わりの1つ手前までとし、範囲が空なら0にする
+ * @param 始め 終わり 増分 終わりを含まないか
+ * @return 生成したValueのポインタ
+ */
+llvm::Value *CodeGen::generateTripCount(llvm::Value *start_val, llvm::Value *end_val, int64_t step, bool exclusive){
+	llvm::Type *i64_type = llvm::Type::getInt64Ty(Context);
+	llvm::Value *low = step > 0 ? start_val : end_val;
+	llvm::Value *high = step > 0 ? end_val : start_val;
+	llvm::Value *not_empty = exclusive ? 
+		Builder->CreateICmpSLT(low, high, "cmp") : Builder->CreateICmpSLE(low, high, "cmp");
+
+	// 空でなければ high - low は負にならないので符号なしで割る
+	llvm::Value *diff = Builder->CreateSub(high, low, "sub_tmp");
+	if(exclusive)
+		diff = Builder->CreateSub(diff, llvm::ConstantInt::get(i64_type, 1), "sub_tmp");
+	int64_t abs_step = step > 0 ? step : -step;
+	llvm::Value *count = Builder->CreateUDiv(diff, llvm::ConstantInt::get(i64_type, abs_step), "div_tmp");
+	count = Builder->CreateAdd(count, llvm::ConstantInt::get(i64_type, 1), "add_tmp");
+	return Builder->CreateSelect(not_empty, count, llvm::ConstantInt::get(i64_type, 0), "trip_count");
+}
 
-	// for.incの生成
-	llvm::Value *roop_var = generateVariable(for_expr->getVal(), func_stmt);
-	llvm::Value *temp_var = Builder->CreateFAdd(roop_var, generateNumber(1.0), "add_tmp");
-	if(CurFunc->getName().str() == "main" || func_stmt->isGlobalVariable(for_expr->getVal()->getName())){
-		roop_var = Mod->getNamedGlobal(for_expr->getVal()->getName());
-	}else{
-		llvm::ValueSymbolTable &vs_table = CurFunc->getValueSymbolTable();
-		roop_var = vs_table.lookup(for_expr->getVal()->getName());
+/**
+ * forの繰り返し数が繰り返しの間変わらないか判定する
+ * 関数呼び出しを含まず、読む変数が本体で代入されず、
+ * 本体で関数を呼ぶ場合は他の関数から書き換えられる変数も読まなければ変わらない
+ * @param 繰り返し数の式 繰り返す文 FunctionStmtAST
+ * @return 変わらない:true 変わるかもしれない:false
+ */
+bool CodeGen::isLoopInvariant(BaseAST *end_expr, BlockAST *body, FunctionStmtAST *func_stmt){
+	std::set<SymbolID> reads, writes, body_reads;
+	bool has_call = false;
+	collectVariables(end_expr, reads, writes, has_call);
+	if(has_call || !writes.empty())
+		return false;
+	collectVariables(body, body_reads, writes, has_call);
+	for(std::set<SymbolID>::iterator it = reads.begin(); it != reads.end(); ++it){
+		if(writes.count(*it))
+			return false;
+		bool shared = !isLocalVariable(*it, func_stmt) ||
+			std::find(PromotedGlobals.begin(), PromotedGlobals.end(), *it) != PromotedGlobals.end();
+		if(has_call && shared)
+			return false;
 	}
-	Builder->CreateStore(temp_var, roop_var);
-	
-	Builder->CreateBr(bcond);
-
-	// for.condの最後にbrを生成
-	Builder->SetInsertPoint(bcond);
-	Builder->CreateCondBr(fcmp, bbody, bend);
-
-	// for.endにpointを設定
-	Builder->SetInsertPoint(bend);
+	return true;
+}
 
-	return bend;
+/**
+ * 文や式で読み書きする変数を集める
+ * @param AST 読む変数の格納先 代入する変数の格納先 print, input以外の関数を呼ぶか
+ */
+void CodeGen::collectVariables(BaseAST *ast, std::set<SymbolID> &reads, std::set<SymbolID> &writes, bool &has_call){
+	if(!ast)
+		return;
+	if(llvm::isa<VariableAST>(ast)){
+		reads.insert(llvm::dyn_cast<VariableAST>(ast)->getSymbol());
+	}
+	else if(llvm::isa<BinaryExprAST>(ast)){
+		BinaryExprAST *bin_expr = llvm::dyn_cast<BinaryExprAST>(ast);
+		if(bin_expr->getOp() == BOP_ASSIGN && llvm::isa<VariableAST>(bin_expr->getLHS()))
+			writes.insert(llvm::dyn_cast<VariableAST>(bin_expr->getLHS())->getSymbol());
+		else
+			collectVariables(bin_expr->getLHS(), reads, writes, has_call);
+		collectVariables(bin_expr->getRHS(), reads, writes, has_call);
+	}
+	else if(llvm::isa<CallExprAST>(ast)){
+		CallExprAST *call_expr = llvm::dyn_cast<CallExprAST>(ast);
+		bool is_input = call_expr->getCallee() == "input";
+		if(!is_input && call_expr->getCallee() != "print")
+			has_call = true;
+		for(int i = 0; call_expr->getArgs(i); i++){
+			BaseAST *arg = call_expr->getArgs(i);
+			if(is_input && llvm::isa<VariableAST>(arg))
+				writes.insert(llvm::dyn_cast<VariableAST>(arg)->getSymbol());
+			else
+				collectVariables(arg, reads, writes, has_call);
+		}
+	}
+	else if(llvm::isa<ReturnStmtAST>(ast)){
+		collectVariables(llvm::dyn_cast<ReturnStmtAST>(ast)->getExpr(), reads, writes, has_call);
+	}
+	else if(llvm::isa<BlockAST>(ast)){
+		BlockAST *block = llvm::dyn_cast<BlockAST>(ast);
+		for(int i = 0; block->getStatement(i); i++)
+			collectVariables(block->getStatement(i), reads, writes, has_call);
+	}
+	else if(llvm::isa<IfStatementAST>(ast)){
+		for(IfStatementAST *clause = llvm::dyn_cast<IfStatementAST>(ast); clause; clause = clause->getElse()){
+			for(int i = 0; i < clause->getComparisonNumber(); i++){
+				collectVariables(clause->getComparison(i)->getLHS(), reads, writes, has_call);
+				collectVariables(clause->getComparison(i)->getRHS(), reads, writes, has_call);
+			}
+			collectVariables(clause->getThen(), reads, writes, has_call);
+		}
+	}
+	else if(llvm::isa<ForStatementAST>(ast)){
+		ForStatementAST *for_expr = llvm::dyn_cast<ForStatementAST>(ast);
+		if(for_expr->getVal())
+			writes.insert(for_expr->getVal()->getSymbol());
+		collectVariables(for_expr->getStartExpr(), reads, writes, has_call);
+		collectVariables(for_expr->getEndExpr(), reads, writes, has_call);
+		collectVariables(for_expr->getBody(), reads, writes, has_call);
+	}
 }
 
 /**
  * 割り算の分母確認
+ * 分母は計算済みの値を使う (式をもう一度生成すると関数呼び出しが2回実行される)
+ * @param 演算の名前 分母の値(i64かdouble) 行
+ * @return 成功時:true
  */
-bool CodeGen::generateDenominatorCheck(std::string op, BaseAST *rhs, int line, FunctionStmtAST *func_stmt){
-	llvm::Value *fcmp = generateComparison(rhs, new NumberAST(0), "==", func_stmt);
-	llvm::BasicBlock *zero = llvm::BasicBlock::Create(llvm::getGlobalContext(), "denominator_zero", CurFunc);
-	llvm::BasicBlock *not_zero = llvm::BasicBlock::Create(llvm::getGlobalContext(), "not_denominator_zero", CurFunc);
-	Builder->CreateCondBr(fcmp, zero, not_zero);
+bool CodeGen::generateDenominatorCheck(std::string op, llvm::Value *rhs_v, int line){
+	llvm::Value *cmp;
+	if(rhs_v->getType()->isIntegerTy())
+		cmp = Builder->CreateICmpEQ(rhs_v, llvm::ConstantInt::get(rhs_v->getType(), 0), "cmp");
+	else
+		cmp = Builder->CreateFCmpOEQ(rhs_v, llvm::ConstantFP::get(rhs_v->getType(), 0.0), "cmp");
+	llvm::BasicBlock *zero = llvm::BasicBlock::Create(Context, "denominator_zero", CurFunc);
+	llvm::BasicBlock *not_zero = llvm::BasicBlock::Create(Context, "not_denominator_zero", CurFunc);
+	Builder->CreateCondBr(cmp, zero, not_zero);
+	sealBlock(zero);
+	sealBlock(not_zero);
 	Builder->SetInsertPoint(zero);
 	std::vector<llvm::Value*> arg_vec;
 	std::string error_denominator_zero = std::to_string(line) + "行目 : " + op + "の分母が 0 です.\n";
 	arg_vec.push_back(generateString(error_denominator_zero));
 	Builder->CreateCall(Mod->getFunction("printf"), arg_vec, "call_temp");
-	Builder->CreateRet(llvm::ConstantInt::get(llvm::Type::getInt32Ty(llvm::getGlobalContext()), 0));
+	// mainはi32, それ以外の関数はdoubleを返す
+	Builder->CreateRet(llvm::Constant::getNullValue(CurFunc->getReturnType()));
 	Builder->SetInsertPoint(not_zero);
 	return true;
 }
@@ -7,32 +7,85 @@
 #include "llvm/Support/FormattedStream.h"
 #include "llvm/Support/PrettyStackTrace.h"
 #include "llvm/Support/Signals.h"
+#include "llvm/Support/Threading.h"
 #include "llvm/Support/TargetSelect.h"
+#include "llvm/Transforms/IPO.h"
+#include "llvm/Transforms/IPO/PassManagerBuilder.h"
+#include "llvm/Transforms/Scalar.h"
 #include "lexer.hpp"
 #include "AST.hpp"
 #include "APP.hpp"
 #include "parser.hpp"
 #include "codegen.hpp"
+#include "emitter.hpp"
+#include "jit.hpp"
+#include "cache.hpp"
+#include "profiler.hpp"
+#include "lto.hpp"
+#include "pgo.hpp"
+#include "repl.hpp"
+#include "server.hpp"
+#include <atomic>
+#include <thread>
+
+/**
+ * PGOの種別
+ */
+enum ProfileMode{
+	PROFILE_NONE,     // なし
+	PROFILE_GENERATE, // カウンタを埋め込む (-fprofile-generate)
+	PROFILE_USE       // プロファイルを使う (-fprofile-use)
+};
 
 /**
  * オプション切り出しクラス
  */
 class OptionParser{
 	private:
-		std::string InputFileName;
+		std::vector<std::string> InputFileNames;
 		std::string OutputFileName;
 		std::string LinkFileName;
+		std::string CPUName;
+		std::string CacheDir;
+		std::string TraceFileName;
+		std::string ProfileFileName;
+		int CacheSize;
+		int Jobs;
 		bool WithJit;
+		bool TimeReport;
+		bool LTO;
+		bool AllocaVars;
+		bool Interactive;
+		ProfileMode Profile;
+		int OptLevel;
+		int JitHotThreshold;
+		OutputType Output;
 		int Argc;
 		char **Argv;
 	
 	public:
-		OptionParser(int argc, char **argv) : Argc(argc), Argv(argv),WithJit(false){}
+		OptionParser(int argc, char **argv) : Argc(argc), Argv(argv),CacheSize(256),Jobs(0),WithJit(false),TimeReport(false),LTO(false),AllocaVars(false),Interactive(false),Profile(PROFILE_NONE),OptLevel(0),JitHotThreshold(0),Output(OUT_EXECUTABLE){}
 		void printHelp();
-		std::string getInputFileName(){return InputFileName;} // 入力ファイル名出力
-		std::string getOutputFileName(){return OutputFileName;} // 出力ファイル名取得
+		int getInputFileNum(){return InputFileNames.size();} // 入力ファイル数取得
+		std::string getInputFileName(int i){return InputFileNames.at(i);} // i番目の入力ファイル名取得
+		std::string getOutputFileName(int i); // i番目の入力ファイルの出力ファイル名取得
+		int getJobs(){return Jobs;} // 並列にコンパイルするファイル数取得
 		std::string getLinkFileName(){return LinkFileName;} // リンク用ファイル名取得
 		bool getWithJit(){return WithJit;} // JIT実行有無
+		int getJitHotThreshold(){return JitHotThreshold;} // JITで再最適化する呼び出し回数
+		int getOptLevel(){return OptLevel;} // 最適化レベル取得
+		OutputType getOutputType(){return Output;} // 出力種別取得
+		std::string getCPUName(){return CPUName;} // ターゲットCPU名取得(空ならホスト)
+		std::string getCacheDir(){return CacheDir;} // キャッシュディレクトリ取得(空なら無効)
+		int getCacheSize(){return CacheSize;} // キャッシュの最大容量取得(MB)
+		std::string getCacheFlags(int i); // i番目の入力ファイルのキャッシュのキーに含めるオプション
+		bool getTimeReport(){return TimeReport;} // 時間レポートの表示有無
+		std::string getTraceFileName(){return TraceFileName;} // traceの出力ファイル名取得(空なら出力しない)
+		bool getLTO(){return LTO;} // リンク時最適化の有無
+		bool getAllocaVars(){return AllocaVars;} // 変数をallocaに置くか
+		bool getInteractive(){return Interactive;} // 対話実行の有無
+		ProfileMode getProfileMode(){return Profile;} // PGOの種別取得
+		std::string getProfileFileName(int i); // i番目の入力ファイルのプロファイル名取得
 		bool parseOption();
 };
 
@@ -41,6 +94,31 @@ class OptionParser{
  */
 void OptionParser::printHelp(){
 	fprintf(stdout, "Compiler for DummyC...\n");
+	fprintf(stdout, "usage: dcc [options] file.gd [file.gd ...]\n");
+	fprintf(stdout, "       dcc -i\n");
+	fprintf(stdout, "       dcc --serve[=<socket>]\n");
+	fprintf(stdout, "       dcc --client[=<socket>] [options] file.gd [file.gd ...]\n");
+	fprintf(stdout, "  -i         対話実行 (入力した文・関数定義をその場でJIT実行)\n");
+	fprintf(stdout, "  -o <file>  出力ファイル名 (入力ファイルが1つの場合のみ)\n");
+	fprintf(stdout, "  -j <n>     n個のファイルを並列にコンパイル (1ファイルなら関数をn並列に構文解析, デフォルト: CPU数)\n");
+	fprintf(stdout, "  -l <file>  リンクするファイル\n");
+	fprintf(stdout, "  -jit       JITで実行 (関数は最初の呼び出し時にコンパイル)\n");
+	fprintf(stdout, "  -jit-hot=<n> JITでn回呼ばれた関数を最適化して再コンパイル\n");
+	fprintf(stdout, "  -O<n>      最適化レベル (0-3, デフォルト: 0)\n");
+	fprintf(stdout, "  -c         オブジェクトファイルを出力\n");
+	fprintf(stdout, "  -S         アセンブリを出力\n");
+	fprintf(stdout, "  -emit-llvm LLVM-IRを出力\n");
+	fprintf(stdout, "  -emit-bc   bitcodeを出力 (-l で使うと必要な関数だけ読み込む)\n");
+	fprintf(stdout, "  -mcpu=<cpu> ターゲットCPU (デフォルト: ホストのCPU)\n");
+	fprintf(stdout, "  -lto       -l のModuleを含めてリンク時最適化 (main以外を内部リンケージにする)\n");
+	fprintf(stdout, "  -alloca-vars 関数の変数をSSAの値でなくallocaに置く (SSA構築との比較用)\n");
+	fprintf(stdout, "  -fprofile-generate[=<file>] 実行回数を計測する実行ファイルを生成 (デフォルト: <入力>.prof)\n");
+	fprintf(stdout, "  -fprofile-use[=<file>] 計測したプロファイルで分岐の重みを付けて最適化\n");
+	fprintf(stdout, "  -cache     コンパイル結果をキャッシュ ($DCC_CACHE_DIR か ~/.cache/dcc)\n");
+	fprintf(stdout, "  -cache-dir=<dir> キャッシュディレクトリを指定してキャッシュ\n");
+	fprintf(stdout, "  -cache-size=<MB> キャッシュの最大容量 (デフォルト: 256)\n");
+	fprintf(stdout, "  -time-report フェーズ・関数・LLVMパスごとの時間と最大メモリを表示\n");
+	fprintf(stdout, "  -trace <file> Chrome trace形式(chrome://tracing)で時間を出力\n");
 }
 
 
@@ -64,6 +142,10 @@ bool OptionParser::parseOption(){
 			printHelp();
 			return false;
                 }
+		// -i 対話実行
+		else if(Argv[i][0] == '-' && Argv[i][1] == 'i' && Argv[i][2] == '\0'){
+			Interactive = true;
+		}
 		// -l リンクファイル名として取得
 		else if(Argv[i][0] == '-' && Argv[i][1] == 'l' && Argv[i][2] == '\0'){
 			LinkFileName.assign(Argv[++i]);
@@ -73,6 +155,101 @@ bool OptionParser::parseOption(){
 			       	Argv[i][2] == 'i' && Argv[i][3] == 't' && Argv[i][4] == '\0'){
 			WithJit = true;
 		}
+		// -j <n> 並列にコンパイルするファイル数を取得
+		else if(Argv[i][0] == '-' && Argv[i][1] == 'j' &&
+				(Argv[i][2] == '\0' || isdigit(Argv[i][2]))){
+			if(Argv[i][2] == '\0' && i+1 < Argc)
+				Jobs = atoi(Argv[++i]);
+			else
+				Jobs = atoi(Argv[i] + 2);
+			if(Jobs <= 0){
+				fprintf(stderr, "-j の後は1以上の数字です\n");
+				return false;
+			}
+		}
+		// -jit-hot=<n> JITの再最適化を有効にする
+		else if(std::string(Argv[i]).compare(0, 9, "-jit-hot=") == 0){
+			WithJit = true;
+			JitHotThreshold = atoi(Argv[i] + 9);
+			if(JitHotThreshold <= 0){
+				fprintf(stderr, "-jit-hot= の後は1以上の数字です\n");
+				return false;
+			}
+		}
+		// -O<n> 最適化レベルを取得
+		else if(Argv[i][0] == '-' && Argv[i][1] == 'O' &&
+				Argv[i][2] >= '0' && Argv[i][2] <= '3' && Argv[i][3] == '\0'){
+			OptLevel = Argv[i][2] - '0';
+		}
+		// -c オブジェクトファイルを出力
+		else if(Argv[i][0] == '-' && Argv[i][1] == 'c' && Argv[i][2] == '\0'){
+			Output = OUT_OBJECT;
+		}
+		// -S アセンブリを出力
+		else if(Argv[i][0] == '-' && Argv[i][1] == 'S' && Argv[i][2] == '\0'){
+			Output = OUT_ASSEMBLY;
+		}
+		// -emit-llvm LLVM-IRを出力
+		else if(std::string(Argv[i]) == "-emit-llvm"){
+			Output = OUT_LLVM_IR;
+		}
+		// -emit-bc bitcodeを出力
+		else if(std::string(Argv[i]) == "-emit-bc"){
+			Output = OUT_BITCODE;
+		}
+		// -mcpu=<cpu> ターゲットCPUを取得
+		else if(std::string(Argv[i]).compare(0, 6, "-mcpu=") == 0){
+			CPUName.assign(Argv[i] + 6);
+		}
+		// -lto リンク時最適化を有効にする
+		else if(std::string(Argv[i]) == "-lto"){
+			LTO = true;
+		}
+		// -alloca-vars 関数の変数をallocaに置く
+		else if(std::string(Argv[i]) == "-alloca-vars"){
+			AllocaVars = true;
+		}
+		// -fprofile-generate[=<file>] プロファイル計測用のカウンタを埋め込む
+		else if(std::string(Argv[i]).compare(0, 18, "-fprofile-generate") == 0 &&
+				(Argv[i][18] == '\0' || Argv[i][18] == '=')){
+			Profile = PROFILE_GENERATE;
+			ProfileFileName.assign(Argv[i][18] == '=' ? Argv[i] + 19 : "");
+		}
+		// -fprofile-use[=<file>] プロファイルを使う
+		else if(std::string(Argv[i]).compare(0, 13, "-fprofile-use") == 0 &&
+				(Argv[i][13] == '\0' || Argv[i][13] == '=')){
+			Profile = PROFILE_USE;
+			ProfileFileName.assign(Argv[i][13] == '=' ? Argv[i] + 14 : "");
+		}
+		// -cache キャッシュを有効にする
+		else if(std::string(Argv[i]) == "-cache"){
+			if(CacheDir.empty())
+				CacheDir = CompileCache::getDefaultDir();
+		}
+		// -cache-dir=<dir> キャッシュディレクトリを取得
+		else if(std::string(Argv[i]).compare(0, 11, "-cache-dir=") == 0){
+			CacheDir.assign(Argv[i] + 11);
+		}
+		// -cache-size=<MB> キャッシュの最大容量を取得
+		else if(std::string(Argv[i]).compare(0, 12, "-cache-size=") == 0){
+			CacheSize = atoi(Argv[i] + 12);
+			if(CacheSize <= 0){
+				fprintf(stderr, "-cache-size= の後は1以上の数字です\n");
+				return false;
+			}
+		}
+		// -time-report 時間レポートを表示する
+		else if(std::string(Argv[i]) == "-time-report"){
+			TimeReport = true;
+		}
+		// -trace <file> traceの出力ファイル名を取得
+		else if(std::string(Argv[i]) == "-trace"){
+			if(i+1 >= Argc){
+				fprintf(stderr, "-trace の後に出力ファイル名が必要です\n");
+				return false;
+			}
+			TraceFileName.assign(Argv[++i]);
+		}
 		// -? 不明なオプション
 		else if(Argv[i][0] == '-'){
 			fprintf(stderr, "%s は不明なオプションです\n", Argv[i]);
@@ -80,84 +257,522 @@ bool OptionParser::parseOption(){
 		}
 		// 入力ファイル名取得
 		else {
-			InputFileName.assign(Argv[i]);
+			InputFileNames.push_back(Argv[i]);
 	        }
 	}
 
-	std::string ifn = InputFileName;
-	int len = ifn.length();
-	if(OutputFileName.empty() && len > 2 && 
-			ifn[len-3] == '.' && ifn[len-2] == 'g' && ifn[len-1] == 'd'){
-		OutputFileName = std::string(ifn.begin(), ifn.end()-3);
-		OutputFileName += ".s";
+	if(InputFileNames.size() > 1 && !OutputFileName.empty()){
+		fprintf(stderr, "入力ファイルが複数の場合 -o は指定できません\n");
+		return false;
+	}
+	if(InputFileNames.size() > 1 && WithJit){
+		fprintf(stderr, "入力ファイルが複数の場合 -jit は指定できません\n");
+		return false;
+	}
+	if(Interactive && (!InputFileNames.empty() || !LinkFileName.empty())){
+		fprintf(stderr, "-i は入力ファイル, -l と同時に指定できません\n");
+		return false;
+	}
+	if(Profile == PROFILE_GENERATE && WithJit){
+		fprintf(stderr, "-fprofile-generate と -jit は同時に指定できません\n");
+		return false;
+	}
+	if(InputFileNames.size() > 1 && !ProfileFileName.empty()){
+		fprintf(stderr, "入力ファイルが複数の場合プロファイル名は指定できません\n");
+		return false;
+	}
+	if(LTO && WithJit){
+		fprintf(stderr, "-lto と -jit は同時に指定できません\n");
+		return false;
 	}
-	else if(OutputFileName.empty()){
-		OutputFileName = ifn;
-		OutputFileName += ".s";
+	if(Jobs == 0){
+		Jobs = std::thread::hardware_concurrency();
+		if(Jobs <= 0)
+			Jobs = 1;
 	}
 	return true;
 }
 
 /**
- * main関数
+ * 出力ファイル名の取得
+ * -oの指定がなければ入力ファイル名の .gd を出力種別に合わせた拡張子に変える
+ * @param 入力ファイル番号
+ * @return 出力ファイル名
  */
-int main(int argc, char **argv){
-	llvm::InitializeNativeTarget();
-	llvm::sys::PrintStackTraceOnErrorSignal();
-	llvm::PrettyStackTraceProgram X(argc,argv);
-	llvm::EnableDebugBuffering = true;
+std::string OptionParser::getOutputFileName(int i){
+	if(!OutputFileName.empty())
+		return OutputFileName;
 
-	OptionParser opt(argc, argv);
-	if(!opt.parseOption()){
-		exit(1);
+	// 出力種別に合わせた拡張子
+	std::string ext;
+	if(Output == OUT_OBJECT)
+		ext = ".o";
+	else if(Output == OUT_ASSEMBLY)
+		ext = ".s";
+	else if(Output == OUT_LLVM_IR)
+		ext = ".ll";
+	else if(Output == OUT_BITCODE)
+		ext = ".bc";
+
+	std::string ifn = InputFileNames.at(i);
+	int len = ifn.length();
+	if(len > 2 && ifn[len-3] == '.' && ifn[len-2] == 'g' && ifn[len-1] == 'd')
+		return std::string(ifn.begin(), ifn.end()-3) + ext;
+	else
+		return ifn + (Output == OUT_EXECUTABLE ? ".out" : ext);
+}
+
+/**
+ * プロファイル名の取得
+ * 指定がなければ入力ファイル名の .gd を .prof に変える
+ * @param 入力ファイル番号
+ * @return プロファイル名
+ */
+std::string OptionParser::getProfileFileName(int i){
+	if(!ProfileFileName.empty())
+		return ProfileFileName;
+	std::string ifn = InputFileNames.at(i);
+	int len = ifn.length();
+	if(len > 2 && ifn[len-3] == '.' && ifn[len-2] == 'g' && ifn[len-1] == 'd')
+		return std::string(ifn.begin(), ifn.end()-3) + ".prof";
+	else
+		return ifn + ".prof";
+}
+
+/**
+ * 最適化パスの登録
+ * 関数単位の最適化はここで実行し、Module単位の最適化はpmに登録する
+ * @param Module PassManager 最適化レベル(0-3)
+ */
+void addOptimizationPasses(llvm::Module &mod, llvm::PassManager &pm, int opt_level){
+	llvm::PassManagerBuilder builder;
+	builder.OptLevel = opt_level;
+	builder.SizeLevel = 0;
+
+	// インライン展開 (-O0, -O1ではalways_inlineのみ)
+	if(opt_level > 1)
+		builder.Inliner = llvm::createFunctionInliningPass(opt_level > 2 ? 275 : 225);
+	else
+		builder.Inliner = llvm::createAlwaysInlinerPass();
+
+	// ループ展開とベクトル化
+	builder.DisableUnrollLoops = (opt_level == 0);
+	builder.LoopVectorize = (opt_level > 2);
+
+	// 関数単位の最適化 (mem2reg, instcombine, ...)
+	ProfileScope prof("phase", "関数単位の最適化", mod.getModuleIdentifier());
+	TracingFunctionPassManager fpm(&mod);
+	if(opt_level > 0)
+		fpm.add(llvm::createPromoteMemoryToRegisterPass());
+	builder.populateFunctionPassManager(fpm);
+	fpm.doInitialization();
+	for(llvm::Module::iterator func = mod.begin(); func != mod.end(); func++)
+		fpm.run(*func);
+	fpm.doFinalization();
+
+	// Module単位の最適化 (inline, GVN, LICM, loop unroll, ...)
+	builder.populateModulePassManager(pm);
+}
+
+/**
+ * キャッシュのキーに含めるオプション
+ * 出力種別は含めない (同じbitcode, オブジェクトファイルを使い回す)
+ * @param 入力ファイル番号
+ * @return オプション文字列
+ */
+std::string OptionParser::getCacheFlags(int i){
+	std::string flags = "-O" + std::to_string(OptLevel);
+	// -mcpu がなければホストのCPUと拡張命令に合わせるので、解決した値を含める
+	flags += " -target=" + Emitter::getTargetDescription(CPUName);
+	if(WithJit)
+		flags += " -jit";
+	if(LTO)
+		flags += " -lto";
+	if(AllocaVars)
+		flags += " -alloca-vars";
+	// プロファイルを使う場合はプロファイルの更新時刻とサイズも含める
+	if(Profile == PROFILE_GENERATE){
+		flags += " -fprofile-generate=" + getProfileFileName(i);
+	}else if(Profile == PROFILE_USE){
+		struct stat st;
+		std::string file_name = getProfileFileName(i);
+		flags += " -fprofile-use=" + file_name;
+		if(stat(file_name.c_str(), &st) == 0)
+			flags += ":" + std::to_string((long long)st.st_mtime) + ":" + std::to_string((long long)st.st_size);
 	}
+	return flags;
+}
+
+/**
+ * JIT実行
+ * @param Module オプション
+ * @return mainの戻り値
+ */
+int runJIT(llvm::Module &mod, OptionParser &opt){
+	ProfileScope prof("phase", "JIT実行", mod.getModuleIdentifier());
+	JITRunner *jit = new JITRunner(&mod);
+	int result = 1;
+	if(jit->initialize(opt.getOptLevel(), opt.getJitHotThreshold()))
+		result = jit->run();
+	SAFE_DELETE(jit);
+	return result;
+}
+
+/**
+ * Moduleを最適化してファイルに出力する
+ * cacheが指定されていたら最適化後のbitcodeとオブジェクトファイルを保存する
+ * @param Module オプション 出力ファイル名 キャッシュ(NULL可) キャッシュのキー 最適化の有無
+ * @return 成功時:true 失敗時:false
+ */
+bool emitModule(llvm::Module &mod, OptionParser &opt, std::string output_file,
+		CompileCache *cache, std::string key, bool optimize){
+	TracingPassManager pm;
 	
-	// check
-	if(opt.getInputFileName().length() == 0){
-		fprintf(stderr, "入力ファイル名が指定されていません\n");
-		exit(1);
+	// ターゲット情報の設定
+	Emitter emitter;
+	if(!emitter.initialize(opt.getOptLevel(), opt.getCPUName()) ||
+			!emitter.prepareModule(mod, pm))
+		return false;
+
+	// 最適化パスをPassManagerに登録
+	LTOOptimizer lto;
+	if(optimize){
+		addOptimizationPasses(mod, pm, opt.getOptLevel());
+		if(opt.getLTO())
+			lto.addPasses(pm, opt.getOptLevel());
+		if(cache)
+			cache->addBitcodeWriter(key, pm);
+	}
+
+	// コード生成パスは計測しない (最適化・コード出力 全体として計測する)
+	pm.setTracing(false);
+
+	// 出力
+	OutputType type = opt.getOutputType();
+	std::string obj_file;
+	if(cache && (type == OUT_OBJECT || type == OUT_EXECUTABLE))
+		obj_file = cache->createTempObjectPath(key);
+	if(!emitter.doEmit(mod, pm, output_file, type, obj_file))
+		return false;
+	if(optimize && opt.getLTO())
+		lto.printReport(output_file);
+
+	if(cache)
+		cache->commit(key);
+	return true;
+}
+
+/**
+ * キャッシュから出力する
+ * オブジェクトファイルがあればそのまま使い、bitcodeがあれば最適化を省略して出力する
+ * @param オプション 出力ファイル名 LLVMContext キャッシュ キャッシュのキー 終了コードの格納先
+ * @return キャッシュを使った場合:true キャッシュがない場合:false
+ */
+bool compileFromCache(OptionParser &opt, std::string output_file, llvm::LLVMContext &context,
+		CompileCache *cache, std::string key, int &result){
+	OutputType type = opt.getOutputType();
+	result = 0;
+
+	if(!opt.getWithJit() && (type == OUT_OBJECT || type == OUT_EXECUTABLE) && cache->hasObject(key)){
+		std::string obj_file = cache->getObjectPath(key);
+		cache->touch(obj_file);
+		if(type == OUT_OBJECT){
+			std::string error;
+			if(llvm::sys::CopyFile(llvm::sys::Path(output_file), llvm::sys::Path(obj_file), &error)){
+				fprintf(stderr, "%s が出力できません : %s\n", output_file.c_str(), error.c_str());
+				result = 1;
+			}
+		}else{
+			Emitter emitter;
+			if(!emitter.linkExecutable(obj_file, output_file))
+				result = 1;
+		}
+		return true;
+	}
+
+	if(!cache->hasBitcode(key))
+		return false;
+	llvm::Module *mod = cache->loadBitcode(key, context);
+	if(!mod)
+		return false;
+
+	if(opt.getWithJit())
+		result = runJIT(*mod, opt);
+	else if(!emitModule(*mod, opt, output_file, cache, key, false))
+		result = 1;
+	SAFE_DELETE(mod);
+	return true;
+}
+
+int compileFileInContext(OptionParser &opt, int index, std::string exe_file,
+		llvm::LLVMContext &context, llvm::Module *link_mod);
+
+/**
+ * 1ファイルのコンパイル
+ * ファイルごとにLLVMContext, Parser, CodeGenを生成するので並列に呼び出せる
+ * @param オプション 入力ファイル番号 dccの実行ファイル名(キャッシュのキー用)
+ * @return 終了コード
+ */
+int compileFile(OptionParser &opt, int index, std::string exe_file){
+	llvm::LLVMContext context;
+	return compileFileInContext(opt, index, exe_file, context, NULL);
+}
+
+/**
+ * 指定したLLVMContextで1ファイルのコンパイル
+ * link_modが指定されていたら -l のファイルを読み込まずにそのModuleを結合する
+ * @param オプション 入力ファイル番号 dccの実行ファイル名 LLVMContext 読み込み済みの -l のModule(NULL可)
+ * @return 終了コード
+ */
+int compileFileInContext(OptionParser &opt, int index, std::string exe_file,
+		llvm::LLVMContext &context, llvm::Module *link_mod){
+	std::string input_file = opt.getInputFileName(index);
+	std::string output_file = opt.getOutputFileName(index);
+
+	// キャッシュの確認
+	CompileCache *cache = NULL;
+	std::string cache_key;
+	if(!opt.getCacheDir().empty()){
+		cache = new CompileCache(opt.getCacheDir(), (uint64_t)opt.getCacheSize() * 1024 * 1024);
+		if(cache->initialize())
+			cache_key = cache->computeKey(input_file, opt.getLinkFileName(),
+					opt.getCacheFlags(index), exe_file);
+		if(cache_key.empty())
+			SAFE_DELETE(cache);
+	}
+	int result;
+	if(cache && compileFromCache(opt, output_file, context, cache, cache_key, result)){
+		SAFE_DELETE(cache);
+		return result;
 	}
-	// lex and parse
-	Parser *parser = new Parser(opt.getInputFileName());
+
+	// 識別子の表はファイルごとに作る (ParserとCodeGenより長く生きる)
+	SymbolTable symbols;
+	SymbolTable::Binding bind_symbols(symbols);
+
+	// lex and parse (1ファイルだけなら関数の本体を -j のスレッド数で並列に解析する)
+	Parser *parser = new Parser(input_file);
+	parser->setJobs(opt.getInputFileNum() == 1 ? opt.getJobs() : 1);
 	if(!parser->doParse() || !parser->CORRECT){
 		SAFE_DELETE(parser);
-		exit(1);
+		SAFE_DELETE(cache);
+		return 1;
 	}
 	// get AST
 	TranslationUnitAST &tunit = parser->getAST();
 	if(tunit.empty()){
 		SAFE_DELETE(parser);
-		exit(1);
+		SAFE_DELETE(cache);
+		return 1;
 	}
 	// get codegen
-	CodeGen *codegen = new CodeGen();
-	if(!codegen->doCodeGen(tunit, opt.getInputFileName(),
-			       	opt.getLinkFileName(), opt.getWithJit()) || !codegen->CORRECT){
+	CodeGen *codegen = new CodeGen(context);
+	codegen->setSharedLinkModule(link_mod);
+	codegen->setUseAllocas(opt.getAllocaVars());
+	if(!codegen->doCodeGen(tunit, input_file, opt.getLinkFileName()) || !codegen->CORRECT){
 		SAFE_DELETE(parser);
 		SAFE_DELETE(codegen);
-		exit(1);
+		SAFE_DELETE(cache);
+		return 1;
 	}
 	// get Module 
 	llvm::Module &mod = codegen->getModule();
 	if(mod.empty()){
 		SAFE_DELETE(parser);
 		SAFE_DELETE(codegen);
-		exit(1);
+		SAFE_DELETE(cache);
+		return 1;
 	}
-	llvm::PassManager pm;
-	
-	// mem2regをPassManagerに登録
-	//pm.add(llvm::createPromoteMemoryToRegisterPass());
-	
-	// 出力
-	std::string error;
-	llvm::raw_fd_ostream raw_stream(opt.getOutputFileName().c_str(), error);
-	pm.add(createPrintModulePass(&raw_stream));
-	pm.run(mod);
-	raw_stream.close();
+
+	// PGO (最適化の前)
+	if(opt.getProfileMode() != PROFILE_NONE){
+		PGO pgo(opt.getProfileFileName(index));
+		bool ok = (opt.getProfileMode() == PROFILE_GENERATE) ?
+			pgo.instrumentModule(mod) : pgo.applyProfile(mod);
+		if(!ok){
+			SAFE_DELETE(parser);
+			SAFE_DELETE(codegen);
+			SAFE_DELETE(cache);
+			return 1;
+		}
+	}
+
+	// JIT実行の場合はファイルを出力しない
+	if(opt.getWithJit()){
+		if(cache)
+			cache->storeBitcode(cache_key, mod);
+		result = runJIT(mod, opt);
+	}
+	else
+		result = emitModule(mod, opt, output_file, cache, cache_key, true) ? 0 : 1;
 	
 	// delete
 	SAFE_DELETE(parser);
 	SAFE_DELETE(codegen);
-	return 0;
+	SAFE_DELETE(cache);
+	return result;
+}
+
+/**
+ * 複数ファイルの並列コンパイル
+ * -jで指定した数のスレッドが、まだコンパイルしていないファイルを順に取っていく
+ * @param オプション dccの実行ファイル名
+ * @return 全て成功:0 失敗あり:1
+ */
+int compileFiles(OptionParser &opt, std::string exe_file){
+	int file_num = opt.getInputFileNum();
+	int jobs = std::min(opt.getJobs(), file_num);
+	std::vector<int> results(file_num, 0);
+	std::atomic<int> next(0);
+
+	llvm::llvm_start_multithreaded();
+	std::vector<std::thread> workers;
+	for(int i = 0; i < jobs; i++){
+		workers.emplace_back([&](){
+			int index;
+			while((index = next++) < file_num)
+				results.at(index) = compileFile(opt, index, exe_file);
+		});
+	}
+	for(int i = 0; i < workers.size(); i++)
+		workers.at(i).join();
+
+	int failed = 0;
+	for(int i = 0; i < file_num; i++){
+		if(results.at(i) != 0){
+			fprintf(stderr, "%s : コンパイルに失敗しました\n", opt.getInputFileName(i).c_str());
+			failed++;
+		}
+	}
+	if(failed > 0)
+		fprintf(stderr, "%d / %d ファイルのコンパイルに失敗しました\n", failed, file_num);
+	return failed > 0 ? 1 : 0;
+}
+
+/**
+ * コンパイルサーバの1リクエストの処理
+ * LLVMContextはリクエストごとに作り、-l のModuleはそのLLVMContextで1回だけ読み込んで
+ * 入力ファイルを順にコンパイルする
+ * @param 引数 サーバ
+ * @return 終了コード
+ */
+int handleServerRequest(std::vector<std::string> &args, CompileServer &server){
+	std::vector<char*> argv;
+	argv.push_back((char*)"dcc");
+	for(int i = 0; i < args.size(); i++)
+		argv.push_back(&args[i][0]);
+	argv.push_back(NULL);
+
+	OptionParser opt(argv.size() - 1, &argv[0]);
+	if(!opt.parseOption())
+		return 1;
+	if(opt.getInteractive()){
+		fprintf(stderr, "サーバでは -i は使えません\n");
+		return 1;
+	}
+	// ユーザのプログラムをサーバのプロセスで実行すると、無限ループや異常終了でサーバが止まるので使えない
+	if(opt.getWithJit()){
+		fprintf(stderr, "サーバでは -jit は使えません (dcc -jit で直接実行してください)\n");
+		return 1;
+	}
+	if(opt.getInputFileNum() == 0){
+		fprintf(stderr, "入力ファイル名が指定されていません\n");
+		return 1;
+	}
+
+	// -l のModuleを読み込んだLLVMContextでコンパイルする (-l のファイルを読み直さない)
+	llvm::LLVMContext &context = server.getContext();
+	llvm::Module *link_mod = NULL;
+	if(!opt.getLinkFileName().empty() && !(link_mod = server.getLinkModule(opt.getLinkFileName()))){
+		server.finishRequest();
+		return 1;
+	}
+
+	Profiler &profiler = Profiler::getInstance();
+	profiler.initialize(opt.getTimeReport(), opt.getTraceFileName());
+	int failed = 0;
+	{
+		ProfileScope prof("phase", "全体");
+		for(int i = 0; i < opt.getInputFileNum(); i++){
+			if(compileFileInContext(opt, i, server.getExeFile(), context, link_mod) != 0){
+				if(opt.getInputFileNum() > 1)
+					fprintf(stderr, "%s : コンパイルに失敗しました\n", opt.getInputFileName(i).c_str());
+				failed++;
+			}
+		}
+	}
+	server.finishRequest();
+	if(!profiler.finish())
+		return 1;
+	return failed > 0 ? 1 : 0;
+}
+
+/**
+ * main関数
+ */
+int main(int argc, char **argv){
+	// --client[=<socket>] LLVMを初期化せずにサーバに送る
+	if(argc >= 2 && std::string(argv[1]).compare(0, 8, "--client") == 0 &&
+			(argv[1][8] == '\0' || argv[1][8] == '=')){
+		std::string socket_path = (argv[1][8] == '=') ? argv[1] + 9 : CompileServer::getDefaultSocketPath();
+		return CompileServer::sendRequest(socket_path, argc - 2, argv + 2);
+	}
+
+	llvm::InitializeNativeTarget();
+	llvm::InitializeNativeTargetAsmPrinter();
+	llvm::sys::PrintStackTraceOnErrorSignal();
+	llvm::PrettyStackTraceProgram X(argc,argv);
+	llvm::EnableDebugBuffering = true;
+
+	// --serve[=<socket>] コンパイルサーバとして起動
+	if(argc >= 2 && std::string(argv[1]).compare(0, 7, "--serve") == 0 &&
+			(argv[1][7] == '\0' || argv[1][7] == '=')){
+		std::string socket_path = (argv[1][7] == '=') ? argv[1] + 8 : CompileServer::getDefaultSocketPath();
+		std::string exe_file = llvm::sys::Path::GetMainExecutable(argv[0],
+				(void*)(intptr_t)&addOptimizationPasses).str();
+		CompileServer *server = new CompileServer(socket_path, exe_file);
+		int result = server->initialize() ? server->run(&handleServerRequest) : 1;
+		SAFE_DELETE(server);
+		return result;
+	}
+
+	OptionParser opt(argc, argv);
+	if(!opt.parseOption()){
+		exit(1);
+	}
+	
+	// 対話実行
+	if(opt.getInteractive()){
+		Profiler::getInstance().initialize(opt.getTimeReport(), opt.getTraceFileName());
+		REPL *repl = new REPL(llvm::getGlobalContext());
+		int result = repl->initialize() ? repl->run() : 1;
+		SAFE_DELETE(repl);
+		if(!Profiler::getInstance().finish())
+			return 1;
+		return result;
+	}
+
+	// check
+	if(opt.getInputFileNum() == 0){
+		fprintf(stderr, "入力ファイル名が指定されていません\n");
+		exit(1);
+	}
+
+	Profiler &profiler = Profiler::getInstance();
+	profiler.initialize(opt.getTimeReport(), opt.getTraceFileName());
+
+	std::string exe_file = llvm::sys::Path::GetMainExecutable(argv[0],
+			(void*)(intptr_t)&addOptimizationPasses).str();
+	int result;
+	{
+		ProfileScope prof("phase", "全体");
+		if(opt.getInputFileNum() == 1)
+			result = compileFile(opt, 0, exe_file);
+		else
+			result = compileFiles(opt, exe_file);
+	}
+
+	if(!profiler.finish())
+		return 1;
+	return result;
 }
@@ -0,0 +1,216 @@
+#include "emitter.hpp"
+
+/**
+ * TargetMachineの生成
+ * cpuが空ならホストのCPUに合わせたコードを生成する
+ * @param 最適化レベル(0-3) CPU名
+ * @return 成功時:true 失敗時:false
+ */
+bool Emitter::initialize(int opt_level, std::string cpu){
+	std::string error;
+	OptLevel = opt_level;
+	Triple = llvm::sys::getDefaultTargetTriple();
+
+	const llvm::Target *target = llvm::TargetRegistry::lookupTarget(Triple, error);
+	if(!target){
+		fprintf(stderr, "ターゲット %s が見つかりません : %s\n", Triple.c_str(), error.c_str());
+		return false;
+	}
+
+	// ホストのCPUと拡張命令に合わせる
+	std::vector<std::string> host_features;
+	cpu = resolveCPU(cpu, host_features);
+	llvm::SubtargetFeatures features;
+	for(int i = 0; i < host_features.size(); i++)
+		features.AddFeature(host_features[i].substr(1), host_features[i][0] == '+');
+
+	llvm::CodeGenOpt::Level level;
+	if(opt_level == 0)
+		level = llvm::CodeGenOpt::None;
+	else if(opt_level == 1)
+		level = llvm::CodeGenOpt::Less;
+	else if(opt_level == 2)
+		level = llvm::CodeGenOpt::Default;
+	else
+		level = llvm::CodeGenOpt::Aggressive;
+
+	llvm::TargetOptions options;
+	TM = target->createTargetMachine(Triple, cpu, features.getString(), options,
+			llvm::Reloc::Default, llvm::CodeModel::Default, level);
+	if(!TM){
+		fprintf(stderr, "TargetMachineが生成できません\n");
+		return false;
+	}
+	return true;
+}
+
+/**
+ * コード生成に使うCPU名と拡張命令を求める
+ * cpuが空ならホストのCPUと拡張命令 (+sse4.2, -avx など, 名前順)
+ * @param CPU名 拡張命令の格納先
+ * @return CPU名
+ */
+std::string Emitter::resolveCPU(std::string cpu, std::vector<std::string> &features){
+	features.clear();
+	if(!cpu.empty())
+		return cpu;
+	llvm::StringMap<bool> host_features;
+	if(llvm::sys::getHostCPUFeatures(host_features)){
+		llvm::StringMap<bool>::iterator iter = host_features.begin();
+		for(; iter != host_features.end(); iter++)
+			features.push_back((iter->second ? "+" : "-") + iter->first().str());
+		std::sort(features.begin(), features.end());
+	}
+	return llvm::sys::getHostCPUName();
+}
+
+/**
+ * 生成するコードのターゲットを表す文字列 (キャッシュのキー用)
+ * 別のマシンとキャッシュを共有しても、違う命令セットのオブジェクトファイルを使わないようにする
+ * @param CPU名 (空ならホスト)
+ * @return "トリプル CPU名 拡張命令,..."
+ */
+std::string Emitter::getTargetDescription(std::string cpu){
+	std::vector<std::string> features;
+	std::string description = llvm::sys::getDefaultTargetTriple() + " " + resolveCPU(cpu, features) + " ";
+	for(int i = 0; i < features.size(); i++){
+		if(i > 0)
+			description += ",";
+		description += features[i];
+	}
+	return description;
+}
+
+/**
+ * Moduleにターゲット情報を設定する
+ * 最適化パスがターゲットのデータレイアウトを使えるように最適化の前に呼ぶ
+ * @param Module PassManager
+ * @return 成功時:true 失敗時:false
+ */
+bool Emitter::prepareModule(llvm::Module &mod, llvm::PassManager &pm){
+	if(!TM)
+		return false;
+	const llvm::DataLayout *layout = TM->getDataLayout();
+	mod.setTargetTriple(Triple);
+	mod.setDataLayout(layout->getStringRepresentation());
+	pm.add(new llvm::DataLayout(*layout));
+	return true;
+}
+
+/**
+ * 出力実行
+ * obj_fileが指定されていたら、オブジェクトファイルをそこに出力して残す
+ * @param Module PassManager 出力ファイル名 出力種別 オブジェクトファイル名
+ * @return 成功時:true 失敗時:false
+ */
+bool Emitter::doEmit(llvm::Module &mod, llvm::PassManager &pm, std::string file_name,
+		OutputType type, std::string obj_file){
+	if(type == OUT_OBJECT && !obj_file.empty()){
+		if(!emitFile(mod, pm, obj_file, OUT_OBJECT))
+			return false;
+		std::string error;
+		if(llvm::sys::CopyFile(llvm::sys::Path(file_name), llvm::sys::Path(obj_file), &error)){
+			fprintf(stderr, "%s が出力できません : %s\n", file_name.c_str(), error.c_str());
+			return false;
+		}
+		return true;
+	}
+	if(type != OUT_EXECUTABLE)
+		return emitFile(mod, pm, file_name, type);
+	if(!obj_file.empty())
+		return emitFile(mod, pm, obj_file, OUT_OBJECT) && linkExecutable(obj_file, file_name);
+
+	// 一時ディレクトリにオブジェクトファイルを出力してからリンク
+	std::string error;
+	llvm::sys::Path tmp_dir = llvm::sys::Path::GetTemporaryDirectory(&error);
+	if(tmp_dir.isEmpty()){
+		fprintf(stderr, "一時ディレクトリが作成できません : %s\n", error.c_str());
+		return false;
+	}
+	llvm::sys::Path tmp_obj = tmp_dir;
+	tmp_obj.appendComponent("dcc.o");
+
+	bool result = emitFile(mod, pm, tmp_obj.str(), OUT_OBJECT) &&
+		linkExecutable(tmp_obj.str(), file_name);
+	tmp_dir.eraseFromDisk(true);
+	return result;
+}
+
+/**
+ * ファイル出力
+ * @param Module PassManager 出力ファイル名 出力種別
+ * @return 成功時:true 失敗時:false
+ */
+bool Emitter::emitFile(llvm::Module &mod, llvm::PassManager &pm, std::string file_name, OutputType type){
+	std::string error;
+	unsigned flags = (type == OUT_OBJECT || type == OUT_BITCODE) ? llvm::raw_fd_ostream::F_Binary : 0;
+	llvm::tool_output_file out(file_name.c_str(), error, flags);
+	if(!error.empty()){
+		fprintf(stderr, "%s が開けません : %s\n", file_name.c_str(), error.c_str());
+		return false;
+	}
+
+	// LLVM-IRの場合はそのまま出力
+	if(type == OUT_LLVM_IR){
+		pm.add(llvm::createPrintModulePass(&out.os()));
+		ProfileScope prof("phase", "最適化・コード出力", file_name);
+		pm.run(mod);
+		out.keep();
+		return true;
+	}
+
+	// bitcodeの場合もそのまま出力 (-l で遅延読み込みできる)
+	if(type == OUT_BITCODE){
+		pm.add(llvm::createBitcodeWriterPass(out.os()));
+		ProfileScope prof("phase", "最適化・コード出力", file_name);
+		pm.run(mod);
+		out.keep();
+		return true;
+	}
+
+	{
+		llvm::formatted_raw_ostream fos(out.os());
+		ProfileScope prof("phase", "最適化・コード出力", file_name);
+		llvm::TargetMachine::CodeGenFileType file_type =
+			(type == OUT_OBJECT) ? llvm::TargetMachine::CGFT_ObjectFile
+			                     : llvm::TargetMachine::CGFT_AssemblyFile;
+		if(TM->addPassesToEmitFile(pm, fos, file_type, false)){
+			fprintf(stderr, "ターゲット %s はこの形式の出力に対応していません\n", Triple.c_str());
+			return false;
+		}
+		pm.run(mod);
+	}
+	out.keep();
+	return true;
+}
+
+/**
+ * システムのCコンパイラでリンクして実行ファイルを生成する
+ * printf, scanfなどはlibcから、-lで指定したModuleはリンク済み
+ * @param オブジェクトファイル名 実行ファイル名
+ * @return 成功時:true 失敗時:false
+ */
+bool Emitter::linkExecutable(std::string obj_file, std::string exe_file){
+	ProfileScope prof("phase", "リンク(cc)", exe_file);
+	llvm::sys::Path cc = llvm::sys::Program::FindProgramByName("cc");
+	if(cc.isEmpty()){
+		fprintf(stderr, "リンカ(cc)が見つかりません\n");
+		return false;
+	}
+
+	std::vector<const char*> args;
+	args.push_back(cc.c_str());
+	args.push_back("-o");
+	args.push_back(exe_file.c_str());
+	args.push_back(obj_file.c_str());
+	args.push_back("-lm");
+	args.push_back(NULL);
+
+	std::string error;
+	int result = llvm::sys::Program::ExecuteAndWait(cc, &args[0], NULL, NULL, 0, 0, &error);
+	if(result != 0){
+		fprintf(stderr, "リンクに失敗しました %s\n", error.c_str());
+		return false;
+	}
+	return true;
+}
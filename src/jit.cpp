@@ -0,0 +1,249 @@
+#include "jit.hpp"
+
+/**
+ * 計測用callから呼ばれる関数
+ * JITしたコードからはaddGlobalMappingで登録したこの関数が呼ばれる
+ */
+static JITRunner *CurRunner = NULL;
+static void jitCountHook(int id){
+	if(CurRunner)
+		CurRunner->countCall(id);
+}
+
+/**
+ * 再最適化用のスタブから呼ばれる関数
+ * 最適化した関数のアドレスを返し、スタブはそれを呼び出す
+ */
+static void *jitReoptimizeHook(int id){
+	return CurRunner ? CurRunner->reoptimizeFunction(id) : NULL;
+}
+
+/**
+ * デストラクタ
+ * ModuleはCodeGenが解放するのでExecutionEngineから外しておく
+ */
+JITRunner::~JITRunner(){
+	if(CurRunner == this)
+		CurRunner = NULL;
+	SAFE_DELETE(FPM);
+	if(EE)
+		EE->removeModule(Mod);
+	SAFE_DELETE(EE);
+}
+
+/**
+ * ExecutionEngine生成
+ * @param 再最適化の最適化レベル 再最適化する呼び出し回数(0なら無効)
+ * @return 成功時:true 失敗時:false
+ */
+bool JITRunner::initialize(int opt_level, int hot_threshold){
+	HotThreshold = hot_threshold;
+	StartTime = llvm::sys::TimeValue::now().usec();
+
+	// 起動を速くするためコード生成の最適化はしない
+	std::string error;
+	EE = llvm::EngineBuilder(Mod)
+		.setEngineKind(llvm::EngineKind::JIT)
+		.setOptLevel(llvm::CodeGenOpt::None)
+		.setErrorStr(&error)
+		.create();
+	if(!EE){
+		fprintf(stderr, "JITが生成できません : %s\n", error.c_str());
+		return false;
+	}
+
+	// 関数は最初に呼ばれた時にスタブからコンパイルする
+	EE->DisableLazyCompilation(false);
+
+	if(HotThreshold <= 0)
+		return true;
+
+	// ホットな関数の最適化パス
+	FPM = new llvm::FunctionPassManager(Mod);
+	FPM->add(new llvm::DataLayout(*EE->getDataLayout()));
+	FPM->add(llvm::createPromoteMemoryToRegisterPass());
+	FPM->add(llvm::createInstructionCombiningPass());
+	FPM->add(llvm::createReassociatePass());
+	FPM->add(llvm::createGVNPass());
+	FPM->add(llvm::createCFGSimplificationPass());
+	FPM->add(llvm::createLICMPass());
+	if(opt_level > 2)
+		FPM->add(llvm::createLoopUnrollPass());
+	FPM->add(llvm::createInstructionCombiningPass());
+	FPM->add(llvm::createCFGSimplificationPass());
+	FPM->doInitialization();
+
+	CurRunner = this;
+	return insertCounters();
+}
+
+/**
+ * 呼び出し回数を数えるcallを各関数の先頭に挿入し、関数の呼び出しを表経由にする
+ * allocaより後に挿入するのでmem2regの対象は変わらない
+ * @return 成功時:true 失敗時:false
+ */
+bool JITRunner::insertCounters(){
+	llvm::LLVMContext &context = Mod->getContext();
+	std::vector<llvm::Type*> hook_args;
+	hook_args.push_back(llvm::Type::getInt32Ty(context));
+	llvm::FunctionType *hook_type = llvm::FunctionType::get(
+			llvm::Type::getVoidTy(context), hook_args, false);
+	llvm::Function *hook = llvm::Function::Create(hook_type,
+			llvm::GlobalValue::ExternalLinkage, "__dcc_jit_count", Mod);
+	EE->addGlobalMapping(hook, (void*)&jitCountHook);
+
+	llvm::FunctionType *reopt_type = llvm::FunctionType::get(
+			llvm::Type::getInt8PtrTy(context), hook_args, false);
+	llvm::Function *reopt_hook = llvm::Function::Create(reopt_type,
+			llvm::GlobalValue::ExternalLinkage, "__dcc_jit_reoptimize", Mod);
+	EE->addGlobalMapping(reopt_hook, (void*)&jitReoptimizeHook);
+
+	// 対象の関数 (スタブを追加しながら回らないように先に集める)
+	std::vector<llvm::Function*> targets;
+	for(llvm::Module::iterator func = Mod->begin(); func != Mod->end(); func++){
+		// mainは一度しか呼ばれないので対象外
+		if(func->isDeclaration() || func->getName() == "main")
+			continue;
+		targets.push_back(&*func);
+	}
+
+	for(int i = 0; i < targets.size(); i++){
+		llvm::Function *func = targets[i];
+
+		llvm::BasicBlock &entry = func->getEntryBlock();
+		llvm::BasicBlock::iterator ip = entry.begin();
+		while(llvm::isa<llvm::AllocaInst>(ip))
+			ip++;
+
+		llvm::IRBuilder<> builder(&entry, ip);
+		int id = Functions.size();
+		llvm::CallInst *counter = builder.CreateCall(hook,
+				llvm::ConstantInt::get(llvm::Type::getInt32Ty(context), id));
+
+		// 呼び出す関数のポインタの表 (最初は元の関数)
+		llvm::GlobalVariable *entry_ptr = new llvm::GlobalVariable(*Mod, func->getType(), false,
+				llvm::GlobalValue::InternalLinkage, func, func->getName() + ".jitptr");
+
+		// 直接の呼び出しを表からloadした関数の呼び出しにする
+		std::vector<llvm::CallInst*> calls;
+		for(llvm::Value::use_iterator use = func->use_begin(); use != func->use_end(); ++use){
+			llvm::CallInst *call = llvm::dyn_cast<llvm::CallInst>(*use);
+			if(call && call->getCalledFunction() == func)
+				calls.push_back(call);
+		}
+		for(int j = 0; j < calls.size(); j++){
+			llvm::Value *callee = new llvm::LoadInst(entry_ptr, func->getName() + ".ptr", calls[j]);
+			calls[j]->setCalledFunction(callee);
+		}
+
+		Functions.push_back(func);
+		Counters.push_back(counter);
+		Table.push_back(entry_ptr);
+		Stubs.push_back(createStub(func, reopt_hook, id));
+		CallCounts.push_back(0);
+	}
+	return true;
+}
+
+/**
+ * 再最適化用のスタブを生成する
+ * スタブは最適化した関数のアドレスを受け取り、引数をそのまま渡して呼び出す
+ * @param 関数 再最適化の関数 カウンタ番号
+ * @return スタブ
+ */
+llvm::Function *JITRunner::createStub(llvm::Function *func, llvm::Function *reopt_hook, int id){
+	llvm::LLVMContext &context = Mod->getContext();
+	llvm::Function *stub = llvm::Function::Create(func->getFunctionType(),
+			llvm::GlobalValue::InternalLinkage, func->getName() + ".reopt", Mod);
+	llvm::IRBuilder<> builder(llvm::BasicBlock::Create(context, "entry", stub));
+	llvm::Value *addr = builder.CreateCall(reopt_hook,
+			llvm::ConstantInt::get(llvm::Type::getInt32Ty(context), id), "addr");
+	llvm::Value *callee = builder.CreateBitCast(addr, func->getType(), "callee");
+
+	std::vector<llvm::Value*> args;
+	for(llvm::Function::arg_iterator arg = stub->arg_begin(); arg != stub->arg_end(); arg++)
+		args.push_back(&*arg);
+	llvm::CallInst *call = builder.CreateCall(callee, args);
+	call->setTailCall();
+	if(func->getReturnType()->isVoidTy())
+		builder.CreateRetVoid();
+	else
+		builder.CreateRet(call);
+	return stub;
+}
+
+/**
+ * 関数のポインタの表を書き換える (次の呼び出しから使われる)
+ * @param カウンタ番号 呼び出す関数
+ */
+void JITRunner::setTableEntry(int id, llvm::Function *func){
+	void **entry = (void**)EE->getPointerToGlobal(Table.at(id));
+	*entry = EE->getPointerToFunction(func);
+}
+
+/**
+ * 関数の呼び出し回数を数えて、しきい値に達したらホットとして表をスタブに差し替える
+ * (実行中の関数のコードは書き換えず、次の呼び出しで再最適化する)
+ * @param カウンタ番号
+ */
+void JITRunner::countCall(int id){
+	if(id < 0 || (size_t)id >= CallCounts.size())
+		return;
+	if(++CallCounts.at(id) == HotThreshold)
+		setTableEntry(id, Stubs.at(id));
+}
+
+/**
+ * 関数を最適化して再コンパイルする (スタブから呼ばれる)
+ * 関数を複製して最適化し、表を複製のコードに書き換える
+ * 元の関数のコードは書き換えないので、実行中のフレームはそのまま元のコードで続く
+ * @param カウンタ番号
+ * @return 最適化した関数のアドレス (失敗時は元の関数)
+ */
+void *JITRunner::reoptimizeFunction(int id){
+	llvm::Function *func = Functions.at(id);
+	if(!FPM){
+		setTableEntry(id, func);
+		return EE->getPointerToFunction(func);
+	}
+	ProfileScope prof("phase", "JIT再最適化", func->getName());
+
+	llvm::ValueToValueMapTy vmap;
+	llvm::Function *opt_func = llvm::CloneFunction(func, vmap, false);
+	opt_func->setName(func->getName() + ".opt");
+	opt_func->setLinkage(llvm::GlobalValue::InternalLinkage);
+	Mod->getFunctionList().push_back(opt_func);
+
+	// 計測用のcallは不要になるので削除
+	if(llvm::Instruction *counter = llvm::dyn_cast_or_null<llvm::Instruction>((llvm::Value*)vmap[Counters.at(id)]))
+		counter->eraseFromParent();
+
+	FPM->run(*opt_func);
+	setTableEntry(id, opt_func);
+	if(Profiler::getInstance().isEnabled())
+		fprintf(stderr, "JIT : 関数 %s を最適化して再コンパイルしました (%d回目の呼び出し)\n",
+				func->getName().str().c_str(), HotThreshold);
+	return EE->getPointerToFunction(opt_func);
+}
+
+/**
+ * main関数をJIT実行する
+ * JIT生成からmainの最初の命令を実行するまでの時間を表示する
+ * @return mainの戻り値
+ */
+int JITRunner::run(){
+	llvm::Function *main_func = Mod->getFunction("main");
+	if(!EE || !main_func){
+		fprintf(stderr, "JIT : main関数がありません\n");
+		return 1;
+	}
+
+	// mainのみコンパイルされる (他の関数はスタブ)
+	int (*fp)() = (int (*)())EE->getPointerToFunction(main_func);
+	uint64_t ready = llvm::sys::TimeValue::now().usec();
+	fprintf(stderr, "JIT : mainの実行開始まで %.3f ms\n", (ready - StartTime) / 1000.0);
+
+	int result = fp();
+	fprintf(stderr, "%d\n", result);
+	return result;
+}
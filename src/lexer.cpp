@@ -2,273 +2,203 @@
 
 /**
  * トークンの切り出し関数
+ * 大きいファイルはMemoryBufferがmmapするので、ソースのコピーは作らない
  * @ param 字句解析対象ファイル名
  * @ return 切り出したトークンを格納したTokenStream
  */
 TokenStream *LexicalAnalysis(std::string input_filename){
-	TokenStream *tokens = new TokenStream();
-	std::ifstream ifs;
-	std::string cur_line;
-	std::string token_str;
-	int line_num = 1;
-	bool iscomment = false;
-	
-	ifs.open(input_filename.c_str(), std::ios::in);
-	if (!ifs){
+	llvm::OwningPtr<llvm::MemoryBuffer> buffer;
+	if(llvm::MemoryBuffer::getFile(input_filename, buffer, -1, false)){
 		fprintf(stderr, "file is not found\n");
 		return NULL;
 	}
+	return LexicalAnalysis(buffer.take(), input_filename);
+}
+
+/**
+ * トークンの切り出し関数
+ * ファイル以外(REPLの入力など)から切り出す場合に使う
+ * @ param 字句解析対象の入力 入力名
+ * @ return 切り出したトークンを格納したTokenStream
+ */
+TokenStream *LexicalAnalysis(std::istream &ifs, std::string input_name){
+	std::string source((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+	return LexicalAnalysis(llvm::MemoryBuffer::getMemBufferCopy(source, input_name), input_name);
+}
+
+/**
+ * トークンの切り出し関数
+ * バッファをポインタで走査し、トークンはバッファ内の範囲を指す
+ * バッファは返すTokenStreamが保持する(失敗時は削除する)
+ * @ param 字句解析対象のバッファ 入力名
+ * @ return 切り出したトークンを格納したTokenStream
+ */
+TokenStream *LexicalAnalysis(llvm::MemoryBuffer *buffer, std::string input_name){
+	ProfileScope prof("phase", "字句解析", input_name);
+	TokenStream *tokens = new TokenStream(buffer);
+	const char *base = buffer->getBufferStart();
+	const char *cur = base;
+	const char *end = buffer->getBufferEnd();
+	int line_num = 1;
+	bool iscomment = false;
 	
-	while (ifs && getline(ifs,cur_line)){
-		char next_char;
-		std::string line;
-		Token *next_token;
-		int index = 0;
-		int length = cur_line.length();
-		std::vector<Token*> line_tokens;
-		cur_line += ":";
-		while(index < length){
-			next_char = cur_line.at(index++);
-			if(next_char == ':' && index == length)
-				break;
-			if (next_char < 0)continue;
-			next_token = NULL;
-			// コメント読み飛ばし
+	while(cur < end){
+		const char *line_end = (const char*)memchr(cur, '\n', end - cur);
+		if(!line_end)
+			line_end = end;
+		const char *p = cur;
+		int line_first = tokens->getTokensSize();
+		while(p < line_end){
+			// コメント読み飛ばし (## まで)
 			if(iscomment){
-				if (length > index && next_char == '#' && cur_line.at(index) == '#'){
-					index++;
+				while(p + 1 < line_end && !(p[0] == '#' && p[1] == '#'))
+					p++;
+				if(p + 1 < line_end){
+					p += 2;
 					iscomment = false;
-				}
+				}else
+					p = line_end;
 				continue;
 			}
 
-			// EOF
-			if (next_char == EOF){
-				token_str = EOF;
-				next_token = new Token(token_str, TOK_EOF, line_num);
-			}else if (isspace(next_char)){
+			const char *start = p;
+			char next_char = *p++;
+			if (next_char < 0 || isspace(next_char))
 				continue;
-			}else if(next_char == '\"'){
-				next_char = cur_line.at(index++);
-				while(index != length && next_char != '\"'){
-					token_str += next_char;
-					next_char = cur_line.at(index++);
-				}
-				if(next_char == '\"')
-					next_token = new Token(token_str, TOK_STR, line_num);
-				else{
-					fprintf(stderr, u8"文字列を閉じる\"がありません");
+
+			// 文字列
+			if(next_char == '\"'){
+				const char *close = (const char*)memchr(p, '\"', line_end - p);
+				if(!close){
+					fprintf(stderr, "%d行目 : 文字列を閉じる\"がありません\n", line_num);
+					SAFE_DELETE(tokens);
 					return NULL;
 				}
+				tokens->pushToken(TOK_STR, p - base, close - p, line_num);
+				p = close + 1;
+
+			// 識別子, 予約語
 			}else if (isalpha(next_char)){
-				token_str += next_char;
-				next_char = cur_line.at(index++);
-				while (isalnum(next_char) || next_char == '_'){
-					token_str += next_char;
-					next_char = cur_line.at(index++);
-					if (index == length){
-						break;
-					}
-				}
-				index--;
+				while(p < line_end && (isalnum((unsigned char)*p) || *p == '_'))
+					p++;
+				llvm::StringRef token_str(start, p - start);
 
+				TokenType type = TOK_IDENTIFIER;
 				if (token_str == "return")
-					next_token = new Token(token_str,TOK_RETURN,line_num);
+					type = TOK_RETURN;
 				else if(token_str == "and")
-					next_token = new Token(token_str, TOK_AND, line_num);
+					type = TOK_AND;
 				else if(token_str == "or")
-					next_token = new Token(token_str, TOK_OR, line_num);
+					type = TOK_OR;
 				else if(token_str == "global")
-					next_token = new Token(token_str, TOK_GLOBAL, line_num);
+					type = TOK_GLOBAL;
 				else if(token_str == "break")
-					next_token = new Token("break", TOK_BREAK, line_num);
+					type = TOK_BREAK;
 				else if(token_str == "continue")
-					next_token = new Token("continue", TOK_CONTINUE, line_num);
+					type = TOK_CONTINUE;
 				else if(token_str == "if")
-					next_token = new Token("if", TOK_IF, line_num);
+					type = TOK_IF;
 				else if(token_str == "elif")
-					next_token = new Token("else if", TOK_ELSE_IF, line_num);
+					type = TOK_ELSE_IF;
 				else if(token_str == "else")
-					next_token = new Token("else", TOK_ELSE, line_num);
+					type = TOK_ELSE;
 				else if(token_str == "for")
-					next_token = new Token("for", TOK_FOR, line_num);
+					type = TOK_FOR;
+
+				if(type == TOK_ELSE_IF)
+					tokens->pushToken(TOK_ELSE_IF, "else if", line_num);
 				else
-					next_token = new Token(token_str,TOK_IDENTIFIER,line_num);
+					tokens->pushToken(type, start - base, p - start, line_num);
 
-			// 数字
+			// 数字 (0から始まる場合は整数部を0だけとする)
 			}else if (isdigit(next_char)){
-				if (next_char == '0'){
-					token_str += next_char;
-					next_char = cur_line.at(index++);
-					if(next_char == '.'){
-						char buff = next_char;
-						next_char = cur_line.at(index++);
-						if(isdigit(next_char)){
-							token_str += buff;
-							while(isdigit(next_char)){
-								token_str += next_char;
-								next_char = cur_line.at(index++);
-							}
-						}
-						else
-							index--;
-					}
-					index--;
-					next_token = new Token(token_str, TOK_DIGIT, line_num);
-				}else{
-					token_str += next_char;
-					next_char = cur_line.at(index++);
-					while (isdigit(next_char)){
-						token_str += next_char;
-						next_char = cur_line.at(index++);
-					}
-					if(next_char == '.'){
-						char buff = next_char;
-						next_char = cur_line.at(index++);
-						if(isdigit(next_char)){
-							token_str += buff;
-							while(isdigit(next_char)){
-								token_str += next_char;
-								next_char = cur_line.at(index++);
-							}
-						}
-						else
-							index--;
-					}
-					index--;
-					next_token = new Token(token_str, TOK_DIGIT, line_num);
+				if(next_char != '0'){
+					while(p < line_end && isdigit((unsigned char)*p))
+						p++;
 				}
-			}else if(next_char == '\"'){
-				next_char = cur_line.at(index++);
-				while(true){
-					token_str += next_char;
-					next_char = cur_line.at(index++);
-					if(next_char == '\"')
-						next_token = new Token(token_str, TOK_STR, line_num);
-					if(index == length){
-						fprintf(stderr, u8"文字列を閉じる\"がありません");
-						SAFE_DELETE(tokens);
-						return NULL;
-					}
+				if(p + 1 < line_end && *p == '.' && isdigit((unsigned char)p[1])){
+					p += 2;
+					while(p < line_end && isdigit((unsigned char)*p))
+						p++;
 				}
-					
+				tokens->pushToken(TOK_DIGIT, start - base, p - start, line_num);
+
 			// コメント
 			}else if (next_char == '#'){
-				next_char = cur_line.at(index++);
-				
 				//コメントが##○○##の場合
-				if(next_char == '#'){
+				if(p < line_end && *p == '#'){
+					p++;
 					iscomment = true;
 					continue;
-				}else{
-					index--;
-					break;
 				}
+				// 行末まで
+				break;
+
+			// 範囲 (.. か 終わりを含まない ..<)
+			}else if(next_char == '.' && p < line_end && *p == '.'){
+				p++;
+				if(p < line_end && *p == '<')
+					p++;
+				tokens->pushToken(TOK_SYMBOL, start - base, p - start, line_num);
+
 			//それ以外 (記号)
-			}else{
-				if (next_char == '*' ||
-				    next_char == '+' ||
-				    next_char == '-' ||
-				    next_char == '/' ||
-				    next_char == '%' ||
-				    next_char == '!' ||
-				    next_char == '=' ||
-				    next_char == '<' ||
-				    next_char == '>' ||
-				    next_char == ',' || 
-				    next_char == '(' ||
-				    next_char == ')' ||
-				    next_char == '\\'||
-				    next_char == '[' ||
-				    next_char == ']' ||
-				    next_char == '{' ||
-				    next_char == '}' ||
-				    next_char == ';'){
-					token_str += next_char;
-					if(index < length){
-						next_char = cur_line.at(index++);
-						if(token_str == "=" && next_char == '=')
-							token_str += next_char;
-						else if(token_str == "<" && next_char == '=')
-							token_str += next_char;
-						else if(token_str == "<" && next_char == '-')
-							token_str += next_char;
-						else if(token_str == ">" && next_char == '=')
-							token_str += next_char;
-						else if(token_str == "!" && next_char == '=')
-							token_str += next_char;
-						else if(token_str == "/" && next_char == '/')
-							token_str += next_char;
-						else if(token_str == "+" && next_char == '=')
-							token_str += next_char;
-						else if(token_str == "-" && next_char == '=')
-							token_str += next_char;
-						else if(token_str == "*" && next_char == '=')
-							token_str += next_char;
-						else if(token_str == "/" && next_char == '=')
-							token_str += next_char;
-						else if(token_str == "%" && next_char == '=')
-							token_str += next_char;
-						else
-							index--;
-						
-						if(token_str == "//"){
-							if(length > index){
-								next_char = cur_line.at(index++);
-								if(next_char == '=')
-									token_str += next_char;
-								else
-									index--;
-							}
-						}
+			}else if(next_char != '\0' && strchr("*+-/%!=<>,()\\[]{};", next_char)){
+				if(p < line_end){
+					char second = *p;
+					if(second == '=' && strchr("=<>!+-*/%", next_char))
+						p++;
+					else if(next_char == '<' && second == '-')
+						p++;
+					else if(next_char == '/' && second == '/'){
+						p++;
+						if(p < line_end && *p == '=')
+							p++;
 					}
-					next_token = new Token(token_str,TOK_SYMBOL,line_num);
-				// 解析不可能
-				}else{
-					fprintf(stderr, "%d行目 : 文字 ", line_num);
-					fprintf(stderr, "%c", next_char);
-					fprintf(stderr, " が処理できません\n");
-					SAFE_DELETE(tokens);
-					return NULL;
 				}
+				tokens->pushToken(TOK_SYMBOL, start - base, p - start, line_num);
+
+			// 解析不可能
+			}else{
+				fprintf(stderr, "%d行目 : 文字 ", line_num);
+				fprintf(stderr, "%c", next_char);
+				fprintf(stderr, " が処理できません\n");
+				SAFE_DELETE(tokens);
+				return NULL;
 			}
-			// Tokensに追加
-			line_tokens.push_back(next_token);
-			token_str.clear();
-			
 		}
 		
-		for(int i = 0; i < line_tokens.size(); i++)
-			tokens->pushToken(line_tokens.at(i));
-		if(line_tokens.size() != 0 &&
-				line_tokens.at(line_tokens.size()-1)->getTokenString() != ";" &&
-				line_tokens.at(line_tokens.size()-1)->getTokenString() != "{" &&
-				line_tokens.at(line_tokens.size()-1)->getTokenString() != "}")
-			tokens->pushToken(new Token(";", TOK_SYMBOL, line_num));
-		token_str.clear();
-		line_tokens.clear();
+		if(tokens->getTokensSize() != line_first){
+			llvm::StringRef last_str = tokens->getRef(tokens->getTokensSize()-1);
+			if(last_str != ";" && last_str != "{" && last_str != "}")
+				tokens->pushToken(TOK_SYMBOL, ";", line_num);
+		}
 		line_num++;
+		cur = line_end + 1;
 	}
-	std::vector<Token*> mains;
-	std::vector<Token*> buff;
-	Token *token;
+
+	// main以外の関数を先に並べ、それ以外の文をmainにまとめる (並べ替える順番を作る)
+	std::vector<int> order;
+	std::vector<int> mains;
+	std::vector<int> buff;
 	bool block = true;
 	bool is_main = false;
 	bool last = false;
 	bool iffor = false;
 	int kakko = 0;
 	int loop = tokens->getTokensSize();
+	order.reserve(loop + 16);
 	
 	for(int i = 0; i < loop; i++){
-		token = tokens->getToken(0);
-		tokens->eraseToken(0);	
+		TokenType type = tokens->getType(i);
+		llvm::StringRef str = tokens->getRef(i);
 
 		block = true;
-		if(token->getTokenType() == TOK_FOR || token->getTokenType() == TOK_IF || token->getTokenType() == TOK_ELSE_IF || token->getTokenType() == TOK_ELSE){
+		if(type == TOK_FOR || type == TOK_IF || type == TOK_ELSE_IF || type == TOK_ELSE || 
+				str == ".." || str == "..<"){
 			iffor = true;
 		}
 
-		if(token->getTokenString() == "{"){
+		if(str == "{"){
 			if(iffor)
 				iffor = false;
 			else if(!iffor && kakko == 0){
@@ -277,7 +207,7 @@ TokenStream *LexicalAnalysis(std::string input_filename){
 			}
 			kakko += 1;
 		}
-		else if(token->getTokenString() == "}"){
+		else if(str == "}"){
 			kakko -= 1;
 			if(kakko == 0 && is_main){
 				is_main = false;
@@ -289,15 +219,16 @@ TokenStream *LexicalAnalysis(std::string input_filename){
 			is_main ^= true;
 			last = true;
 		}
-		buff.push_back(token);
+		buff.push_back(i);
 
 		if(!block || last){
-			int block_index = -1;
+			int block_index = 0;
 			if(!is_main || last)
 				block_index = buff.size();
 			else{
 				for(int j = buff.size()-1; j >= 0; j--){
-					if(buff.at(j)->getTokenString() == "}" || buff.at(j)->getTokenString() == ";"){
+					llvm::StringRef buff_str = tokens->getRef(buff.at(j));
+					if(buff_str == "}" || buff_str == ";"){
 						block_index = j+1;
 						break;
 					}
@@ -305,44 +236,41 @@ TokenStream *LexicalAnalysis(std::string input_filename){
 			}
 			
 			if(is_main){
-				for(int j = 0; j < block_index; j++){
-					mains.push_back(buff.at(0));
-					buff.erase(buff.begin());
-				}
+				mains.insert(mains.end(), buff.begin(), buff.begin() + block_index);
 			}
 			else{
-				for(int j = 0; j < block_index; j++){
-					tokens->pushToken(buff.at(0));
-					buff.erase(buff.begin());
-				}
+				order.insert(order.end(), buff.begin(), buff.begin() + block_index);
 				// エラーチェックのため
-				if(block_index > 0)
-					tokens->pushToken(new Token("]]", TOK_SYMBOL, -1));
+				if(block_index > 0){
+					order.push_back(tokens->getTokensSize());
+					tokens->pushToken(TOK_SYMBOL, "]]", -1);
+				}
 			}
+			buff.erase(buff.begin(), buff.begin() + block_index);
 		}
 	}
-	if(tokens->getTokensSize() != 0 && tokens->getToken(tokens->getTokensSize()-1)->getTokenString() != "]]"){
+	if(order.size() != 0 && tokens->getRef(order.back()) != "]]"){
 		fprintf(stdout, "最後に作成した関数の最後に } を挿入します.\n");
-		tokens->pushToken(new Token("}", TOK_SYMBOL, -1));
-		tokens->pushToken(new Token("]]", TOK_SYMBOL, -1));
+		order.push_back(tokens->getTokensSize());
+		tokens->pushToken(TOK_SYMBOL, "}", -1);
+		order.push_back(tokens->getTokensSize());
+		tokens->pushToken(TOK_SYMBOL, "]]", -1);
+	}
+	const char *main_head[] = {"main", "(", ")", "{{"};
+	for(int i = 0; i < 4; i++){
+		order.push_back(tokens->getTokensSize());
+		tokens->pushToken(i == 0 ? TOK_IDENTIFIER : TOK_SYMBOL, main_head[i], -1);
 	}
-	tokens->pushToken(new Token("main", TOK_IDENTIFIER, -1));
-	tokens->pushToken(new Token("(", TOK_SYMBOL, -1));
-	tokens->pushToken(new Token(")", TOK_SYMBOL, -1));
-	tokens->pushToken(new Token("{{", TOK_SYMBOL, -1));
-	for(int i = 0; i < mains.size(); i++)
-		tokens->pushToken(mains.at(i));
-	tokens->pushToken(new Token("}}", TOK_SYMBOL, -1));
+	order.insert(order.end(), mains.begin(), mains.end());
+	order.push_back(tokens->getTokensSize());
+	tokens->pushToken(TOK_SYMBOL, "}}", -1);
 	
+	// EOF
+	order.push_back(tokens->getTokensSize());
+	tokens->pushToken(TOK_EOF, "", line_num);
+
+	tokens->reorderTokens(order);
 	// tokens->printTokens();
-	// return NULL;
-	
-	// EOFの確認
-	if (ifs.eof()){
-		tokens->pushToken(new Token(token_str,TOK_EOF,line_num));
-	}
-	// クローズ
-	ifs.close();
 	return tokens;
 }
 
@@ -350,18 +278,79 @@ TokenStream *LexicalAnalysis(std::string input_filename){
  *  * デストラクタ
  *   */
 TokenStream::~TokenStream(){
-	for(int i=0;i<Tokens.size();i++){
-		SAFE_DELETE(Tokens[i]);
+	SAFE_DELETE(Source);
+}
+
+/**
+ * ソースの範囲のトークンを追加する
+ * @param 種別 ソース中の開始位置 長さ 行
+ * @return 成功時:true 失敗時:false
+ */
+bool TokenStream::pushToken(TokenType type, uint32_t offset, uint32_t length, int line){
+	Types.push_back(type);
+	Offsets.push_back(offset);
+	Lengths.push_back(length);
+	Lines.push_back(line);
+	double num = 0x7fffff;
+	if(type == TOK_DIGIT){
+		// 範囲の後ろまで読まないように終端付きでコピーしてから変換する
+		char buff[64];
+		llvm::StringRef text = getRef(Types.size()-1);
+		if(text.size() < sizeof(buff)){
+			memcpy(buff, text.data(), text.size());
+			buff[text.size()] = '\0';
+			num = atof(buff);
+		}else
+			num = atof(text.str().c_str());
 	}
-	Tokens.clear();
+	Nums.push_back(num);
+	Symbols.push_back(type == TOK_IDENTIFIER ?
+			SymbolTable::getInstance().intern(getRef(Types.size()-1)) : SymbolTable::None);
+	return true;
 }
 
 /**
- *  * トークン取得
- *   * @return CurIndex番目のToken
- *    */
-Token TokenStream::getToken(){
-	return *Tokens[CurIndex];
+ * ソースにないトークン(字句解析で補ったもの)を追加する
+ * @param 種別 文字列 行
+ * @return 成功時:true 失敗時:false
+ */
+bool TokenStream::pushToken(TokenType type, llvm::StringRef text, int line){
+	uint32_t source_size = Source ? Source->getBufferSize() : 0;
+	uint32_t offset = source_size + Extra.size();
+	Extra.append(text.data(), text.size());
+	return pushToken(type, offset, text.size(), line);
+}
+
+/**
+ * トークンを並べ替える
+ * @param 並べ替え後のi番目に置くトークンの番号
+ * @return 成功時:true 失敗時:false
+ */
+bool TokenStream::reorderTokens(const std::vector<int> &order){
+	std::vector<unsigned char> types(order.size());
+	std::vector<uint32_t> offsets(order.size());
+	std::vector<uint32_t> lengths(order.size());
+	std::vector<int> lines(order.size());
+	std::vector<double> nums(order.size());
+	std::vector<SymbolID> symbols(order.size());
+	for(int i = 0; i < order.size(); i++){
+		int index = order.at(i);
+		types[i] = Types.at(index);
+		offsets[i] = Offsets.at(index);
+		lengths[i] = Lengths.at(index);
+		lines[i] = Lines.at(index);
+		nums[i] = Nums.at(index);
+		symbols[i] = Symbols.at(index);
+	}
+	Types.swap(types);
+	Offsets.swap(offsets);
+	Lengths.swap(lengths);
+	Lines.swap(lines);
+	Nums.swap(nums);
+	Symbols.swap(symbols);
+	CurIndex = 0;
+	EndIndex = Types.size();
+	return true;
 }
 
 /**
@@ -369,8 +358,8 @@ Token TokenStream::getToken(){
  *   * @return 成功時:true 失敗時:false
  *    */
 bool TokenStream::getNextToken(){
-	int size = Tokens.size();
-	if (--size<=CurIndex){
+	// EOFと範囲の終わりから先には進まない
+	if (CurIndex >= EndIndex || getType(CurIndex) == TOK_EOF){
 		return false;
 	}else{
 		CurIndex++;
@@ -407,12 +396,12 @@ bool TokenStream::ungetToken(int times){
  *  * 格納されたトークン一覧を表示する
  *   */
 bool TokenStream::printTokens(){
-	std::vector<Token*>::iterator titer = Tokens.begin();
-	while(titer != Tokens.end()){
-		fprintf(stdout,"%d:",(*titer)->getTokenType());
-		if((*titer)->getTokenType() != TOK_EOF)
-			fprintf(stdout,"%s %d\n",(*titer)->getTokenString().c_str(), (*titer)->getLine());
-		++titer;
+	for(int i = 0; i < getTokensSize(); i++){
+		fprintf(stdout,"%d:",getType(i));
+		if(getType(i) != TOK_EOF){
+			llvm::StringRef str = getRef(i);
+			fprintf(stdout,"%.*s %d\n",(int)str.size(), str.data(), getLine(i));
+		}
 	}
 	return true;
 }
@@ -421,9 +410,9 @@ bool TokenStream::printTokens(){
  * 次のStatementに進める
  */
 bool TokenStream::getNextStatement(){
-	std::string str;
-	for(int i = CurIndex; i < Tokens.size(); i++){
-		str = Tokens[CurIndex]->getTokenString();
+	llvm::StringRef str;
+	for(int i = CurIndex; i < EndIndex; i++){
+		str = getRef(CurIndex);
 		if(str == ";" || str == "{" || str == "}")
 			break;
 		CurIndex++;
@@ -435,8 +424,8 @@ bool TokenStream::getNextStatement(){
  * 次のFunctionに進める
  */
 bool TokenStream::getNextFunction(){
-	for(int i = CurIndex; i < Tokens.size()-1; i++){
-		if(Tokens[CurIndex]->getTokenString() == "]]")
+	for(int i = CurIndex; i < EndIndex-1; i++){
+		if(getRef(CurIndex) == "]]")
 			break;
 		CurIndex++;
 	}
@@ -0,0 +1,60 @@
+#include "lto.hpp"
+
+char ModuleStatsPass::ID = 0;
+
+/**
+ * 関数, 命令, 呼び出しの数を数える
+ */
+bool ModuleStatsPass::runOnModule(llvm::Module &M){
+	Stats->Functions = Stats->Instructions = Stats->Calls = 0;
+	for(llvm::Module::iterator func = M.begin(); func != M.end(); func++){
+		if(func->isDeclaration())
+			continue;
+		Stats->Functions++;
+		for(llvm::Function::iterator bb = func->begin(); bb != func->end(); bb++){
+			for(llvm::BasicBlock::iterator inst = bb->begin(); inst != bb->end(); inst++){
+				Stats->Instructions++;
+				llvm::CallInst *call = llvm::dyn_cast<llvm::CallInst>(inst);
+				if(call && call->getCalledFunction() && !call->getCalledFunction()->isDeclaration())
+					Stats->Calls++;
+			}
+		}
+	}
+	return false;
+}
+
+/**
+ * LTOのパスをPassManagerに登録する
+ * 通常の最適化パスの後に呼ぶ
+ * @param PassManager 最適化レベル(0-3)
+ */
+void LTOOptimizer::addPasses(llvm::PassManagerBase &pm, int opt_level){
+	pm.add(new ModuleStatsPass(&Before));
+
+	// main以外は外から呼ばれないので内部リンケージにする
+	std::vector<const char*> exports;
+	exports.push_back("main");
+	pm.add(llvm::createInternalizePass(exports));
+
+	// inline, globalopt, IPSCCP, globaldce, ...
+	llvm::PassManagerBuilder builder;
+	builder.OptLevel = opt_level;
+	builder.populateLTOPassManager(pm, false, true);
+
+	pm.add(new ModuleStatsPass(&After));
+}
+
+/**
+ * LTOの効果を表示する
+ * 呼び出し数の減少はインライン展開によるもので、実行速度の目安になる
+ * @param 出力ファイル名
+ */
+void LTOOptimizer::printReport(std::string file_name){
+	fprintf(stderr, "LTO : %s\n", file_name.c_str());
+	fprintf(stderr, "  関数     %6d -> %6d\n", Before.Functions, After.Functions);
+	fprintf(stderr, "  命令     %6d -> %6d", Before.Instructions, After.Instructions);
+	if(Before.Instructions > 0)
+		fprintf(stderr, " (%+.1f%%)", (After.Instructions - Before.Instructions) * 100.0 / Before.Instructions);
+	fprintf(stderr, "\n");
+	fprintf(stderr, "  関数呼び出し %6d -> %6d\n", Before.Calls, After.Calls);
+}
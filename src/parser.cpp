@@ -4,20 +4,117 @@
 /**
  * コンストラクタ
  */
-Parser::Parser(std::string filename){
+Parser::Parser(std::string filename) : TU(NULL), Arena(NULL), Diagnostics(NULL), Jobs(1), Incremental(false){
 	Tokens = LexicalAnalysis(filename);
 };
 
+/**
+ * 関数の本体を並列に解析するスレッド用のコンストラクタ
+ * 関数の表はプロトタイプを全て宣言した後の親の表をコピーする
+ * @param 親のParser ノードを確保するアリーナ(親のTUが引き取る)
+ */
+Parser::Parser(Parser &parent, ASTArena *arena)
+	: Tokens(NULL), TU(NULL), Arena(arena), Diagnostics(NULL), Jobs(1), Incremental(false){
+	PrototypeTable = parent.PrototypeTable;
+	FunctionTable = parent.FunctionTable;
+}
+
+/**
+ * エラーメッセージの出力
+ * 関数ごとに解析している間は関数のメッセージに溜めて、最後にソースの順に出力する
+ * @param printfと同じ書式と引数
+ */
+void Parser::printError(const char *format, ...){
+	va_list args;
+	va_start(args, format);
+	if(Diagnostics){
+		// 長さを測ってからその大きさで書き込む (識別子が長くても切らない)
+		va_list copy;
+		va_copy(copy, args);
+		int length = vsnprintf(NULL, 0, format, copy);
+		va_end(copy);
+		if(length > 0){
+			std::string buff(length + 1, '\0');
+			vsnprintf(&buff[0], buff.size(), format, args);
+			Diagnostics->append(buff, 0, length);
+		}
+	}else
+		vfprintf(stderr, format, args);
+	va_end(args);
+}
+
+/**
+ * 入力の一部(REPLの1入力)の構文解析実行
+ * 前の入力で定義した関数とmainの変数はそのまま使える
+ * mainは入力ごとに作り直す
+ * @param ソース
+ * @return 解析成功:true 解析失敗:false
+ */
+bool Parser::parseSource(std::string source){
+	SAFE_DELETE(TU);
+	SAFE_DELETE(Tokens);
+	Arena = NULL;
+	CORRECT = true;
+
+	// 失敗した時に戻せるように保存
+	SavedMainVariableTable = MainVariableTable;
+	SavedPrototypeTable = PrototypeTable;
+	SavedFunctionTable = FunctionTable;
+	SymbolID main_symbol = SymbolTable::getInstance().intern("main");
+	PrototypeTable.erase(main_symbol);
+	FunctionTable.erase(main_symbol);
+
+	std::istringstream iss(source);
+	Tokens = LexicalAnalysis(iss, "<stdin>");
+	if(!doParse() || !CORRECT){
+		rollback();
+		return false;
+	}
+	return true;
+}
+
+/**
+ * 直前のparseSourceで追加した関数と変数を取り消す
+ * (コード生成に失敗した場合にも呼ぶ)
+ */
+void Parser::rollback(){
+	MainVariableTable = SavedMainVariableTable;
+	PrototypeTable = SavedPrototypeTable;
+	FunctionTable = SavedFunctionTable;
+}
+
 /**
  * 構文解析実行
  * @return 解析成功:true 解析失敗:false
  */
 bool Parser::doParse(){
+	ProfileScope prof("phase", "構文解析");
 	if(!Tokens){
 		//fprintf(stderr, "error at lexer\n");
 		return false;
 	}else{
-		return visitTranslationUnit();
+		bool result = visitTranslationUnit();
+
+		// トークン数とASTのアリーナの最大使用量を記録する (-time-report からトークン/秒が分かる)
+		std::string detail = std::to_string(Tokens->getTokensSize()) + " tokens";
+		if(TU){
+			size_t nodes = 0, used = 0, reserved = 0;
+			for(int i = 0; i < TU->getArenaNum(); i++){
+				nodes += TU->getArena(i).getNodeCount();
+				used += TU->getArena(i).getBytesUsed();
+				reserved += TU->getArena(i).getBytesReserved();
+			}
+			detail += ", " + std::to_string(nodes) + " nodes, arena " +
+				std::to_string(used / 1024) + "/" + std::to_string(reserved / 1024) + " KB";
+			if(TU->getArenaNum() > 1)
+				detail += ", " + std::to_string(TU->getArenaNum() - 1) + " threads";
+		}
+		// 変数表の探索1回あたりの位置の数が変数の数によらず一定なら線形に伸びる
+		detail += ", scope " + std::to_string(VariableTable.getFinds()) + " finds/" +
+			std::to_string(VariableTable.getProbes()) + " probes/" +
+			std::to_string(VariableTable.getGrows()) + " grows";
+		prof.setDetail(detail);
+		return result;
 	}
 };
 
@@ -26,11 +123,10 @@ bool Parser::doParse(){
  * @return TranslationUnitへの参照
  */
 TranslationUnitAST &Parser::getAST(){
-	if(TU){
-		return *TU;
-	}else{ 
-		return *(new TranslationUnitAST());
-	}
+	// 解析していない場合も空のASTを返す (Parserが所有する)
+	if(!TU)
+		TU = new TranslationUnitAST();
+	return *TU;
 };
 
 /**
@@ -39,14 +135,15 @@ TranslationUnitAST &Parser::getAST(){
  */
 bool Parser::visitTranslationUnit(){
 	TU = new TranslationUnitAST();
+	Arena = &TU->getArena();
 
 	// printの宣言追加
 	std::vector<std::string> param_list;
 	std::vector<std::string> param_identify;
 	param_list.push_back("i");
 	param_identify.push_back("string");
-	TU->addPrototype(new PrototypeAST("int", "print", param_list, param_identify));
-	PrototypeTable["print"] = 1;
+	TU->addPrototype(Arena->create<PrototypeAST>("int", "print", param_list, param_identify));
+	PrototypeTable[SymbolTable::getInstance().intern("print")] = 1;
 	
 	// clear
 	param_list.clear();
@@ -55,52 +152,145 @@ bool Parser::visitTranslationUnit(){
 	// inputの宣言追加
 	param_list.push_back("i");
 	param_identify.push_back("string");
-	TU->addPrototype(new PrototypeAST("int", "input", param_list, param_identify));
-	PrototypeTable["input"] = 1;
+	TU->addPrototype(Arena->create<PrototypeAST>("int", "input", param_list, param_identify));
+	PrototypeTable[SymbolTable::getInstance().intern("input")] = 1;
 	
-	//ExternalDecl
-	while(true){
-		if(!visitExternalDeclaration(TU)){
-			SAFE_DELETE(TU);
-			return false;
-		}
-		if (Tokens->getCurType() == TOK_EOF){
-			break;
+	// 関数の境界を探し、プロトタイプを先に全て宣言してから関数の本体を解析する
+	// (関数の本体は後に定義した関数も呼び出せる)
+	std::vector<FunctionUnit> units;
+	scanFunctionUnits(units);
+	for(int i = 0; i < units.size(); i++)
+		visitFunctionUnitDeclaration(units[i]);
+
+	if(Jobs > 1 && !Incremental && units.size() > 1){
+		parseFunctionUnitsInParallel(units);
+	}else{
+		for(int i = 0; i < units.size(); i++)
+			visitFunctionUnitBody(*Tokens, units[i]);
+	}
+
+	// ソースの順にエラーメッセージを出力し、ASTをまとめる
+	for(int i = 0; i < units.size(); i++){
+		FunctionUnit &unit = units[i];
+		fputs(unit.Diagnostics.c_str(), stderr);
+		if(unit.Proto)
+			TU->addPrototype(unit.Proto);
+		if(unit.Function){
+			TU->addFunction(unit.Function);
+			FunctionTable[unit.Proto->getSymbol()] = unit.Proto->getParamNum();
 		}
 	}
 	return true;
 }
 
 /**
- * ExternalDeclaration用構文解析クラス
- * @param TranslationUnitAST
- * @return true
+ * トップレベルの関数の境界を探す
+ * 関数は字句解析で置いた ]] で終わり、最後のmainはEOFで終わる
+ * @param 見つけた関数の範囲の格納先
+ */
+void Parser::scanFunctionUnits(std::vector<FunctionUnit> &units){
+	int begin = 0;
+	int size = Tokens->getTokensSize();
+	for(int i = 0; i < size; i++){
+		TokenType type = Tokens->getType(i);
+		if(type == TOK_EOF || (type == TOK_SYMBOL && Tokens->getRef(i) == "]]")){
+			units.push_back(FunctionUnit(begin, i + 1));
+			begin = i + 1;
+		}
+	}
+}
+
+/**
+ * 関数のプロトタイプの解析と宣言 (ソースの順に呼ぶ)
+ * @param 関数の範囲
  */
-bool Parser::visitExternalDeclaration(TranslationUnitAST *tunit){
-	int bkup = Tokens->getCurIndex();
+void Parser::visitFunctionUnitDeclaration(FunctionUnit &unit){
+	TokenStream *tokens = Tokens;
+	TokenStream unit_tokens(*tokens, unit.Begin, unit.End);
+	Tokens = &unit_tokens;
+	Diagnostics = &unit.Diagnostics;
+
 	// FunctionDeclaration
-	PrototypeAST *proto = visitFunctionDeclaration();
-	if (!proto){
+	unit.Line = Tokens->getCurLine();
+	unit.Proto = visitFunctionDeclaration();
+	if(!unit.Proto){
 		CORRECT = false;
-		fprintf(stderr, "%d行目 : 関数を宣言する際は 関数名(引数,引数,,,){処理} としてください.\n", Tokens->getCurLine());
-		Tokens->getNextFunction();
-		return true;
+		printError("%d行目 : 関数を宣言する際は 関数名(引数,引数,,,){処理} としてください.\n", unit.Line);
+	}else if(Tokens->getCurRef() == "{" || Tokens->getCurRef() == "{{"){
+		unit.Body = Tokens->getCurIndex();
 	}
 
-	tunit->addPrototype(proto);
-	if(Tokens->getCurString() == "{" || Tokens->getCurString() == "{{"){
-		Tokens->applyTokenIndex(bkup);
-		// FunctionDefinition
-		FunctionAST *func_def = visitFunctionDefinition();
-		if (func_def){
-			if(Tokens->getCurString() == "]]")Tokens->getNextToken();
-			tunit->addFunction(func_def);
-		}else
-			Tokens->getNextFunction();
+	Diagnostics = NULL;
+	Tokens = tokens;
+}
 
-	}else{
-		Tokens->getNextFunction();
-		SAFE_DELETE(proto);
+/**
+ * 関数の本体の解析
+ * 関数ごとに独立しているので、スレッドごとのParserから並列に呼べる
+ * @param 全体のTokenStream 関数の範囲
+ */
+void Parser::visitFunctionUnitBody(TokenStream &tokens, FunctionUnit &unit){
+	if(unit.Body < 0)
+		return;
+	TokenStream *bkup_tokens = Tokens;
+	TokenStream unit_tokens(tokens, unit.Body, unit.End);
+	Tokens = &unit_tokens;
+	Diagnostics = &unit.Diagnostics;
+
+	// FunctionDefinition (プロトタイプは読み直さずに本体から解析する)
+	unit.Function = visitFunctionDefinition(Arena->create<PrototypeAST>(*unit.Proto), unit.Line);
+	if(unit.Function){
+		if(Tokens->getCurRef() == "]]")
+			Tokens->getNextToken();
+		if(Tokens->getCurType() != TOK_EOF){
+			CORRECT = false;
+			printError("%d行目 : 関数を宣言する際は 関数名(引数,引数,,,){処理} としてください.\n", Tokens->getCurLine());
+		}
+	}
+
+	Diagnostics = NULL;
+	Tokens = bkup_tokens;
+}
+
+/**
+ * 関数の本体をJobs個のスレッドで並列に解析する
+ * スレッドはまだ解析していない関数を順に取っていき、自身のアリーナにASTを作る
+ * @param 関数の範囲 (プロトタイプは宣言済み)
+ * @return true
+ */
+bool Parser::parseFunctionUnitsInParallel(std::vector<FunctionUnit> &units){
+	int jobs = std::min(Jobs, (int)units.size());
+	std::vector<Parser*> workers;
+	for(int i = 0; i < jobs; i++){
+		ASTArena *arena = new ASTArena();
+		TU->adoptArena(arena);
+		workers.push_back(new Parser(*this, arena));
+	}
+
+	// ワーカーも同じ識別子の表を使う (並列に使う間だけLockする)
+	SymbolTable &symbols = SymbolTable::getInstance();
+	symbols.setConcurrent(true);
+
+	std::atomic<int> next(0);
+	std::vector<std::thread> threads;
+	for(int i = 0; i < jobs; i++){
+		Parser *worker = workers[i];
+		threads.emplace_back([&, worker](){
+			SymbolTable::Binding bind_symbols(symbols);
+			int index;
+			while((index = next++) < units.size())
+				worker->visitFunctionUnitBody(*Tokens, units[index]);
+		});
+	}
+	for(int i = 0; i < threads.size(); i++)
+		threads[i].join();
+	symbols.setConcurrent(false);
+
+	for(int i = 0; i < workers.size(); i++){
+		if(!workers[i]->CORRECT)
+			CORRECT = false;
+		VariableTable.addStats(workers[i]->VariableTable);
+		SAFE_DELETE(workers[i]);
 	}
 	return true;
 }
@@ -110,61 +300,64 @@ bool Parser::visitExternalDeclaration(TranslationUnitAST *tunit){
  * @return 解析成功:PrototypeAST 解析失敗:NULL
  */
 PrototypeAST *Parser::visitFunctionDeclaration(){
-	int bkup = Tokens->getCurIndex();
 	int line = Tokens->getCurLine();
 	PrototypeAST *proto = visitPrototype();
 	if (!proto)
 		return NULL;
 	
 	// 再定義されていない確認
-	if(PrototypeTable.find(proto->getName()) != PrototypeTable.end() ||
-			(FunctionTable.find(proto->getName()) != FunctionTable.end() &&
-			 FunctionTable[proto->getName()] != proto->getParamNum())){
+	if(PrototypeTable.find(proto->getSymbol()) != PrototypeTable.end() ||
+			(FunctionTable.find(proto->getSymbol()) != FunctionTable.end() &&
+			 FunctionTable[proto->getSymbol()] != proto->getParamNum())){
 		// エラーメッセージを出してNULLを返す
 		CORRECT = false;
-		fprintf(stderr, "%d行目 : 関数 %s はすでに作成されています\n",  line, proto->getName().c_str());
-		SAFE_DELETE(proto);
+		printError("%d行目 : 関数 %s はすでに作成されています\n",  line, proto->getName().c_str());
 		return NULL;
 	}
 
 	// prototype
 	// （関数名, 引数）のペアをプロトタイプ宣言テーブル（Map）に追加
-	PrototypeTable[proto->getName()] = proto->getParamNum();
+	PrototypeTable[proto->getSymbol()] = proto->getParamNum();
 	return proto;
 }
 
 /**
  * FunctionDefinition用構文解析メソッド
+ * プロトタイプは visitFunctionDeclaration で解析済みで、現在のトークンは関数本体の {
+ * @param 関数のPrototypeAST(FunctionASTが所有する) 関数の行
  * @return 解析成功:FunctionAST 解析失敗:NULL
  */
-FunctionAST *Parser::visitFunctionDefinition(){
-	int bkup = Tokens->getCurIndex();
-	int line = Tokens->getCurLine();
-	PrototypeAST *proto = visitPrototype();
+FunctionAST *Parser::visitFunctionDefinition(PrototypeAST *proto, int line){
+	ProfileScope prof("function", "構文解析");
 	
-	if(!proto){
-		return NULL;
 	// ここでプロトタイプ宣言と間違いないか
 	// すでに関数定義が行われていないか確認
-	}else if(PrototypeTable.find(proto->getName()) != PrototypeTable.end() &&
-			PrototypeTable[proto->getName()] != proto->getParamNum() ||
-			FunctionTable.find(proto->getName()) != FunctionTable.end()){
+	if(PrototypeTable.find(proto->getSymbol()) != PrototypeTable.end() &&
+			PrototypeTable[proto->getSymbol()] != proto->getParamNum() ||
+			FunctionTable.find(proto->getSymbol()) != FunctionTable.end()){
 
 		CORRECT = false;
 		// エラーメッセージを出してNULLを返す
-		fprintf(stderr, "%d行目 : 関数 %s はすでに作成されています\n",  line, proto->getName().c_str());
-		SAFE_DELETE(proto);
+		printError("%d行目 : 関数 %s はすでに作成されています\n",  line, proto->getName().c_str());
 		return NULL;
 	}
 	
-	VariableTable.clear();
+	prof.setDetail(proto->getName());
+	// 関数の変数のスコープ
+	VariableTable.pushScope();
+	if(Incremental && proto->getName() == "main"){
+		for(int i = 0; i < MainVariableTable.size(); i++)
+			VariableTable.insert(MainVariableTable[i]);
+	}
 	FunctionStmtAST *func_stmt = visitFunctionStatement(proto);
+	if(func_stmt && Incremental && proto->getName() == "main")
+		MainVariableTable = VariableTable.getScopeSymbols();
+	VariableTable.popScope();
 	if(func_stmt){
 		// ここで（関数名, 引数の数）のペアを関数テーブル（Map）に追加
-		FunctionTable[proto->getName()] = proto->getParamNum();
-		return new FunctionAST(proto, func_stmt);
+		FunctionTable[proto->getSymbol()] = proto->getParamNum();
+		return Arena->create<FunctionAST>(proto, func_stmt);
 	}else{
-		SAFE_DELETE(proto);
 		Tokens->getNextStatement();
 		return NULL;
 	}
@@ -174,9 +367,6 @@ FunctionAST *Parser::visitFunctionDefinition(){
  * @return 解析成功:PrototypeAST 解析失敗:NULL;
  */
 PrototypeAST *Parser::visitPrototype(){
-	// bkup index
-	int bkup = Tokens->getCurIndex();
-
 	// parameter_list
 	bool is_first_param = true;
 	std::string func_name;
@@ -199,28 +389,25 @@ PrototypeAST *Parser::visitPrototype(){
 		func_identify = "double";
 	
 	// LEFT PAREN 
-	if(Tokens->getCurType() != TOK_SYMBOL || Tokens->getCurString() != "("){
-		if(Tokens->getCurString() == "=")
-			fprintf(stderr, "%d行目 : もしかして繰り返し構文？.\n", Tokens->getCurLine());
+	if(Tokens->getCurType() != TOK_SYMBOL || Tokens->getCurRef() != "("){
+		if(Tokens->getCurRef() == "=")
+			printError("%d行目 : もしかして繰り返し構文？.\n", Tokens->getCurLine());
 		CORRECT = false;
-		Tokens->applyTokenIndex(bkup);
 		return NULL;
 	}
 	Tokens->getNextToken();
 	
 	for(int i=0;;i++){
 		// ,
-		if (!is_first_param && Tokens->getCurType() == TOK_SYMBOL && Tokens->getCurString() == ","){
+		if (!is_first_param && Tokens->getCurType() == TOK_SYMBOL && Tokens->getCurRef() == ","){
 			Tokens->getNextToken();
 		}
 		else if(Tokens->getCurType() == TOK_IDENTIFIER){
 			// 変数は全てdouble
 			param_identify_list.push_back("double");
 			// 引数の変数名に重複がないか確認
-			if(std::find(param_list.begin(),param_list.end(), Tokens->getCurString()) != param_list.end()){
-				Tokens->applyTokenIndex(bkup);
+			if(std::find(param_list.begin(),param_list.end(), Tokens->getCurString()) != param_list.end())
 				return NULL;
-			}
 
 			param_list.push_back(Tokens->getCurString());
 			Tokens->getNextToken();
@@ -232,11 +419,10 @@ PrototypeAST *Parser::visitPrototype(){
 	}
 
 	// RIGHT PAREN
-	if(Tokens->getCurType() == TOK_SYMBOL && Tokens->getCurString() == ")"){
+	if(Tokens->getCurType() == TOK_SYMBOL && Tokens->getCurRef() == ")"){
 		Tokens->getNextToken();
-		return new PrototypeAST(func_identify, func_name, param_list, param_identify_list);
+		return Arena->create<PrototypeAST>(func_identify, func_name, param_list, param_identify_list);
 	}else{
-		Tokens->applyTokenIndex(bkup);
 		return NULL;
 	}
 }
@@ -247,216 +433,129 @@ PrototypeAST *Parser::visitPrototype(){
  * @return 解析成功:FunctionStmtAST 解析失敗:NULL;
  */
 FunctionStmtAST *Parser::visitFunctionStatement(PrototypeAST *proto){
-	int bkup = Tokens->getCurIndex();
-	if(Tokens->getCurString() == "{" || Tokens->getCurString() == "{{")
+	if(Tokens->getCurRef() == "{" || Tokens->getCurRef() == "{{")
 		Tokens->getNextToken();
 	else
 		return NULL;
 	
-	FunctionStmtAST *func_stmt = new FunctionStmtAST();
+	FunctionStmtAST *func_stmt = Arena->create<FunctionStmtAST>();
 	
 	// 引数をfunc_stmtの変数宣言リストに追加
 	for(int i = 0; i < proto->getParamNum(); i++){
-		VariableDeclAST *vdecl = new 
-			VariableDeclAST(proto->getParamName(i), proto->getParamIdentify(i));
+		VariableDeclAST *vdecl = Arena->create<
+			VariableDeclAST>(proto->getParamName(i), proto->getParamIdentify(i));
 		vdecl->setDeclType(VariableDeclAST::param);
 		func_stmt->addVariableDeclaration(vdecl);
-		VariableTable.push_back(vdecl->getName());
+		VariableTable.insert(vdecl->getSymbol());
 	}
 	
-	VariableDeclAST *var_decl;
-	BaseAST *stmt = NULL;
-	BaseAST *last = NULL;
-	// {,}を使うfor ifを格納
-	std::vector<std::tuple<std::string, int>> lastStmt;
-	std::string popStmt;
-	int popLine;
-	while(true){
-		last = stmt;
+	Enclosing.clear();
+	BlockAST *body = visitBlock(func_stmt);
+	func_stmt->setBody(body);
+	
+	if(Tokens->getCurRef() == "}" || Tokens->getCurRef() == "}}" || Tokens->getCurType() == TOK_EOF || Tokens->getCurRef() == "]]"){
+		if(Tokens->getCurRef() == "}}"){}
+		else if (Tokens->getCurRef() != "}"){
+			CORRECT = false;
+			printError("関数 %s : 関数を閉じる } が足りません.\n", proto->getName().c_str());
+		}
+		
+		BaseAST *last = body->getLastStatement();
+		if(!last || !llvm::isa<ReturnStmtAST>(last))
+			body->addStatement(Arena->create<ReturnStmtAST>(Arena->create<NumberAST>(0.0)));
+		Tokens->getNextToken();
+		return func_stmt;
+	}else{
+		return NULL;
+	}
+}
 
-		if(Tokens->getCurType() == TOK_EOF || Tokens->getCurString() == "]]"){
+/**
+ * Block用構文解析メソッド
+ * } の手前まで (関数の最後では }} , ]] , EOF の手前まで) の文を解析する
+ * if, forの中のBlockは再帰して解析する
+ * @return 解析したBlockAST
+ */
+BlockAST *Parser::visitBlock(FunctionStmtAST *func_stmt){
+	BlockAST *block = Arena->create<BlockAST>();
+	BaseAST *stmt;
+	while(true){
+		if(Tokens->getCurType() == TOK_EOF || Tokens->getCurRef() == "]]" ||
+				Tokens->getCurRef() == "}" || Tokens->getCurRef() == "}}"){
 			break;
 		}
-		// 代入式か調べて代入先が未宣言の場合宣言する
-		Tokens->getNextToken();
-		if(Tokens->getCurString() == "="){
-			Tokens->getBackToken();
+		// 代入式か調べて(1つ先読み)代入先が未宣言の場合宣言する
+		if(Tokens->peekRef(1) == "="){
 			if(Tokens->getCurType() != TOK_IDENTIFIER){
 				CORRECT = false;
-				fprintf(stderr, "%d行目 :  = の左は変数が必要です\n", 
+				printError("%d行目 :  = の左は変数が必要です\n", 
 						Tokens->getCurLine());
-				Tokens->applyTokenIndex(bkup);
-				return NULL;
+				Tokens->getNextStatement();
+				Tokens->getNextToken();
+				continue;
 			}
 			// 変数が宣言されていなかったら宣言する
-			if(std::find(VariableTable.begin(), VariableTable.end(), 
-						Tokens->getCurString()) == VariableTable.end()){
+			if(!VariableTable.contains(Tokens->getCurSymbol())){
 				VariableDeclAST *var_decl = visitVariableDeclaration();
 				var_decl->setDeclType(VariableDeclAST::local);
 				func_stmt->addVariableDeclaration(var_decl);
-				VariableTable.push_back(var_decl->getName());
+				VariableTable.insert(var_decl->getSymbol());
 			}
-		}else{
-			Tokens->getBackToken();
 		}
 
-
 		int line = Tokens->getCurLine();
-		
-		// "}"が来るか確認
-		if(Tokens->getCurString() == "}" && lastStmt.size() > 0){
-			// "}"を処理していく
-			while(Tokens->getCurString() == "}" && lastStmt.size() > 0){
-				// if for どちらの}か取得
-				popStmt = std::get<0>(lastStmt.at(lastStmt.size()-1));
-				popLine = std::get<1>(lastStmt.at(lastStmt.size()-1));
-				lastStmt.pop_back();
-				// }の次のトークンに設定
-				Tokens->getNextToken();
-				
-				line = Tokens->getCurLine();
-				
-				// elseが来た時に前にifが来ているか調べる
-				if((Tokens->getCurType() == TOK_ELSE_IF || 
-							Tokens->getCurType() == TOK_ELSE) && 
-						(popStmt == "if" || popStmt == "else if")){
-					std::string catch_token = Tokens->getCurString();
-					int catch_line = Tokens->getCurLine();
-					lastStmt.emplace_back(catch_token, catch_line);
-					stmt = visitIfStatement(func_stmt);
-					// 現在の else if, else をlastStmtへ
-					// IfStatementへ
-					if(Tokens->getCurType() == TOK_SYMBOL &&
-						       	Tokens->getCurString() == "{"){
-						Tokens->getNextToken();
-					}else{
-						CORRECT = false;
-						fprintf(stderr, "%d行目 : 条件式またはelseの後に { がありません.\n", popLine);
-						Tokens->getNextStatement();
-						stmt = NULL;
-					}
-				}
-				else if(popStmt == "if" || popStmt == "else if" || popStmt == "else"){
-					stmt = visitIfEndStatement();
-					if(Tokens->getCurType() == TOK_EOF){
-						CORRECT = false;
-						fprintf(stderr, "%d行目 : 条件式の処理の最後に } がありません.\n", popLine);
-						Tokens->getNextStatement();
-					}
-					break;
-				}
-				else if(popStmt == "for"){
-					stmt = visitForEndStatement();
-					if(Tokens->getCurType() == TOK_EOF){
-						CORRECT = false;
-						fprintf(stderr, "%d行目 : 繰り返し構文の処理の最後に } がありません.\n", popLine);
-						Tokens->getNextStatement();
-					}
-					break;
-				}
-				else
-					stmt = NULL;
-			}
-		
-		}
-		else if(Tokens->getCurString() == "}" || Tokens->getCurString() == "}}"){
-			break;
-		}else if(Tokens->getCurType() == TOK_IF && Tokens->getCurString() == "if"){
-			// {がくるか確認
-			std::string catch_token = Tokens->getCurString();
-			int catch_line = Tokens->getCurLine();
-			lastStmt.emplace_back(catch_token, catch_line);
-			stmt = visitIfStatement(func_stmt);
-			if(Tokens->getCurType() == TOK_SYMBOL && Tokens->getCurString() == "{"){
-				Tokens->getNextToken();
-			}else{
+		bool in_if = !Enclosing.empty() && llvm::isa<IfStatementAST>(Enclosing.back());
+		// 変数 = 始め..終わり { } も繰り返し構文
+		switch(isRangeStatement() ? TOK_FOR : Tokens->getCurType()){
+			case TOK_IF:
+				stmt = visitIfStatement(func_stmt);
+				break;
+
+			case TOK_ELSE_IF:
+				// 前に if がない else if (中身は読み飛ばす)
 				CORRECT = false;
-				fprintf(stderr, "%d行目 : if 条件式 の後に { がありません.\n", line);
+				if(in_if)
+					printError("%d行目 : 上の条件式が } で閉じられていません.\n", line);
+				else
+					printError("%d行目 : elif の前に ? がありません.\n", line);
+				visitIfStatement(func_stmt);
 				stmt = NULL;
-				Tokens->getNextStatement();
-			}
-		
-		}else if(Tokens->getCurType() == TOK_ELSE_IF){
-			CORRECT = false;
-			if(std::get<0>(lastStmt.at(lastStmt.size()-1)) == "if" || std::get<0>(lastStmt.at(lastStmt.size()-1)) == "else if")
-				fprintf(stderr, "%d行目 : 上の条件式が } で閉じられていません.\n", line);
-			else
-				fprintf(stderr, "%d行目 : elif の前に ? がありません.\n", line);
-			
-			stmt = visitIfStatement(func_stmt);
-			
-			if(Tokens->getCurString() != "{")
-				fprintf(stderr, "%d行目 : elif の処理を { の後に記述してください.\n", line);
-			else
-				Tokens->getNextToken();
-		}
-		else if(Tokens->getCurType() == TOK_ELSE){
-			CORRECT = false;
-			if(std::get<0>(lastStmt.at(lastStmt.size()-1)) == "if" || std::get<0>(lastStmt.at(lastStmt.size()-1)) == "else if")
-				fprintf(stderr, "%d行目 : 上の条件式が } で閉じられていません.\n", line);
-			else
-				fprintf(stderr, "%d行目 : else の前に ? がありません.\n", line);
-			
-			stmt = visitIfStatement(func_stmt);
-			
-			if(Tokens->getCurString() != "{")
-				fprintf(stderr, "%d行目 : else の処理を { の後に記述してください.\n", line);
-			else
-				Tokens->getNextToken();
-		}
-		else if(Tokens->getCurType() == TOK_FOR){
-			std::string catch_token = Tokens->getCurString();
-			int catch_line = Tokens->getCurLine();
-			lastStmt.emplace_back(catch_token, catch_line);
-			stmt = visitForStatement(func_stmt, lastStmt.size());
-			// {がくるか確認
-			if(Tokens->getCurType() == TOK_SYMBOL && Tokens->getCurString() == "{"){
-				Tokens->getNextToken();
-			}else{
+				break;
+
+			case TOK_ELSE:
 				CORRECT = false;
-				fprintf(stderr, "%d行目 : for 繰り返し数 の後に { がありません.\n", line);
-				Tokens->getNextStatement();
-			}
-		}else if(Tokens->getCurType() == TOK_BREAK){
-			stmt = visitBreakStatement();
+				if(in_if)
+					printError("%d行目 : 上の条件式が } で閉じられていません.\n", line);
+				else
+					printError("%d行目 : else の前に ? がありません.\n", line);
+				visitIfStatement(func_stmt);
+				stmt = NULL;
+				break;
 
-		}else if(Tokens->getCurType() == TOK_CONTINUE){
-			stmt = visitContinueStatement();
-			
-		}else{
-			stmt = visitStatement(func_stmt);
-			if(!stmt){
-				Tokens->getNextStatement();
-				Tokens->getNextToken();
-			}
+			case TOK_FOR:
+				stmt = visitForStatement(func_stmt);
+				break;
+
+			case TOK_BREAK:
+				stmt = visitBreakStatement();
+				break;
+
+			case TOK_CONTINUE:
+				stmt = visitContinueStatement();
+				break;
+
+			default:
+				stmt = visitStatement(func_stmt);
+				if(!stmt){
+					Tokens->getNextStatement();
+					Tokens->getNextToken();
+				}
+				break;
 		}
 		if(stmt)
-			func_stmt->addStatement(stmt);
-	}
-	
-	if(Tokens->getCurString() == "}" || Tokens->getCurString() == "}}" || Tokens->getCurType() == TOK_EOF || Tokens->getCurString() == "]]"){
-		while(lastStmt.size() != 0){
-			popStmt = std::get<0>(lastStmt.at(lastStmt.size()-1));
-                        popLine = std::get<1>(lastStmt.at(lastStmt.size()-1));
-			lastStmt.pop_back();
-			CORRECT = false;
-			fprintf(stderr, "%d行目 : 処理の最後に } がありません.\n", popLine);
-		}
-		if(Tokens->getCurString() == "}}"){}
-		else if (Tokens->getCurString() != "}"){
-			CORRECT = false;
-			fprintf(stderr, "関数 %s : 関数を閉じる } が足りません.\n", proto->getName().c_str());
-		}
-		
-		if(!last || !llvm::isa<ReturnStmtAST>(last))
-			func_stmt->addStatement(new ReturnStmtAST(new NumberAST(0.0)));
-		Tokens->getNextToken();
-		return func_stmt;
-	}else{
-		SAFE_DELETE(func_stmt);
-		SAFE_DELETE(stmt);
-		return NULL;
+			block->addStatement(stmt);
 	}
+	return block;
 }
 
 /**
@@ -465,147 +564,52 @@ FunctionStmtAST *Parser::visitFunctionStatement(PrototypeAST *proto){
  * 代入文の解析
  */
 BaseAST *Parser::visitAssignmentExpression(FunctionStmtAST *func_stmt){
-	int bkup = Tokens->getCurIndex();
-
-	BaseAST *lhs;
-	if(Tokens->getCurType() == TOK_IDENTIFIER){
-		// 変数が宣言されているか確認
-		if(std::find(VariableTable.begin(), VariableTable.end(), Tokens->getCurString()) 
-				!= VariableTable.end()){
-			lhs = new VariableAST(Tokens->getCurString());
-			Tokens->getNextToken();
-			BaseAST *rhs;
-			if(Tokens->getCurType() == TOK_SYMBOL && Tokens->getCurString() == "="){
-				Tokens->getNextToken();
-				if(rhs = visitAdditiveExpression(NULL, func_stmt))
-					return new BinaryExprAST("=", lhs, rhs, Tokens->getToken().getLine());
-				else{
-					SAFE_DELETE(lhs);
-					Tokens->getBackToken();
-					CORRECT = false;
-					fprintf(stderr, "%d行目 : = の右辺を確認してください.(上のエラーを修正することで直る場合があります)\n", Tokens->getCurLine());
-					Tokens->getNextStatement();
-					return NULL;
-				}
-			}
-			else if(Tokens->getCurType() == TOK_SYMBOL && Tokens->getCurString() == "+="){
-				Tokens->getBackToken();
-				BaseAST *mhs = new VariableAST(Tokens->getCurString());
-				Tokens->getNextToken();
+	// 宣言済みの変数の次のトークンを先読みして、代入文か式かを決める
+	if(Tokens->getCurType() == TOK_IDENTIFIER && VariableTable.contains(Tokens->getCurSymbol())){
+		llvm::StringRef assign_op = Tokens->peekRef(1);
+
+		// 変数と関数が同じ場合は関数呼び出しの式として解析する
+		if(assign_op != "("){
+			// 複合代入は 変数 = 変数 op 右辺 にする
+			BinaryOp op = BOP_ASSIGN;
+			if(assign_op == "+=")
+				op = BOP_ADD;
+			else if(assign_op == "-=")
+				op = BOP_SUB;
+			else if(assign_op == "*=")
+				op = BOP_MUL;
+			else if(assign_op == "/=")
+				op = BOP_DIV;
+			else if(assign_op == "%=")
+				op = BOP_REM;
+			else if(assign_op == "//=")
+				op = BOP_FLOOR_DIV;
+			else if(assign_op != "="){
 				Tokens->getNextToken();
-				if(rhs = visitAdditiveExpression(NULL, func_stmt)){
-					rhs = new BinaryExprAST("+", mhs, rhs, Tokens->getToken().getLine());
-					return new BinaryExprAST("=", lhs, rhs, Tokens->getToken().getLine());
-				}else{
-					SAFE_DELETE(lhs);
-					CORRECT = false;
-					fprintf(stderr, "%d行目 : += の右辺を確認してください.(上のエラ>ーを修正することで直る場合があります)\n", Tokens->getCurLine());
-					Tokens->getNextStatement();
-					return NULL;
-				}
-			}
-			else if(Tokens->getCurType() == TOK_SYMBOL && Tokens->getCurString() == "-="){
-				Tokens->getBackToken();
-				BaseAST *mhs = new VariableAST(Tokens->getCurString());
-				Tokens->getNextToken();
-				Tokens->getNextToken();
-				if(rhs = visitAdditiveExpression(NULL,func_stmt)){
-					rhs = new BinaryExprAST("-", mhs, rhs, Tokens->getToken().getLine());
-					return new BinaryExprAST("=", lhs, rhs, Tokens->getToken().getLine());
-				}else{
-					SAFE_DELETE(lhs);
-					CORRECT = false;
-					fprintf(stderr, "%d行目 : -= の右辺を確認してください.(上のエラ>ーを修正することで直る場合があります)\n", Tokens->getCurLine());
-					Tokens->getNextStatement();
-					return NULL;
-				}
-			}
-			else if(Tokens->getCurType() == TOK_SYMBOL && Tokens->getCurString() == "*="){
-				Tokens->getBackToken();
-				BaseAST *mhs = new VariableAST(Tokens->getCurString());
-				Tokens->getNextToken();
-				Tokens->getNextToken();
-				if(rhs = visitAdditiveExpression(NULL, func_stmt)){
-					rhs = new BinaryExprAST("*", mhs, rhs, Tokens->getToken().getLine());
-					return new BinaryExprAST("=", lhs, rhs, Tokens->getToken().getLine());
-				}else{
-					SAFE_DELETE(lhs);
-					CORRECT = false;
-					fprintf(stderr, "%d行目 : *= の右辺を確認してください.(上のエラ>ーを修正することで直る場合があります)\n", Tokens->getCurLine());
-					Tokens->getNextStatement();
-					return NULL;
-				}
-			}
-			else if(Tokens->getCurType() == TOK_SYMBOL && Tokens->getCurString() == "/="){
-				Tokens->getBackToken();
-				BaseAST *mhs = new VariableAST(Tokens->getCurString());
-				Tokens->getNextToken();
-				Tokens->getNextToken();
-				if(rhs = visitAdditiveExpression(NULL, func_stmt)){
-					rhs = new BinaryExprAST("/", mhs, rhs, Tokens->getToken().getLine());
-					return new BinaryExprAST("=", lhs, rhs, Tokens->getToken().getLine());
-				}else{
-					SAFE_DELETE(lhs);
-					CORRECT = false;
-					fprintf(stderr, "%d行目 : /= の右辺を確認してください.(上のエラ>ーを修正することで直る場合があります)\n", Tokens->getCurLine());
-					Tokens->getNextStatement();
-					return NULL;
-				}
-			}
-			else if(Tokens->getCurType() == TOK_SYMBOL && Tokens->getCurString() == "%="){
-				Tokens->getBackToken();
-				BaseAST *mhs = new VariableAST(Tokens->getCurString());
-				Tokens->getNextToken();
-				Tokens->getNextToken();
-				if(rhs = visitAdditiveExpression(NULL, func_stmt)){
-					rhs = new BinaryExprAST("%", mhs, rhs, Tokens->getToken().getLine());
-					return new BinaryExprAST("=", lhs, rhs, Tokens->getToken().getLine());
-				}else{
-					SAFE_DELETE(lhs);
-					CORRECT = false;
-					fprintf(stderr, "%d行目 : %%= の右辺を確認してください.(上のエラ>ーを修正することで直る場合があります)\n", Tokens->getCurLine());
-					Tokens->getNextStatement();
-					return NULL;
-				}
-			}
-			else if(Tokens->getCurType() == TOK_SYMBOL && Tokens->getCurString() == "//="){
-				Tokens->getBackToken();
-				BaseAST *mhs = new VariableAST(Tokens->getCurString());
-				Tokens->getNextToken();
-				Tokens->getNextToken();
-				if(rhs = visitAdditiveExpression(NULL, func_stmt)){
-					rhs = new BinaryExprAST("//", mhs, rhs, Tokens->getToken().getLine());
-					return new BinaryExprAST("=", lhs, rhs, Tokens->getToken().getLine());
-				}else{
-					SAFE_DELETE(lhs);
-					CORRECT = false;
-					fprintf(stderr, "%d行目 : //= の右辺を確認してください.(上のエラ>ーを修正することで直る場合があります)\n", Tokens->getCurLine());
-					Tokens->getNextStatement();
-					return NULL;
-				}
+				CORRECT = false;
+				printError("%d行目 : 式は変数に代入されていません.\n", Tokens->getCurLine());
+				Tokens->getNextStatement();
+				return NULL;
 			}
-			else{
-				// 変数と関数が同じ場合
-				if(Tokens->getCurString() == "("){
-					Tokens->getBackToken();
-				}else{
-					SAFE_DELETE(lhs);
-					CORRECT = false;
-					fprintf(stderr, "%d行目 : 式は変数に代入されていません.\n", Tokens->getCurLine());
-					Tokens->getNextStatement();
-					return NULL;
-				}
+
+			SymbolID symbol = Tokens->getCurSymbol();
+			Tokens->getNextToken();
+			Tokens->getNextToken();
+			BaseAST *rhs = visitAdditiveExpression(NULL, func_stmt);
+			if(!rhs){
+				CORRECT = false;
+				printError("%d行目 : %s の右辺を確認してください.(上のエラーを修正することで直る場合があります)\n",
+						Tokens->getCurLine(), assign_op.str().c_str());
+				Tokens->getNextStatement();
+				return NULL;
 			}
-		}else{
-			Tokens->applyTokenIndex(bkup);
+			if(op != BOP_ASSIGN)
+				rhs = Arena->create<BinaryExprAST>(op, Arena->create<VariableAST>(symbol), rhs, Tokens->getCurLine());
+			return Arena->create<BinaryExprAST>(BOP_ASSIGN, Arena->create<VariableAST>(symbol), rhs, Tokens->getCurLine());
 		}
 	}
 
-	BaseAST *add_expr = visitAdditiveExpression(NULL, func_stmt);
-	if(add_expr){
-		return add_expr;
-	}
-	return NULL;
+	return visitAdditiveExpression(NULL, func_stmt);
 }
 
 /**
@@ -613,22 +617,15 @@ BaseAST *Parser::visitAssignmentExpression(FunctionStmtAST *func_stmt){
  * @return 解析成功時: AST失敗時:NULL
  */
 BaseAST *Parser::visitPrimaryExpression(FunctionStmtAST *func_stmt){
-	// recored index
-	int bkup = Tokens->getCurIndex();
 	// 変数が宣言されていることを確認
-	// VARIABLE_IDENTIFIER
+	// VARIABLE_IDENTIFIER (次が "(" なら関数呼び出しなので PostfixExpression に任せる)
 	if(Tokens->getCurType() == TOK_IDENTIFIER){
-		Tokens->getNextToken();
-		if(Tokens->getCurString() == "("){
-			Tokens->getBackToken();
+		if(Tokens->peekRef(1) == "(")
 			return NULL;
-		}
-		Tokens->getBackToken();
-		if(std::find(VariableTable.begin(), VariableTable.end(),
-				   Tokens->getCurString()) != VariableTable.end()){
-			std::string var_name = Tokens->getCurString();
+		if(VariableTable.contains(Tokens->getCurSymbol())){
+			SymbolID var_symbol = Tokens->getCurSymbol();
 			Tokens->getNextToken();
-			return new VariableAST(var_name);
+			return Arena->create<VariableAST>(var_symbol);
 		}
 		return NULL;
 	
@@ -636,39 +633,39 @@ BaseAST *Parser::visitPrimaryExpression(FunctionStmtAST *func_stmt){
 	}else if(Tokens->getCurType() == TOK_DIGIT){
 		double val = Tokens->getCurNumVal();
 		Tokens->getNextToken();
-		return new NumberAST(val);
+		return Arena->create<NumberAST>(val);
 	
 	// string
 	}else if(Tokens->getCurType() == TOK_STR){
 		std::string str = Tokens->getCurStrVal();
 		Tokens->getNextToken();
-		return new StringAST(str);
+		return Arena->create<StringAST>(str);
 
 	// integer(-)
-	}else if(Tokens->getCurType() == TOK_SYMBOL && Tokens->getCurString() == "-"){
-		BaseAST *lhs = new NumberAST(-1);
+	}else if(Tokens->getCurType() == TOK_SYMBOL && Tokens->getCurRef() == "-"){
+		BaseAST *lhs = Arena->create<NumberAST>(-1);
 		Tokens->getNextToken();
 		BaseAST *rhs = visitPostfixExpression(func_stmt);
-		return new BinaryExprAST("*", lhs, rhs, Tokens->getCurLine());
+		return Arena->create<BinaryExprAST>(BOP_MUL, lhs, rhs, Tokens->getCurLine());
 	// (
-	}else if(Tokens->getCurType() == TOK_SYMBOL && Tokens->getCurString() == "("){
+	}else if(Tokens->getCurType() == TOK_SYMBOL && Tokens->getCurRef() == "("){
 		int line = Tokens->getCurLine();
 		Tokens->getNextToken();
 		BaseAST *lhs = visitAdditiveExpression(NULL, func_stmt);
-		if(Tokens->getCurType() == TOK_SYMBOL && Tokens->getCurString() == ")")
+		if(Tokens->getCurType() == TOK_SYMBOL && Tokens->getCurRef() == ")")
 			Tokens->getNextToken();
 		else{
 			CORRECT = false;
-			fprintf(stderr, "%d行目 : ( を使った式が ) で閉じられていません.\n", line);
+			printError("%d行目 : ( を使った式が ) で閉じられていません.\n", line);
 			Tokens->getNextStatement();
 			return NULL;
 		}
 		return lhs;
 	}
 
-	if(Tokens->getCurType() == TOK_SYMBOL && Tokens->getCurString() != ";" && Tokens->getCurString() != "{" && Tokens->getCurString() != "}"){
+	if(Tokens->getCurType() == TOK_SYMBOL && Tokens->getCurRef() != ";" && Tokens->getCurRef() != "{" && Tokens->getCurRef() != "}"){
 		CORRECT = false;
-		fprintf(stderr, "%d行目 : %s が予期せぬところに書かれています.\n", Tokens->getCurLine(), Tokens->getCurString().c_str());
+		printError("%d行目 : %s が予期せぬところに書かれています.\n", Tokens->getCurLine(), Tokens->getCurString().c_str());
 		Tokens->getNextStatement();
 	}
 	
@@ -680,8 +677,6 @@ BaseAST *Parser::visitPrimaryExpression(FunctionStmtAST *func_stmt){
  * @return 解析成功:AST 解析失敗:NULL
  */
 BaseAST *Parser::visitPostfixExpression(FunctionStmtAST *func_stmt){
-	// get index
-	int bkup = Tokens->getCurIndex();
 	int line = Tokens->getCurLine();
 	BaseAST *prim_expr = visitPrimaryExpression(func_stmt);
 	if(prim_expr)
@@ -692,23 +687,20 @@ BaseAST *Parser::visitPostfixExpression(FunctionStmtAST *func_stmt){
 	if(Tokens->getCurType() == TOK_IDENTIFIER){
 		int param_num;
 		// プロトタイプ宣言されているか確認し、引数の数をテーブルから取得
-		if(PrototypeTable.find(Tokens->getCurString()) != PrototypeTable.end() ){
-			param_num = PrototypeTable[Tokens->getCurString()];
+		if(PrototypeTable.find(Tokens->getCurSymbol()) != PrototypeTable.end() ){
+			param_num = PrototypeTable[Tokens->getCurSymbol()];
 
 		//関数定義済みであるか確認し、引数の数をテーブルから取得
-		}else if(FunctionTable.find(Tokens->getCurString()) != FunctionTable.end()){
-			param_num = FunctionTable[Tokens->getCurString()];
+		}else if(FunctionTable.find(Tokens->getCurSymbol()) != FunctionTable.end()){
+			param_num = FunctionTable[Tokens->getCurSymbol()];
 		}
 		else{
-			int bfr = Tokens->getCurIndex();
-			if(Tokens->getNextToken() && Tokens->getCurString() == "(" && Tokens->getNextToken() && Tokens->getCurString() == ")"){
-				Tokens->applyTokenIndex(bfr);
+			if(Tokens->peekRef(1) == "(" && Tokens->peekRef(2) == ")"){
 				CORRECT = false;
-				fprintf(stderr, "%d行目 : 関数 %s は宣言されていません.\n", line, Tokens->getCurString().c_str());
+				printError("%d行目 : 関数 %s は宣言されていません.\n", line, Tokens->getCurString().c_str());
 			}else{
-				Tokens->applyTokenIndex(bfr);
 				CORRECT = false;
-				fprintf(stderr, "%d行目 : 変数 %s は宣言されていません.\n", line, Tokens->getCurString().c_str());
+				printError("%d行目 : 変数 %s は宣言されていません.\n", line, Tokens->getCurString().c_str());
 			}
 			Tokens->getNextStatement();
 			return NULL;
@@ -716,10 +708,11 @@ BaseAST *Parser::visitPostfixExpression(FunctionStmtAST *func_stmt){
 
 		// 関数名取得
 		std::string Callee = Tokens->getCurString();
+		SymbolID callee_symbol = Tokens->getCurSymbol();
 		Tokens->getNextToken();
 		
 		// LEFT PAREN
-		if(Tokens->getCurType() != TOK_SYMBOL || Tokens->getCurString() != "("){
+		if(Tokens->getCurType() != TOK_SYMBOL || Tokens->getCurRef() != "("){
 			Tokens->getNextStatement();
 			return NULL;
 		}
@@ -729,18 +722,18 @@ BaseAST *Parser::visitPostfixExpression(FunctionStmtAST *func_stmt){
 		BaseAST *assign_expr = NULL;
 		// 引数を解析 print と その他
 		if(Callee == "print"){
-			while(Tokens->getCurString() != ")"){
+			while(Tokens->getCurRef() != ")"){
 				VariableAST *arg1 = NULL;
 				NumberAST *arg2 = NULL;
 				BinaryExprAST *arg3 = NULL;
 				CallExprAST *arg4 = NULL;
-				if(Tokens->getCurString() == ","){
-					assign_expr = new NewLineAST();
+				if(Tokens->getCurRef() == ","){
+					assign_expr = Arena->create<NewLineAST>();
 					Tokens->getNextToken();
 				}
 				else if(!(assign_expr = visitAdditiveExpression(NULL, func_stmt))){
 					CORRECT = false;
-					fprintf(stderr, "%d行目 : printの引数を確認してください\n", line);
+					printError("%d行目 : printの引数を確認してください\n", line);
 					Tokens->getNextStatement();
 					break;
 				}
@@ -755,7 +748,7 @@ BaseAST *Parser::visitPostfixExpression(FunctionStmtAST *func_stmt){
 					arg4 = llvm::dyn_cast<CallExprAST>(assign_expr);
 
 				if(arg1 || arg2 || arg3 || arg4){
-					if(Tokens->getCurType() == TOK_SYMBOL && Tokens->getCurString() == "\\"){
+					if(Tokens->getCurType() == TOK_SYMBOL && Tokens->getCurRef() == "\\"){
 						Tokens->getNextToken();
 						if(Tokens->getCurType() == TOK_DIGIT){
 							if(arg1)
@@ -768,13 +761,13 @@ BaseAST *Parser::visitPostfixExpression(FunctionStmtAST *func_stmt){
 								arg4->setWidth(Tokens->getCurString());
 							Tokens->getNextToken();
 						}
-						if(!(Tokens->getCurType() == TOK_SYMBOL && Tokens->getCurString() == "\\")){
+						if(!(Tokens->getCurType() == TOK_SYMBOL && Tokens->getCurRef() == "\\")){
 							CORRECT = false;
-							fprintf(stderr, "%d行目 : printの引数を確認してください\n", line);
+							printError("%d行目 : printの引数を確認してください\n", line);
 							return NULL;
 						}
 						Tokens->getNextToken();
-						if(Tokens->getCurString() == ","){
+						if(Tokens->getCurRef() == ","){
 							if(arg1)
 								arg1->setDigit("-1");
 							else if(arg2)
@@ -786,7 +779,7 @@ BaseAST *Parser::visitPostfixExpression(FunctionStmtAST *func_stmt){
 						}
 						else{
 							std::string s = "";
-							if(Tokens->getCurType() == TOK_SYMBOL && Tokens->getCurString() == "-"){
+							if(Tokens->getCurType() == TOK_SYMBOL && Tokens->getCurRef() == "-"){
 								s += Tokens->getCurString();
 								Tokens->getNextToken();
 							}
@@ -814,40 +807,40 @@ BaseAST *Parser::visitPostfixExpression(FunctionStmtAST *func_stmt){
 						assign_expr = arg4;
 				}
 				args.push_back(assign_expr);
-				if (Tokens->getCurString() == ";" || Tokens->getCurString() == "}" || Tokens->getCurString() == "{"){
+				if (Tokens->getCurRef() == ";" || Tokens->getCurRef() == "}" || Tokens->getCurRef() == "{"){
 					CORRECT = false;
-					fprintf(stderr, "%d行目 : printの末尾にカッコがありません\n", line);
+					printError("%d行目 : printの末尾にカッコがありません\n", line);
 					Tokens->getNextStatement();
 					return NULL;
 				}
-				else if(Tokens->getCurString() == ","){
+				else if(Tokens->getCurRef() == ","){
 					Tokens->getNextToken();
-					if(Tokens->getCurString() == ")")
-						args.push_back(new NewLineAST());
+					if(Tokens->getCurRef() == ")")
+						args.push_back(Arena->create<NewLineAST>());
 				}
 			}
 			if(args.size() == 0)
-				args.push_back(new NewLineAST());
+				args.push_back(Arena->create<NewLineAST>());
 		}
 		else if(Callee == "input"){
 			bool is_first = true;
-			while(is_first || Tokens->getCurType() == TOK_SYMBOL && Tokens->getCurString() == ","){
+			while(is_first || Tokens->getCurType() == TOK_SYMBOL && Tokens->getCurRef() == ","){
 				if(!is_first) Tokens->getNextToken();
 				
 				// 変数が宣言されていなかったら宣言する
 				if(Tokens->getCurType() == TOK_IDENTIFIER){
-					if(std::find(VariableTable.begin(), VariableTable.end(), Tokens->getCurString()) == VariableTable.end()){
+					if(!VariableTable.contains(Tokens->getCurSymbol())){
 						VariableDeclAST *var_decl = visitVariableDeclaration();
 						var_decl->setDeclType(VariableDeclAST::local);
 						func_stmt->addVariableDeclaration(var_decl);
-						VariableTable.push_back(var_decl->getName());
+						VariableTable.insert(var_decl->getSymbol());
 					}
-					args.push_back(new VariableAST(Tokens->getCurString()));
+					args.push_back(Arena->create<VariableAST>(Tokens->getCurSymbol()));
 					Tokens->getNextToken();
 				}
 				else{
 					CORRECT = false;
-					fprintf(stderr, "%d行目 : input の引数の %s に入力は代入できません.\n", line, Tokens->getCurString().c_str());
+					printError("%d行目 : input の引数の %s に入力は代入できません.\n", line, Tokens->getCurString().c_str());
 					Tokens->getNextStatement();
 					return NULL;
 				}
@@ -856,13 +849,13 @@ BaseAST *Parser::visitPostfixExpression(FunctionStmtAST *func_stmt){
 			}
 		}
 		else{
-			if(Tokens->getCurString() != ")" && (assign_expr = visitAdditiveExpression(NULL, func_stmt))){
+			if(Tokens->getCurRef() != ")" && (assign_expr = visitAdditiveExpression(NULL, func_stmt))){
 				args.push_back(assign_expr);
 				// ","が続く限り繰り返し
-				while(Tokens->getCurType() == TOK_SYMBOL && Tokens->getCurString() == ","){
+				while(Tokens->getCurType() == TOK_SYMBOL && Tokens->getCurRef() == ","){
 					Tokens->getNextToken();
 					// IDENTIFIER
-					if(Tokens->getCurString() != ")" && (assign_expr = visitAdditiveExpression(NULL, func_stmt)))
+					if(Tokens->getCurRef() != ")" && (assign_expr = visitAdditiveExpression(NULL, func_stmt)))
 						args.push_back(assign_expr);
 					else
 						break;
@@ -871,25 +864,19 @@ BaseAST *Parser::visitPostfixExpression(FunctionStmtAST *func_stmt){
 		}
 		// 引数の数を確認(変数の数に指定のないprint関数は除く)
 		if(Callee != "print" && Callee != "input" && args.size() != param_num){
-			for(int i=0;i<args.size();i++){
-				SAFE_DELETE(args[i]);
-			}
 			CORRECT = false;
-			fprintf(stderr, "%d行目 : 関数 %s の引数の数が合いません.\n", line, Callee.c_str());
+			printError("%d行目 : 関数 %s の引数の数が合いません.\n", line, Callee.c_str());
 			Tokens->getNextStatement();
 			return NULL;
 		}
 		
 		// Right PaLen
-		if(Tokens->getCurType() == TOK_SYMBOL && Tokens->getCurString() == ")"){
+		if(Tokens->getCurType() == TOK_SYMBOL && Tokens->getCurRef() == ")"){
 			Tokens->getNextToken();
-			return new CallExprAST(Callee,args);
+			return Arena->create<CallExprAST>(Callee,callee_symbol,args);
 		}else{
-			for(int i=0;i<args.size();i++){
-				SAFE_DELETE(args[i]);
-			}
 			CORRECT = false;
-			fprintf(stderr, "%d行目 : 関数 %s の呼び出しに失敗しました.\n", line, Callee.c_str());
+			printError("%d行目 : 関数 %s の呼び出しに失敗しました.\n", line, Callee.c_str());
 			Tokens->getNextStatement();
 			return NULL;
 		}
@@ -904,42 +891,38 @@ BaseAST *Parser::visitPostfixExpression(FunctionStmtAST *func_stmt){
  * @return 解析成功:AST 解析失敗:NULL
  */
 BaseAST *Parser::visitAdditiveExpression(BaseAST *lhs, FunctionStmtAST *func_stmt){
-	// bkup index
-	int bkup = Tokens->getCurIndex();
 	int line = Tokens->getCurLine();
 	if(!lhs)
 		lhs = visitMultiplicativeExpression(NULL, func_stmt);
 	if(!lhs)
 		return NULL;
-	if(Tokens->getCurType() == TOK_SYMBOL && Tokens->getCurString() == ")")
+	if(Tokens->getCurType() == TOK_SYMBOL && Tokens->getCurRef() == ")")
 		return lhs;
 
 	BaseAST *rhs;
 	// +
-	if(Tokens->getCurType() == TOK_SYMBOL && Tokens->getCurString() == "+"){
+	if(Tokens->getCurType() == TOK_SYMBOL && Tokens->getCurRef() == "+"){
 		Tokens->getNextToken();
 		rhs = visitMultiplicativeExpression(NULL, func_stmt);
 		if(rhs){
 			return visitAdditiveExpression(
-					new BinaryExprAST("+", lhs, rhs, line), func_stmt);
+					Arena->create<BinaryExprAST>(BOP_ADD, lhs, rhs, line), func_stmt);
 		}else{
 			CORRECT = false;
-			fprintf(stderr, "%d行目 : 式を確認してください.\n", Tokens->getCurLine());
-			SAFE_DELETE(lhs);
+			printError("%d行目 : 式を確認してください.\n", Tokens->getCurLine());
 			Tokens->getNextStatement();
 			return NULL;
 		}
 	
 	// -
-	}else if(Tokens->getCurType() == TOK_SYMBOL && Tokens->getCurString() == "-"){
+	}else if(Tokens->getCurType() == TOK_SYMBOL && Tokens->getCurRef() == "-"){
 		Tokens->getNextToken();
 		rhs = visitMultiplicativeExpression(NULL, func_stmt);
 		if(rhs){
-			return visitAdditiveExpression(new BinaryExprAST("-", lhs, rhs, line),func_stmt);
+			return visitAdditiveExpression(Arena->create<BinaryExprAST>(BOP_SUB, lhs, rhs, line),func_stmt);
 		}else{
 			CORRECT = false;
-			fprintf(stderr, "%d行目 : 式を確認してください.\n", Tokens->getCurLine());
-			SAFE_DELETE(lhs);
+			printError("%d行目 : 式を確認してください.\n", Tokens->getCurLine());
 			Tokens->getNextStatement();
 			return NULL;
 		}
@@ -955,17 +938,17 @@ BaseAST *Parser::visitExpressionStatement(FunctionStmtAST *func_stmt){
 	BaseAST *assign_expr;
 
 	// NULL Expression
-	if(Tokens->getCurString() == ";"){
+	if(Tokens->getCurRef() == ";"){
 		Tokens->getNextToken();
-		return new NullExprAST();
+		return Arena->create<NullExprAST>();
 	}else if(assign_expr = visitAssignmentExpression(func_stmt)){
-		if(Tokens->getCurString() == ";"){
+		if(Tokens->getCurRef() == ";"){
 			Tokens->getNextToken();
 			return assign_expr;
 		}
 		else{
 			CORRECT = false;
-			fprintf(stderr, "%d行目 : %s が予期せぬところにあります.\n", Tokens->getCurLine(), Tokens->getCurString().c_str());
+			printError("%d行目 : %s が予期せぬところにあります.\n", Tokens->getCurLine(), Tokens->getCurString().c_str());
 			Tokens->getNextStatement();
 		}
 	}
@@ -977,15 +960,14 @@ BaseAST *Parser::visitExpressionStatement(FunctionStmtAST *func_stmt){
  * @return 解析成功:AST 解析失敗:NULL
  */
 BaseAST *Parser::visitStatement(FunctionStmtAST *func_stmt){
-	BaseAST *stmt = NULL;
-	if(stmt = visitReturnStatement(func_stmt)){
-		return stmt;
-	}else if(stmt = visitGlobalStatement(func_stmt)){
-		return stmt;
-	}else if(stmt = visitExpressionStatement(func_stmt)){
-		return stmt;
-	}else{
-		return NULL;
+	// 先頭のトークンの種類で文の種類が決まる
+	switch(Tokens->getCurType()){
+		case TOK_RETURN:
+			return visitReturnStatement(func_stmt);
+		case TOK_GLOBAL:
+			return visitGlobalStatement(func_stmt);
+		default:
+			return visitExpressionStatement(func_stmt);
 	}
 }
 
@@ -994,19 +976,18 @@ BaseAST *Parser::visitStatement(FunctionStmtAST *func_stmt){
  * @return 解析成功:VariableeclAST 解析失敗:NULL
  */
 VariableDeclAST *Parser::visitVariableDeclaration(){
-	std::string name;
+	SymbolID symbol;
 	std::string identify;
 
 	identify = "double";
 
 	if(Tokens->getCurType() == TOK_IDENTIFIER){
-		name = Tokens->getCurString();
+		symbol = Tokens->getCurSymbol();
 	}else{
-		Tokens->ungetToken(1);
 		return NULL;
 	}
 	
-	return new VariableDeclAST(name, identify);
+	return Arena->create<VariableDeclAST>(symbol, identify);
 }
 
 /**
@@ -1014,9 +995,8 @@ VariableDeclAST *Parser::visitVariableDeclaration(){
  * @return 解析成功:GlobalVariableAST 解析失敗:NULL
  */
 BaseAST *Parser::visitGlobalStatement(FunctionStmtAST *func_stmt){
-	int bkup = Tokens->getCurIndex();
 	int line = Tokens->getCurLine();
-	std::string Name;
+	SymbolID symbol;
 	
 	if(Tokens->getCurType() == TOK_GLOBAL)
 		Tokens->getNextToken();
@@ -1024,34 +1004,31 @@ BaseAST *Parser::visitGlobalStatement(FunctionStmtAST *func_stmt){
 		return NULL;
 	
 	if(Tokens->getCurType() == TOK_IDENTIFIER)
-		Name = Tokens->getCurString();
+		symbol = Tokens->getCurSymbol();
 	else{
 		CORRECT = false;
-		fprintf(stderr, "global の後は変数名である必要があります.\n");
-		Tokens->applyTokenIndex(bkup);
+		printError("global の後は変数名である必要があります.\n");
 		return NULL;
 	}
 
-	if(std::find(VariableTable.begin(), VariableTable.end(), Name) == VariableTable.end())
-		VariableTable.push_back(Name);
+	if(!VariableTable.contains(symbol))
+		VariableTable.insert(symbol);
 	else{
 		CORRECT = false;
-		fprintf(stderr, "global の後の変数が関数内の変数と被っています.\n");
-		Tokens->applyTokenIndex(bkup);
+		printError("global の後の変数が関数内の変数と被っています.\n");
 		return NULL;
 	}
 	Tokens->getNextToken();
-	if(Tokens->getCurString() == ";")
+	if(Tokens->getCurRef() == ";")
 		Tokens->getNextToken();
 	else{
 		CORRECT = false;
-		fprintf(stderr, "global 変数名 の後は ; である必要があります.\n");
-		Tokens->applyTokenIndex(bkup);
+		printError("global 変数名 の後は ; である必要があります.\n");
 		return NULL;
 	}
 
-	func_stmt->addGlobalVariables(Name);
-	return new GlobalVariableAST(Name, line);
+	func_stmt->addGlobalVariables(symbol);
+	return Arena->create<GlobalVariableAST>(symbol, line);
 }
 
 /**
@@ -1059,7 +1036,6 @@ BaseAST *Parser::visitGlobalStatement(FunctionStmtAST *func_stmt){
  * @return 解析成功:AST 解析失敗:NULL
  */
 BaseAST *Parser::visitMultiplicativeExpression(BaseAST *lhs, FunctionStmtAST *func_stmt){
-	int bkup = Tokens->getCurIndex();
 	int line = Tokens->getCurLine();
 	if(!lhs){
 		lhs = visitPostfixExpression(func_stmt);
@@ -1069,50 +1045,26 @@ BaseAST *Parser::visitMultiplicativeExpression(BaseAST *lhs, FunctionStmtAST *fu
 		return NULL;
 	}
 
-	if(Tokens->getCurType() == TOK_SYMBOL && Tokens->getCurString() == "*"){
-		Tokens->getNextToken();
-		rhs = visitPostfixExpression(func_stmt);
-		if(rhs){
-			return visitMultiplicativeExpression(new BinaryExprAST("*", lhs, rhs, line), func_stmt);
-		}else{
-			SAFE_DELETE(lhs);
-			Tokens->applyTokenIndex(bkup);
-			return NULL;
-		}
-	}else if(Tokens->getCurType() == TOK_SYMBOL && Tokens->getCurString() == "/"){
-		Tokens->getNextToken();
-		rhs = visitPostfixExpression(func_stmt);
-		if(rhs){
-			return visitMultiplicativeExpression(new BinaryExprAST("/", lhs, rhs, line), func_stmt);
-		}else{
-			SAFE_DELETE(lhs);
-			Tokens->applyTokenIndex(bkup);
-			return NULL;
-		}
-	}
-	else if(Tokens->getCurType() == TOK_SYMBOL && Tokens->getCurString() == "//"){
-		Tokens->getNextToken();
-		rhs = visitPostfixExpression(func_stmt);
-		if(rhs){
-			return visitMultiplicativeExpression(new BinaryExprAST("//", lhs, rhs, line), func_stmt);
-		}else{
-			SAFE_DELETE(lhs);
-			Tokens->applyTokenIndex(bkup);
-			return NULL;
-		}
-	}
-	else if(Tokens->getCurType() == TOK_SYMBOL && Tokens->getCurString() == "%"){
-		Tokens->getNextToken();
-		rhs = visitPostfixExpression(func_stmt);
-		if(rhs){
-			return visitMultiplicativeExpression(new BinaryExprAST("%", lhs, rhs, line), func_stmt);
-		}else{
-			SAFE_DELETE(lhs);
-			Tokens->applyTokenIndex(bkup);
-			return NULL;
-		}
-	}
-	return lhs;
+	// * / // %
+	BinaryOp op;
+	if(Tokens->getCurType() != TOK_SYMBOL)
+		return lhs;
+	else if(Tokens->getCurRef() == "*")
+		op = BOP_MUL;
+	else if(Tokens->getCurRef() == "/")
+		op = BOP_DIV;
+	else if(Tokens->getCurRef() == "//")
+		op = BOP_FLOOR_DIV;
+	else if(Tokens->getCurRef() == "%")
+		op = BOP_REM;
+	else
+		return lhs;
+
+	Tokens->getNextToken();
+	rhs = visitPostfixExpression(func_stmt);
+	if(!rhs)
+		return NULL;
+	return visitMultiplicativeExpression(Arena->create<BinaryExprAST>(op, lhs, rhs, line), func_stmt);
 }
 
 /**
@@ -1120,25 +1072,21 @@ BaseAST *Parser::visitMultiplicativeExpression(BaseAST *lhs, FunctionStmtAST *fu
  * @return 解析成功:ReturnStmtAST 解析失敗:NULL
  */
 BaseAST *Parser::visitReturnStatement(FunctionStmtAST *func_stmt){
-	int bkup = Tokens->getCurIndex();
 	int line = Tokens->getCurLine();
 	BaseAST *expr;
 
 	if(Tokens->getCurType() == TOK_RETURN){
 		Tokens->getNextToken();
 		expr = visitAdditiveExpression(NULL, func_stmt);
-		if(!expr || llvm::isa<NullExprAST>(expr)){
-			Tokens->applyTokenIndex(bkup);
+		if(!expr || llvm::isa<NullExprAST>(expr))
 			return NULL;
-		}
 
-		if(Tokens->getCurString() == ";"){
+		if(Tokens->getCurRef() == ";"){
 			Tokens->getNextToken();
-			return new ReturnStmtAST(expr);
+			return Arena->create<ReturnStmtAST>(expr);
 		}else{
 			CORRECT = false;
-			fprintf(stderr, "%d行目 : ; がありません.\n", line);
-			Tokens->applyTokenIndex(bkup);
+			printError("%d行目 : ; がありません.\n", line);
 			return NULL;
 		}
 	}else{
@@ -1149,43 +1097,95 @@ BaseAST *Parser::visitReturnStatement(FunctionStmtAST *func_stmt){
 /**
  * IfStatement用解析メソッド
  * if(式 and or 式){}の形
+ * } の後に else if, else が続けば、次の節として続けて解析する
  * @return 解析成功：IfStmtAST 解析失敗：NULL
  */
 BaseAST *Parser::visitIfStatement(FunctionStmtAST *func_stmt){
-	int bkup = Tokens->getCurIndex();
 	int line = Tokens->getCurLine();
-	std::string name = Tokens->getCurString();
-	IfStatementAST *if_expr = new IfStatementAST();
-	if_expr->setIf(name);
+	IfKind kind;
+	if(Tokens->getCurType() == TOK_ELSE_IF)
+		kind = IF_ELSE_IF;
+	else if(Tokens->getCurType() == TOK_ELSE)
+		kind = IF_ELSE;
+	else
+		kind = IF_IF;
+	IfStatementAST *if_expr = Arena->create<IfStatementAST>(kind);
 	Tokens->getNextToken();
-	
+
+	bool is_valid = kind == IF_ELSE || visitIfCondition(if_expr, func_stmt);
+
+	// {がくるか確認 (なくても } までをこの節の文とする)
+	if(Tokens->getCurType() == TOK_SYMBOL && Tokens->getCurRef() == "{"){
+		Tokens->getNextToken();
+	}else{
+		CORRECT = false;
+		if(kind == IF_IF)
+			printError("%d行目 : if 条件式 の後に { がありません.\n", line);
+		else
+			printError("%d行目 : 条件式またはelseの後に { がありません.\n", line);
+		Tokens->getNextStatement();
+		is_valid = false;
+	}
+
+	Enclosing.push_back(if_expr);
+	if_expr->setThen(visitBlock(func_stmt));
+	Enclosing.pop_back();
+
+	if(Tokens->getCurRef() != "}"){
+		CORRECT = false;
+		printError("%d行目 : 処理の最後に } がありません.\n", line);
+		return NULL;
+	}
+	Tokens->getNextToken();
+
+	// else if, elseを次の節としてつなぐ
+	if(kind != IF_ELSE && 
+			(Tokens->getCurType() == TOK_ELSE_IF || Tokens->getCurType() == TOK_ELSE)){
+		BaseAST *else_stmt = visitIfStatement(func_stmt);
+		if(else_stmt)
+			if_expr->setElse(llvm::dyn_cast<IfStatementAST>(else_stmt));
+		else
+			is_valid = false;
+	}else if(Tokens->getCurType() == TOK_EOF){
+		CORRECT = false;
+		printError("%d行目 : 条件式の処理の最後に } がありません.\n", line);
+	}
+
+	return is_valid ? if_expr : NULL;
+}
+
+/**
+ * ifの条件式用解析メソッド
+ * 比較を and or でつないだ式 ( [ ] で優先度を指定) を { の手前まで解析する
+ * @param 条件式を追加するIfStatementAST
+ * @return 解析成功:true 解析失敗:false
+ */
+bool Parser::visitIfCondition(IfStatementAST *if_expr, FunctionStmtAST *func_stmt){
+	int line = Tokens->getCurLine();
 	int depth = 0;
 
-	if(name == "else")
-		return if_expr;
-		
 	// 条件式を見ていく
 	bool is_first = true;
 	BaseAST *lhs;
-	std::string op;
+	CompareOp op;
 	BaseAST *rhs;
 	ComparisonAST *com;
-	while(Tokens->getCurString() != "{"){
+	while(Tokens->getCurRef() != "{"){
 		if(!is_first){
 			if(Tokens->getCurType() == TOK_AND || Tokens->getCurType() == TOK_OR){
-				if_expr->addOp(Tokens->getCurString());
+				if_expr->addOp(Tokens->getCurType() == TOK_AND ? LOGICAL_AND : LOGICAL_OR);
 				Tokens->getNextToken();
 				if_expr->addDepth(depth);
 			}
 			else{
 				CORRECT = false;
-				fprintf(stderr, "%d行目 : 条件式の結合が %s でされています.\n", line, Tokens->getCurString().c_str());
+				printError("%d行目 : 条件式の結合が %s でされています.\n", line, Tokens->getCurString().c_str());
 				Tokens->getNextStatement();
-				return NULL;
+				return false;
 			}
 		}
 			
-		while(Tokens->getCurType() == TOK_SYMBOL && Tokens->getCurString() == "["){
+		while(Tokens->getCurType() == TOK_SYMBOL && Tokens->getCurRef() == "["){
 			depth += 1;
 			Tokens->getNextToken();
 		}
@@ -1193,47 +1193,58 @@ BaseAST *Parser::visitIfStatement(FunctionStmtAST *func_stmt){
 		lhs = visitAdditiveExpression(NULL, func_stmt);
 		if(!lhs || llvm::isa<NullExprAST>(lhs)){
 			CORRECT = false;
-			fprintf(stderr, "%d行目 : 条件式を確認してください.\n", line);
+			printError("%d行目 : 条件式を確認してください.\n", line);
 			Tokens->getNextToken();
-			return NULL;
+			return false;
 		}
 
 		// 比較方法を取得
-		if(Tokens->getCurType() == TOK_SYMBOL && 
-				(Tokens->getCurString() == "==" ||
-				 Tokens->getCurString() == "!=" ||
-				 Tokens->getCurString() == "<"  ||
-				 Tokens->getCurString() == ">"  ||
-				 Tokens->getCurString() == ">=" ||
-				 Tokens->getCurString() == "<=")){
-			op = Tokens->getCurString();
+		bool is_comparison = Tokens->getCurType() == TOK_SYMBOL;
+		if(is_comparison){
+			llvm::StringRef str = Tokens->getCurRef();
+			if(str == "==")
+				op = CMP_EQ;
+			else if(str == "!=")
+				op = CMP_NE;
+			else if(str == "<")
+				op = CMP_LT;
+			else if(str == ">")
+				op = CMP_GT;
+			else if(str == "<=")
+				op = CMP_LE;
+			else if(str == ">=")
+				op = CMP_GE;
+			else
+				is_comparison = false;
+		}
+		if(is_comparison){
 			Tokens->getNextToken();
 		}else{
 			CORRECT = false;
-			fprintf(stderr, "%d行目 : 条件式内で %s を条件としています.\n", line, Tokens->getCurString().c_str());
+			printError("%d行目 : 条件式内で %s を条件としています.\n", line, Tokens->getCurString().c_str());
 			Tokens->getNextStatement();
-			return NULL;
+			return false;
 		}
 
 		// 条件式の右辺を取得
 		rhs = visitAdditiveExpression(NULL, func_stmt);
 		if(!rhs || llvm::isa<NullExprAST>(rhs)){
 			CORRECT = false;
-			fprintf(stderr, "%d行目 : 条件式内を確認してください.\n", line);
+			printError("%d行目 : 条件式内を確認してください.\n", line);
 			Tokens->getNextStatement();
-			return NULL;
+			return false;
 		}
 				
 		// 条件式追加
-		com = new ComparisonAST(op, lhs, rhs);
+		com = Arena->create<ComparisonAST>(op, lhs, rhs);
 		if(!com){
 			Tokens->getNextStatement();
-			return NULL;
+			return false;
 		}
 		
 		// )を確認する
 		//Tokens->getBackToken();
-		while(Tokens->getCurType() == TOK_SYMBOL && Tokens->getCurString() == "]"){
+		while(Tokens->getCurType() == TOK_SYMBOL && Tokens->getCurRef() == "]"){
 			depth -= 1;
 			Tokens->getNextToken();
 		}
@@ -1244,69 +1255,156 @@ BaseAST *Parser::visitIfStatement(FunctionStmtAST *func_stmt){
 	
 	if(depth != 0){
 		CORRECT = false;
-		fprintf(stderr, "%d行目 : 真偽値の () を確認してください.\n", line);
-		SAFE_DELETE(if_expr);
-		return NULL;
+		printError("%d行目 : 真偽値の () を確認してください.\n", line);
+		return false;
 	}
 
-	return if_expr;
+	return true;
 }
 
 /**
- ** IfEndStatement用解析メソッド
- ** @return 解析成功：IfEndAST 解析失敗：NULL
+ * 変数 = 始め..終わり の範囲の繰り返し構文か先読みして判定する
+ * @return 範囲の繰り返し構文:true それ以外:false
  */
-BaseAST *Parser::visitIfEndStatement(){
-	return new IfEndAST();
+bool Parser::isRangeStatement(){
+	if(Tokens->getCurType() != TOK_IDENTIFIER || Tokens->peekRef(1) != "=")
+		return false;
+	for(int k = 2; Tokens->peekType(k) != TOK_EOF; k++){
+		llvm::StringRef str = Tokens->peekRef(k);
+		if(str == ".." || str == "..<")
+			return true;
+		if(str == ";" || str == "{" || str == "}")
+			return false;
+	}
+	return false;
 }
 
 /**
  * ForStatement用解析メソッド
+ * for 繰り返し数 { } と 変数 = 始め..終わり step 増分 { } の形 (繰り返す文まで解析する)
+ * (繰り返し変数は呼び出し元で宣言しておく)
  * @return 解析成功:ForStatementAST 解析失敗:NULL
  */
-ForStatementAST *Parser::visitForStatement(FunctionStmtAST *func_stmt, int id){
-	int bkup = Tokens->getCurIndex();
-		
-	// エラー検出のためforを表すTokenのつぎへ
-	while(Tokens->getCurType() == TOK_FOR)
+ForStatementAST *Parser::visitForStatement(FunctionStmtAST *func_stmt){
+	int line = Tokens->getCurLine();
+	// 繰り返し回数は変数にせず、コード生成で誘導変数を作る
+	VariableAST *val = NULL;
+	BaseAST *start_expr = NULL;
+	BaseAST *end_expr;
+	int64_t step = 1;
+	bool exclusive = false;
+	ForStatementAST *for_expr;
+
+	if(Tokens->getCurType() == TOK_IDENTIFIER){
+		// 変数 = 始め..
+		val = Arena->create<VariableAST>(Tokens->getCurSymbol());
 		Tokens->getNextToken();
-	// 変数名取得
-	std::string val_name;
-	BaseAST *start_expr = new NumberAST(1);
-	BaseAST *end_expr = new NumberAST(0);
-	VariableAST *val;
-	BinaryExprAST *bin_expr;
-	
-	// 繰り返し回数のカウント
-	std::string count_id = "count__________count" + std::to_string(id);
-	if (std::find(VariableTable.begin(), VariableTable.end(), count_id) == VariableTable.end()){
-		VariableDeclAST *var_decl = new VariableDeclAST(count_id, "double");
-		var_decl->setDeclType(VariableDeclAST::local);
-		func_stmt->addVariableDeclaration(var_decl);
-		VariableTable.push_back(var_decl->getName());
+		Tokens->getNextToken();
+		start_expr = visitAdditiveExpression(NULL, func_stmt);
+		if(!start_expr || llvm::isa<NullExprAST>(start_expr) ||
+				(Tokens->getCurRef() != ".." && Tokens->getCurRef() != "..<")){
+			CORRECT = false;
+			printError("%d行目 : 範囲の始めの値を確認してください.\n", line);
+			start_expr = Arena->create<NumberAST>(0);
+			while(Tokens->getCurType() != TOK_EOF && Tokens->getCurRef() != ".." && Tokens->getCurRef() != "..<" &&
+					Tokens->getCurRef() != "{" && Tokens->getCurRef() != ";" && Tokens->getCurRef() != "}")
+				Tokens->getNextToken();
+		}
+		if(Tokens->getCurRef() == ".." || Tokens->getCurRef() == "..<"){
+			exclusive = Tokens->getCurRef() == "..<";
+			Tokens->getNextToken();
+		}
+	}
+	else{
+		// エラー検出のためforを表すTokenのつぎへ
+		while(Tokens->getCurType() == TOK_FOR)
+			Tokens->getNextToken();
 	}
-	val = new VariableAST(count_id);
 
 	// 繰り返しの終わりの値を取得
 	end_expr = visitAdditiveExpression(NULL, func_stmt);
 	if(!end_expr || llvm::isa<NullExprAST>(end_expr)){
 		if(!end_expr){
 			CORRECT = false;
-			fprintf(stderr, "%d行目 : for 繰り返し回数 でなければいけません\n", Tokens->getCurLine());
+			if(val)
+				printError("%d行目 : 範囲の終わりの値を確認してください.\n", Tokens->getCurLine());
+			else
+				printError("%d行目 : for 繰り返し回数 でなければいけません\n", Tokens->getCurLine());
+		}
+		end_expr = Arena->create<NumberAST>(0);
+	}
+
+	// step 増分 (0以外の整数の定数, 小数に正確に表せる絶対値2^53まで)
+	if(val && Tokens->getCurType() == TOK_IDENTIFIER && Tokens->getCurRef() == "step"){
+		Tokens->getNextToken();
+		int sign = 1;
+		if(Tokens->getCurType() == TOK_SYMBOL && Tokens->getCurRef() == "-"){
+			sign = -1;
+			Tokens->getNextToken();
+		}
+		double value = Tokens->getCurNumVal();
+		// 整数か確かめる前に範囲を確かめる (範囲外の値をint64_tにするのは未定義動作)
+		if(Tokens->getCurType() == TOK_DIGIT && value > 9007199254740992.0){
+			CORRECT = false;
+			printError("%d行目 : step が大きすぎます (絶対値は 9007199254740992 以下).\n", Tokens->getCurLine());
 		}
-		bin_expr = new BinaryExprAST("=", val, start_expr, Tokens->getCurLine());
-		return new ForStatementAST(val, bin_expr, new NumberAST(0));
+		else if(Tokens->getCurType() != TOK_DIGIT || value == 0 || value != (int64_t)value){
+			CORRECT = false;
+			printError("%d行目 : step は0以外の整数でなければいけません.\n", Tokens->getCurLine());
+		}
+		else
+			step = sign * (int64_t)value;
+		if(Tokens->getCurType() == TOK_DIGIT)
+			Tokens->getNextToken();
 	}
-	bin_expr = new BinaryExprAST("=", val, start_expr, Tokens->getCurLine());
-	return new ForStatementAST(val, bin_expr, end_expr);
+
+	if(val)
+		for_expr = Arena->create<ForStatementAST>(val, start_expr, end_expr, step, exclusive);
+	else
+		for_expr = Arena->create<ForStatementAST>(end_expr);
+
+	// {がくるか確認 (なくても } までを繰り返す文とする)
+	if(Tokens->getCurType() == TOK_SYMBOL && Tokens->getCurRef() == "{"){
+		Tokens->getNextToken();
+	}else{
+		CORRECT = false;
+		if(val)
+			printError("%d行目 : 範囲の後に { がありません.\n", line);
+		else
+			printError("%d行目 : for 繰り返し数 の後に { がありません.\n", line);
+		Tokens->getNextStatement();
+	}
+
+	Enclosing.push_back(for_expr);
+	for_expr->setBody(visitBlock(func_stmt));
+	Enclosing.pop_back();
+
+	if(Tokens->getCurRef() != "}"){
+		CORRECT = false;
+		printError("%d行目 : 処理の最後に } がありません.\n", line);
+		return for_expr;
+	}
+	Tokens->getNextToken();
+	if(Tokens->getCurType() == TOK_EOF){
+		CORRECT = false;
+		printError("%d行目 : 繰り返し構文の処理の最後に } がありません.\n", line);
+	}
+	return for_expr;
 }
 
 /**
- * ForEndStatement用解析メソッド
- * @return ForEndAST
+ * break, continue の飛び先の繰り返し構文を探す
+ * @param 何個外のforか (1なら一番内側)
+ * @return 見つかった:ForStatementAST 見つからない:NULL
  */
-BaseAST *Parser::visitForEndStatement(){
-	return new ForEndAST();
+ForStatementAST *Parser::findEnclosingLoop(int depth){
+	for(int i = Enclosing.size()-1; i >= 0; i--){
+		if(!llvm::isa<ForStatementAST>(Enclosing[i]))
+			continue;
+		if(--depth == 0)
+			return llvm::dyn_cast<ForStatementAST>(Enclosing[i]);
+	}
+	return NULL;
 }
 
 /**
@@ -1314,17 +1412,16 @@ BaseAST *Parser::visitForEndStatement(){
  * @return BreakAST or NULL
  */
 BaseAST *Parser::visitBreakStatement(){
-	int bkup = Tokens->getCurIndex();
 	int line = Tokens->getCurLine();
 	int to = 1;
 	Tokens->getNextToken();
-	if(Tokens->getCurType() == TOK_SYMBOL && Tokens->getCurString() == "("){
+	if(Tokens->getCurType() == TOK_SYMBOL && Tokens->getCurRef() == "("){
 		Tokens->getNextToken();
 		if(Tokens->getCurType() == TOK_DIGIT){
 			to = std::stoi(Tokens->getCurString());
 			if(to <= 0){
 				CORRECT = false;
-				fprintf(stderr, "%d行目 : break( の後の数字は1以上です\n", line);
+				printError("%d行目 : break( の後の数字は1以上です\n", line);
 				Tokens->getNextStatement();
 				return NULL;
 			}
@@ -1332,29 +1429,35 @@ BaseAST *Parser::visitBreakStatement(){
 		}
 		else{
 			CORRECT = false;
-			fprintf(stderr, "%d行目 : break( の次は数字でなければいけません", Tokens->getCurLine());
+			printError("%d行目 : break( の次は数字でなければいけません", Tokens->getCurLine());
 			Tokens->getNextStatement();
 			return NULL;
 		}
-		if(Tokens->getCurType() == TOK_SYMBOL && Tokens->getCurString() == ")")
+		if(Tokens->getCurType() == TOK_SYMBOL && Tokens->getCurRef() == ")")
 			Tokens->getNextToken();
 		else{
 			CORRECT = false;
-			fprintf(stderr, "%d行目 : break(数字　の次は ) でなければいけません", Tokens->getCurLine());
+			printError("%d行目 : break(数字　の次は ) でなければいけません", Tokens->getCurLine());
 			Tokens->getNextStatement();
 			return NULL;
 		}
 	}
 
-	if(Tokens->getCurString() == ";")
+	if(Tokens->getCurRef() == ";")
 		Tokens->getNextToken();
 	else{
 		CORRECT = false;
-		fprintf(stderr, "%d行目 : break() と異なります.\n", line);
+		printError("%d行目 : break() と異なります.\n", line);
 		Tokens->getNextStatement();
 		return NULL;
 	}
-	return new BreakAST(to);
+	ForStatementAST *target = findEnclosingLoop(to);
+	if(!target){
+		CORRECT = false;
+		printError("%d行目 : break文のカッコの中の数を確認してください.\n", line);
+		return NULL;
+	}
+	return Arena->create<BreakAST>(to, target);
 }
 
 /**
@@ -1362,18 +1465,17 @@ BaseAST *Parser::visitBreakStatement(){
  * @return ContinueAST or NULL
  */
 BaseAST *Parser::visitContinueStatement(){
-	int bkup = Tokens->getCurIndex();
 	int line = Tokens->getCurLine();
 
 	int to = 1;
 	Tokens->getNextToken();
-	if(Tokens->getCurType() == TOK_SYMBOL && Tokens->getCurString() == "("){
+	if(Tokens->getCurType() == TOK_SYMBOL && Tokens->getCurRef() == "("){
 		Tokens->getNextToken();
 		if(Tokens->getCurType() == TOK_DIGIT){
 			to = std::stoi(Tokens->getCurString());
 			if(to <= 0){
 				CORRECT = false;
-				fprintf(stderr, "%d行目 : continue( の後の数字は1以上です\n", line);
+				printError("%d行目 : continue( の後の数字は1以上です\n", line);
 				Tokens->getNextStatement();
 				return NULL;
 			}
@@ -1381,26 +1483,32 @@ BaseAST *Parser::visitContinueStatement(){
 		}
 		else{
 			CORRECT = false;
-			fprintf(stderr, "%d行目 : continue( の次は数字でなければいけません", line);
+			printError("%d行目 : continue( の次は数字でなければいけません", line);
 			Tokens->getNextStatement();
 			return NULL;
 		}
-		if(Tokens->getCurType() == TOK_SYMBOL && Tokens->getCurString() == ")")
+		if(Tokens->getCurType() == TOK_SYMBOL && Tokens->getCurRef() == ")")
 			Tokens->getNextToken();
 		else{
-			fprintf(stderr, "%d行目 : continue(数字　の次は ) でなければいけません", line);
+			printError("%d行目 : continue(数字　の次は ) でなければいけません", line);
 			Tokens->getNextStatement();
 			return NULL;
 		}
 	}
 
-	if(Tokens->getCurString() == ";")
+	if(Tokens->getCurRef() == ";")
 		Tokens->getNextToken();
 	else{
 		CORRECT = false;
-		fprintf(stderr, "%d行目 : continue() の次は ; が来る必要があります.\n", line);
+		printError("%d行目 : continue() の次は ; が来る必要があります.\n", line);
 		Tokens->getNextStatement();
 		return NULL;
 	}
-	return new ContinueAST(to);
+	ForStatementAST *target = findEnclosingLoop(to);
+	if(!target){
+		CORRECT = false;
+		printError("%d行目 : continue文のカッコの中の数を確認してください.\n", line);
+		return NULL;
+	}
+	return Arena->create<ContinueAST>(to, target);
 }
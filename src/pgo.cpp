@@ -0,0 +1,246 @@
+#include "pgo.hpp"
+
+// プロファイルファイルの先頭
+static const uint64_t PROFILE_MAGIC = 0x666f727063636400ULL; // "dccprof"
+
+/**
+ * カウンタを埋め込む
+ * 各基本ブロックの先頭でカウンタを1増やし、mainの最初でatexitに書き出し関数を登録する
+ * @param Module
+ * @return 成功時:true 失敗時:false
+ */
+bool PGO::instrumentModule(llvm::Module &mod){
+	llvm::LLVMContext &context = mod.getContext();
+	llvm::Type *i64 = llvm::Type::getInt64Ty(context);
+
+	uint64_t block_num;
+	uint64_t hash = computeShapeHash(mod, block_num);
+	llvm::Function *main_func = mod.getFunction("main");
+	if(!main_func || main_func->isDeclaration()){
+		fprintf(stderr, "mainがないためプロファイルを取れません\n");
+		return false;
+	}
+
+	// カウンタ配列とヘッダ (マジック, ハッシュ値, ブロック数)
+	llvm::ArrayType *counters_type = llvm::ArrayType::get(i64, block_num);
+	llvm::GlobalVariable *counters = new llvm::GlobalVariable(mod, counters_type, false,
+			llvm::GlobalValue::InternalLinkage, llvm::ConstantAggregateZero::get(counters_type),
+			"__dcc_prof_counters");
+	std::vector<llvm::Constant*> header_values;
+	header_values.push_back(llvm::ConstantInt::get(i64, PROFILE_MAGIC));
+	header_values.push_back(llvm::ConstantInt::get(i64, hash));
+	header_values.push_back(llvm::ConstantInt::get(i64, block_num));
+	llvm::ArrayType *header_type = llvm::ArrayType::get(i64, header_values.size());
+	llvm::GlobalVariable *header = new llvm::GlobalVariable(mod, header_type, true,
+			llvm::GlobalValue::InternalLinkage, llvm::ConstantArray::get(header_type, header_values),
+			"__dcc_prof_header");
+
+	// 各基本ブロックにカウンタを埋め込む
+	// (先にブロックを集めてから命令を追加する)
+	std::vector<llvm::BasicBlock*> blocks;
+	for(llvm::Module::iterator func = mod.begin(); func != mod.end(); func++){
+		if(func->isDeclaration())
+			continue;
+		for(llvm::Function::iterator bb = func->begin(); bb != func->end(); bb++)
+			blocks.push_back(bb);
+	}
+	llvm::Value *zero = llvm::ConstantInt::get(i64, 0);
+	for(uint64_t i = 0; i < blocks.size(); i++){
+		llvm::IRBuilder<> builder(blocks[i], getCounterInsertPoint(*blocks[i]));
+		llvm::Value *indices[] = {zero, llvm::ConstantInt::get(i64, i)};
+		llvm::Value *ptr = builder.CreateInBoundsGEP(counters, indices, "prof.ptr");
+		llvm::Value *count = builder.CreateLoad(ptr, "prof.count");
+		builder.CreateStore(builder.CreateAdd(count, llvm::ConstantInt::get(i64, 1), "prof.inc"), ptr);
+	}
+
+	// mainの最初で書き出し関数をatexitに登録
+	llvm::Function *dump = createDumpFunction(mod, header, counters, block_num, ProfileFile);
+	llvm::FunctionType *atexit_type = llvm::FunctionType::get(llvm::Type::getInt32Ty(context),
+			llvm::PointerType::getUnqual(dump->getFunctionType()), false);
+	llvm::Constant *atexit_func = mod.getOrInsertFunction("atexit", atexit_type);
+	llvm::IRBuilder<> builder(&main_func->getEntryBlock(), getCounterInsertPoint(main_func->getEntryBlock()));
+	builder.CreateCall(atexit_func, dump);
+	return true;
+}
+
+/**
+ * プロファイルを読み込み、分岐の重みと関数の呼び出し回数を付ける
+ * 呼び出し回数から、よく呼ばれる関数はインライン展開されやすくし
+ * 一度も呼ばれない関数はサイズ優先にする
+ * @param Module
+ * @return 成功時:true 失敗時:false
+ */
+bool PGO::applyProfile(llvm::Module &mod){
+	FILE *fp = fopen(ProfileFile.c_str(), "rb");
+	if(!fp){
+		fprintf(stderr, "プロファイル %s が開けません\n", ProfileFile.c_str());
+		return false;
+	}
+	uint64_t block_num;
+	uint64_t hash = computeShapeHash(mod, block_num);
+	uint64_t header[3];
+	std::vector<uint64_t> counts(block_num);
+	bool valid = fread(header, sizeof(uint64_t), 3, fp) == 3 &&
+		header[0] == PROFILE_MAGIC && header[1] == hash && header[2] == block_num &&
+		fread(counts.data(), sizeof(uint64_t), block_num, fp) == block_num;
+	fclose(fp);
+	if(!valid){
+		fprintf(stderr, "プロファイル %s はこのプログラムのものではありません\n", ProfileFile.c_str());
+		return false;
+	}
+
+	// ブロック -> 実行回数
+	std::map<llvm::BasicBlock*, uint64_t> block_counts;
+	uint64_t index = 0;
+	uint64_t max_count = 0;
+	for(llvm::Module::iterator func = mod.begin(); func != mod.end(); func++){
+		if(func->isDeclaration())
+			continue;
+		for(llvm::Function::iterator bb = func->begin(); bb != func->end(); bb++){
+			block_counts[bb] = counts[index++];
+			if(block_counts[bb] > max_count)
+				max_count = block_counts[bb];
+		}
+	}
+
+	llvm::LLVMContext &context = mod.getContext();
+	llvm::MDBuilder md_builder(context);
+	uint64_t max_entry = 0;
+	for(llvm::Module::iterator func = mod.begin(); func != mod.end(); func++){
+		if(!func->isDeclaration() && func->getName() != "main")
+			max_entry = std::max(max_entry, block_counts[&func->getEntryBlock()]);
+	}
+
+	for(llvm::Module::iterator func = mod.begin(); func != mod.end(); func++){
+		if(func->isDeclaration())
+			continue;
+
+		// 関数の呼び出し回数
+		uint64_t entry = block_counts[&func->getEntryBlock()];
+		if(func->getName() != "main"){
+			if(entry == 0)
+				func->addFnAttr(llvm::Attributes::OptimizeForSize);
+			else if(entry * 10 >= max_entry)
+				func->addFnAttr(llvm::Attributes::InlineHint);
+		}
+
+		// 条件分岐の重み
+		// 分岐先の前任が1つならその実行回数が辺の実行回数になる
+		// 両方とも合流先の場合は分岐先の実行回数の比で近似する
+		for(llvm::Function::iterator bb = func->begin(); bb != func->end(); bb++){
+			llvm::BranchInst *br = llvm::dyn_cast<llvm::BranchInst>(bb->getTerminator());
+			if(!br || !br->isConditional())
+				continue;
+			llvm::BasicBlock *succ_true = br->getSuccessor(0);
+			llvm::BasicBlock *succ_false = br->getSuccessor(1);
+			uint64_t count = block_counts[bb];
+			uint64_t count_true = block_counts[succ_true];
+			uint64_t count_false = block_counts[succ_false];
+			if(succ_true->getSinglePredecessor())
+				count_false = count > count_true ? count - count_true : 0;
+			else if(succ_false->getSinglePredecessor())
+				count_true = count > count_false ? count - count_false : 0;
+
+			br->setMetadata(llvm::LLVMContext::MD_prof, md_builder.createBranchWeights(
+						scaleWeight(count_true, max_count), scaleWeight(count_false, max_count)));
+		}
+	}
+	return true;
+}
+
+/**
+ * Moduleの形のハッシュ値 (関数名と基本ブロック数のFNV-1a)
+ * @param Module ブロック数の格納先
+ * @return ハッシュ値
+ */
+uint64_t PGO::computeShapeHash(llvm::Module &mod, uint64_t &block_num){
+	uint64_t hash = 14695981039346656037ULL;
+	block_num = 0;
+	for(llvm::Module::iterator func = mod.begin(); func != mod.end(); func++){
+		if(func->isDeclaration())
+			continue;
+		std::string data = func->getName().str() + ":" + std::to_string((long long)func->size()) + ";";
+		for(int i = 0; i < data.size(); i++){
+			hash ^= (unsigned char)data[i];
+			hash *= 1099511628211ULL;
+		}
+		block_num += func->size();
+	}
+	return hash;
+}
+
+/**
+ * カウンタを入れる位置
+ * PHIと先頭のallocaの後
+ */
+llvm::BasicBlock::iterator PGO::getCounterInsertPoint(llvm::BasicBlock &bb){
+	llvm::BasicBlock::iterator iter = bb.getFirstInsertionPt();
+	while(iter != bb.end() && llvm::isa<llvm::AllocaInst>(iter))
+		iter++;
+	return iter;
+}
+
+/**
+ * カウンタの書き出し関数を生成する
+ * void __dcc_prof_dump() : fopenしてヘッダとカウンタをfwriteする
+ * @param Module ヘッダ カウンタ ブロック数 ファイル名
+ * @return 生成したFunction
+ */
+llvm::Function *PGO::createDumpFunction(llvm::Module &mod, llvm::GlobalVariable *header,
+		llvm::GlobalVariable *counters, uint64_t block_num, std::string file_name){
+	llvm::LLVMContext &context = mod.getContext();
+	llvm::Type *i8_ptr = llvm::Type::getInt8PtrTy(context);
+	llvm::Type *i64 = llvm::Type::getInt64Ty(context);
+	llvm::Type *i32 = llvm::Type::getInt32Ty(context);
+
+	// libcの関数
+	std::vector<llvm::Type*> fopen_args(2, i8_ptr);
+	llvm::Constant *fopen_func = mod.getOrInsertFunction("fopen",
+			llvm::FunctionType::get(i8_ptr, fopen_args, false));
+	std::vector<llvm::Type*> fwrite_args;
+	fwrite_args.push_back(i8_ptr);
+	fwrite_args.push_back(i64);
+	fwrite_args.push_back(i64);
+	fwrite_args.push_back(i8_ptr);
+	llvm::Constant *fwrite_func = mod.getOrInsertFunction("fwrite",
+			llvm::FunctionType::get(i64, fwrite_args, false));
+	std::vector<llvm::Type*> fclose_args(1, i8_ptr);
+	llvm::Constant *fclose_func = mod.getOrInsertFunction("fclose",
+			llvm::FunctionType::get(i32, fclose_args, false));
+
+	llvm::Function *dump = llvm::Function::Create(
+			llvm::FunctionType::get(llvm::Type::getVoidTy(context), false),
+			llvm::GlobalValue::InternalLinkage, "__dcc_prof_dump", &mod);
+	llvm::BasicBlock *bentry = llvm::BasicBlock::Create(context, "entry", dump);
+	llvm::BasicBlock *bwrite = llvm::BasicBlock::Create(context, "write", dump);
+	llvm::BasicBlock *bend = llvm::BasicBlock::Create(context, "end", dump);
+
+	llvm::IRBuilder<> builder(bentry);
+	llvm::Value *fp = builder.CreateCall2(fopen_func,
+			builder.CreateGlobalStringPtr(file_name, ".prof.name"),
+			builder.CreateGlobalStringPtr("wb", ".prof.mode"), "fp");
+	builder.CreateCondBr(builder.CreateIsNull(fp), bend, bwrite);
+
+	builder.SetInsertPoint(bwrite);
+	builder.CreateCall4(fwrite_func, builder.CreateBitCast(header, i8_ptr),
+			llvm::ConstantInt::get(i64, 8), llvm::ConstantInt::get(i64, 3), fp);
+	builder.CreateCall4(fwrite_func, builder.CreateBitCast(counters, i8_ptr),
+			llvm::ConstantInt::get(i64, 8), llvm::ConstantInt::get(i64, block_num), fp);
+	builder.CreateCall(fclose_func, fp);
+	builder.CreateBr(bend);
+
+	builder.SetInsertPoint(bend);
+	builder.CreateRetVoid();
+	return dump;
+}
+
+/**
+ * 実行回数を分岐の重み(32bit)に変換する
+ * 0回の分岐も重み1にして、大きすぎる場合は最大値に合わせて縮める
+ */
+uint32_t PGO::scaleWeight(uint64_t count, uint64_t max_count){
+	const uint64_t limit = 0xffffffffULL - 1;
+	if(max_count > limit)
+		count = (uint64_t)((double)count * limit / max_count);
+	return (uint32_t)count + 1;
+}
@@ -0,0 +1,393 @@
+#include "profiler.hpp"
+
+char TraceModuleMarker::ID = 0;
+char TraceSCCMarker::ID = 0;
+char TraceFunctionMarker::ID = 0;
+char TraceLoopMarker::ID = 0;
+
+/**
+ * インスタンス取得
+ */
+Profiler &Profiler::getInstance(){
+	static Profiler instance;
+	return instance;
+}
+
+/**
+ * 計測開始
+ * コンパイルサーバではリクエストごとに呼ぶので、前の記録は消す
+ * @param 時間レポートを表示するか traceの出力ファイル名(空なら出力しない)
+ * @return 成功時:true 失敗時:false
+ */
+bool Profiler::initialize(bool report, std::string trace_file){
+	std::lock_guard<std::mutex> lock(Lock);
+	Events.clear();
+	ThreadIds.clear();
+	Report = report;
+	TraceFile = trace_file;
+	Enabled = Report || !TraceFile.empty();
+	BaseTime = getWallTime();
+	return true;
+}
+
+/**
+ * 区間を記録する
+ * @param カテゴリ 区間名 対象 開始時刻 実時間 CPU時間
+ */
+void Profiler::addEvent(std::string category, std::string name, std::string detail,
+		uint64_t start, uint64_t wall, uint64_t cpu){
+	if(!Enabled)
+		return;
+	long peak_rss = getPeakRSS();
+
+	std::lock_guard<std::mutex> lock(Lock);
+	std::thread::id id = std::this_thread::get_id();
+	if(ThreadIds.find(id) == ThreadIds.end()){
+		int tid = ThreadIds.size() + 1;
+		ThreadIds[id] = tid;
+	}
+
+	Event event;
+	event.Category = category;
+	event.Name = name;
+	event.Detail = detail;
+	event.Start = start - BaseTime;
+	event.Wall = wall;
+	event.CPU = cpu;
+	event.PeakRSS = peak_rss;
+	event.Tid = ThreadIds[id];
+	Events.push_back(event);
+}
+
+/**
+ * 計測終了
+ * レポートの表示とtraceの出力を行う
+ * @return 成功時:true 失敗時:false
+ */
+bool Profiler::finish(){
+	if(!Enabled)
+		return true;
+	if(Report)
+		printReport();
+	if(!TraceFile.empty())
+		return writeTrace();
+	return true;
+}
+
+/**
+ * 実時間を取得
+ * @return マイクロ秒
+ */
+uint64_t Profiler::getWallTime(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+ * 呼び出したスレッドのCPU時間を取得
+ * @return マイクロ秒
+ */
+uint64_t Profiler::getCPUTime(){
+	struct timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+ * プロセスの最大RSSを取得
+ * @return KB
+ */
+long Profiler::getPeakRSS(){
+	struct rusage usage;
+	if(getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0;
+	return usage.ru_maxrss;
+}
+
+/**
+ * 時間レポートを標準エラー出力に表示する
+ * カテゴリごとに、同じ名前の区間は合計して最初に現れた順で表示する
+ */
+void Profiler::printReport(){
+	struct Total{
+		uint64_t Wall;
+		uint64_t CPU;
+		long PeakRSS;
+		int Count;
+	};
+	const char *categories[] = {"phase", "function", "pass"};
+	const char *titles[] = {"フェーズ", "関数", "LLVMパス"};
+
+	std::lock_guard<std::mutex> lock(Lock);
+	fprintf(stderr, "===== 時間レポート =====\n");
+	for(int i = 0; i < 3; i++){
+		std::vector<std::string> names;
+		std::map<std::string, Total> totals;
+		for(int j = 0; j < Events.size(); j++){
+			Event &event = Events.at(j);
+			if(event.Category != categories[i])
+				continue;
+
+			// パスは関数ごとではなくパス単位で合計する
+			std::string name = event.Name;
+			if(event.Category != "pass" && !event.Detail.empty())
+				name += " " + event.Detail;
+			if(totals.find(name) == totals.end()){
+				names.push_back(name);
+				Total total = {0, 0, 0, 0};
+				totals[name] = total;
+			}
+			Total &total = totals[name];
+			total.Wall += event.Wall;
+			total.CPU += event.CPU;
+			if(event.PeakRSS > total.PeakRSS)
+				total.PeakRSS = event.PeakRSS;
+			total.Count++;
+		}
+		if(names.empty())
+			continue;
+
+		fprintf(stderr, "--- %s ---\n", titles[i]);
+		fprintf(stderr, "%12s %12s %12s %8s  %s\n", "実時間(ms)", "CPU時間(ms)", "最大RSS(MB)", "回数", "名前");
+		for(int j = 0; j < names.size(); j++){
+			Total &total = totals[names.at(j)];
+			fprintf(stderr, "%12.3f %12.3f %12.1f %8d  %s\n",
+					total.Wall / 1000.0, total.CPU / 1000.0, total.PeakRSS / 1024.0,
+					total.Count, names.at(j).c_str());
+		}
+	}
+	fprintf(stderr, "最大RSS : %.1f MB\n", getPeakRSS() / 1024.0);
+}
+
+/**
+ * Chrome trace 形式で出力する
+ * 各区間を "ph":"X" (complete event) として出力する
+ * @return 成功時:true 失敗時:false
+ */
+bool Profiler::writeTrace(){
+	FILE *fp = fopen(TraceFile.c_str(), "w");
+	if(!fp){
+		fprintf(stderr, "%s が開けません\n", TraceFile.c_str());
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(Lock);
+	fprintf(fp, "{\"traceEvents\":[\n");
+	for(int i = 0; i < Events.size(); i++){
+		Event &event = Events.at(i);
+		std::string name = event.Name;
+		if(event.Category != "pass" && !event.Detail.empty())
+			name += " " + event.Detail;
+		fprintf(fp, "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%llu,\"dur\":%llu,"
+				"\"pid\":1,\"tid\":%d,\"args\":{\"detail\":\"%s\",\"cpu_us\":%llu,\"peak_rss_kb\":%ld}}%s\n",
+				escapeJSON(name).c_str(), event.Category.c_str(),
+				(unsigned long long)event.Start, (unsigned long long)event.Wall, event.Tid,
+				escapeJSON(event.Detail).c_str(), (unsigned long long)event.CPU, event.PeakRSS,
+				(i + 1 < Events.size()) ? "," : "");
+	}
+	fprintf(fp, "],\"displayTimeUnit\":\"ms\"}\n");
+
+	if(fclose(fp) != 0){
+		fprintf(stderr, "%s に書き込めません\n", TraceFile.c_str());
+		return false;
+	}
+	return true;
+}
+
+/**
+ * JSONの文字列用にエスケープする
+ */
+std::string Profiler::escapeJSON(std::string str){
+	std::string result;
+	for(int i = 0; i < str.length(); i++){
+		unsigned char c = str[i];
+		if(c == '"' || c == '\\'){
+			result += '\\';
+			result += c;
+		}else if(c < 0x20){
+			char buf[8];
+			snprintf(buf, sizeof(buf), "\\u%04x", c);
+			result += buf;
+		}else{
+			result += c;
+		}
+	}
+	return result;
+}
+
+
+/**
+ * コンストラクタ
+ * 計測が有効ならここから計測を開始する
+ */
+ProfileScope::ProfileScope(std::string category, std::string name, std::string detail)
+	: Active(Profiler::getInstance().isEnabled()){
+	if(!Active)
+		return;
+	Category = category;
+	Name = name;
+	Detail = detail;
+	StartWall = Profiler::getWallTime();
+	StartCPU = Profiler::getCPUTime();
+}
+
+/**
+ * デストラクタ
+ * 区間を記録する
+ */
+ProfileScope::~ProfileScope(){
+	if(!Active)
+		return;
+	Profiler::getInstance().addEvent(Category, Name, Detail, StartWall,
+			Profiler::getWallTime() - StartWall, Profiler::getCPUTime() - StartCPU);
+}
+
+
+/**
+ * パスの開始
+ * @param IRの単位(Function, Loopなど)
+ */
+void PassSpan::begin(const void *unit){
+	Starts[unit] = std::make_pair(Profiler::getWallTime(), Profiler::getCPUTime());
+}
+
+/**
+ * パスの終了
+ * 開始が記録されていない場合(単位が削除されたなど)は記録しない
+ * @param IRの単位 対象名
+ */
+void PassSpan::end(const void *unit, std::string detail){
+	std::map<const void*, std::pair<uint64_t, uint64_t>>::iterator iter = Starts.find(unit);
+	if(iter == Starts.end())
+		return;
+	uint64_t start = iter->second.first;
+	uint64_t cpu = iter->second.second;
+	Starts.erase(iter);
+	Profiler::getInstance().addEvent("pass", Name, detail, start,
+			Profiler::getWallTime() - start, Profiler::getCPUTime() - cpu);
+}
+
+
+/**
+ * マーカーパス
+ * いずれもIRは変更しない
+ */
+bool TraceModuleMarker::runOnModule(llvm::Module &M){
+	if(IsBegin)
+		Span->begin(&M);
+	else
+		Span->end(&M, M.getModuleIdentifier());
+	return false;
+}
+
+bool TraceSCCMarker::runOnSCC(llvm::CallGraphSCC &SCC){
+	if(SCC.begin() == SCC.end())
+		return false;
+	llvm::CallGraphNode *node = *SCC.begin();
+	if(IsBegin){
+		Span->begin(node);
+	}else{
+		llvm::Function *func = node->getFunction();
+		Span->end(node, func ? func->getName().str() : "");
+	}
+	return false;
+}
+
+bool TraceFunctionMarker::runOnFunction(llvm::Function &F){
+	if(IsBegin)
+		Span->begin(&F);
+	else
+		Span->end(&F, F.getName());
+	return false;
+}
+
+bool TraceLoopMarker::runOnLoop(llvm::Loop *L, llvm::LPPassManager &LPM){
+	if(IsBegin){
+		Span->begin(L);
+	}else{
+		llvm::Function *func = L->getHeader()->getParent();
+		Span->end(L, func->getName());
+	}
+	return false;
+}
+
+
+/**
+ * パスの種類に合わせたマーカーを生成する
+ * 解析パスとマーカーを入れられない種類のパスはNULL
+ * @param パス 区間 開始マーカーか
+ * @return マーカー
+ */
+static llvm::Pass *createTraceMarker(llvm::Pass *P, PassSpan *span, bool is_begin){
+	const llvm::PassInfo *info = llvm::PassRegistry::getPassRegistry()->getPassInfo(P->getPassID());
+	if(info && info->isAnalysis())
+		return NULL;
+
+	switch(P->getPassKind()){
+		case llvm::PT_Module:
+			return new TraceModuleMarker(span, is_begin);
+		case llvm::PT_CallGraphSCC:
+			return new TraceSCCMarker(span, is_begin);
+		case llvm::PT_Function:
+			return new TraceFunctionMarker(span, is_begin);
+		case llvm::PT_Loop:
+			return new TraceLoopMarker(span, is_begin);
+		default:
+			return NULL;
+	}
+}
+
+/**
+ * パスの追加
+ * 計測が有効ならパスの前後にマーカーを挿入する
+ */
+void TracingPassManager::add(llvm::Pass *P){
+	if(!Tracing){
+		llvm::PassManager::add(P);
+		return;
+	}
+	PassSpan *span = new PassSpan(P->getPassName());
+	llvm::Pass *begin = createTraceMarker(P, span, true);
+	if(!begin){
+		SAFE_DELETE(span);
+		llvm::PassManager::add(P);
+		return;
+	}
+	Spans.push_back(span);
+	llvm::PassManager::add(begin);
+	llvm::PassManager::add(P);
+	llvm::PassManager::add(createTraceMarker(P, span, false));
+}
+
+/**
+ * デストラクタ
+ * マーカーはPassManagerが削除するので区間だけ削除する
+ */
+TracingPassManager::~TracingPassManager(){
+	for(int i = 0; i < Spans.size(); i++)
+		SAFE_DELETE(Spans[i]);
+}
+
+void TracingFunctionPassManager::add(llvm::Pass *P){
+	if(!Tracing){
+		llvm::FunctionPassManager::add(P);
+		return;
+	}
+	PassSpan *span = new PassSpan(P->getPassName());
+	llvm::Pass *begin = createTraceMarker(P, span, true);
+	if(!begin){
+		SAFE_DELETE(span);
+		llvm::FunctionPassManager::add(P);
+		return;
+	}
+	Spans.push_back(span);
+	llvm::FunctionPassManager::add(begin);
+	llvm::FunctionPassManager::add(P);
+	llvm::FunctionPassManager::add(createTraceMarker(P, span, false));
+}
+
+TracingFunctionPassManager::~TracingFunctionPassManager(){
+	for(int i = 0; i < Spans.size(); i++)
+		SAFE_DELETE(Spans[i]);
+}
@@ -0,0 +1,146 @@
+#include "repl.hpp"
+
+/**
+ * コンストラクタ
+ * @param コード生成に使うLLVMContext
+ */
+REPL::REPL(llvm::LLVMContext &context) : EE(NULL), Count(0){
+	InputParser = new Parser();
+	Generator = new CodeGen(context);
+}
+
+/**
+ * デストラクタ
+ * ModuleはCodeGenが解放するのでExecutionEngineから外しておく
+ */
+REPL::~REPL(){
+	if(EE)
+		EE->removeModule(&Generator->getModule());
+	SAFE_DELETE(EE);
+	SAFE_DELETE(Generator);
+	SAFE_DELETE(InputParser);
+}
+
+/**
+ * ModuleとJITの生成
+ * @return 成功時:true 失敗時:false
+ */
+bool REPL::initialize(){
+	if(!Generator->beginModule("<stdin>"))
+		return false;
+
+	// 応答を速くするためコード生成の最適化はしない
+	std::string error;
+	EE = llvm::EngineBuilder(&Generator->getModule())
+		.setEngineKind(llvm::EngineKind::JIT)
+		.setOptLevel(llvm::CodeGenOpt::None)
+		.setErrorStr(&error)
+		.create();
+	if(!EE){
+		fprintf(stderr, "JITが生成できません : %s\n", error.c_str());
+		return false;
+	}
+	EE->DisableLazyCompilation(false);
+	return true;
+}
+
+/**
+ * 対話実行
+ * 入力がなくなるか exit が入力されるまで繰り返す
+ * @return 終了コード
+ */
+int REPL::run(){
+	fprintf(stdout, "DummyC (%s) : exit で終了\n", DCC_VERSION);
+	std::string source;
+	while(readInput(source)){
+		if(source.empty())
+			continue;
+		evaluate(source);
+	}
+	fprintf(stdout, "\n");
+	return 0;
+}
+
+/**
+ * 1入力の読み込み
+ * { と } の数が合うまで(if, for, 関数定義の終わりまで)続けて読む
+ * @param 入力の格納先
+ * @return 入力あり:true 終了:false
+ */
+bool REPL::readInput(std::string &source){
+	std::string line;
+	int depth = 0;
+	source.clear();
+	do{
+		fprintf(stdout, source.empty() ? ">>> " : "... ");
+		fflush(stdout);
+		if(!std::getline(std::cin, line))
+			return false;
+		if(source.empty() && (line == "exit" || line == "quit"))
+			return false;
+		depth += countBraces(line);
+		source += line + "\n";
+	}while(depth > 0);
+
+	// 空行だけなら何もしない
+	if(source.find_first_not_of(" \t\n") == std::string::npos)
+		source.clear();
+	return true;
+}
+
+/**
+ * 1入力のコンパイルと実行
+ * 失敗した場合は関数表, mainの変数, Moduleを入力前に戻す
+ * @param 入力
+ * @return 成功時:true 失敗時:false
+ */
+bool REPL::evaluate(std::string source){
+	ProfileScope prof("phase", "REPL入力");
+	if(!InputParser->parseSource(source))
+		return false;
+	if(!Generator->addTranslationUnit(InputParser->getAST())){
+		InputParser->rollback();
+		return false;
+	}
+
+	// 入力の文はmainとして生成されるので、次の入力と被らないように名前を変えて実行
+	llvm::Module &mod = Generator->getModule();
+	llvm::Function *main_func = mod.getFunction("main");
+	if(!main_func)
+		return true;
+	main_func->setName("__repl_" + std::to_string((long long)++Count));
+
+	int (*func)() = (int (*)())(intptr_t)EE->getPointerToFunction(main_func);
+	if(func)
+		func();
+	fflush(stdout);
+
+	// 1度しか実行しないので削除
+	EE->freeMachineCodeForFunction(main_func);
+	main_func->eraseFromParent();
+	return func != NULL;
+}
+
+/**
+ * 行の { と } の数の差
+ * 文字列とコメントの中は数えない
+ * @param 行
+ * @return { の数 - } の数
+ */
+int REPL::countBraces(std::string line){
+	int depth = 0;
+	bool in_string = false;
+	for(int i = 0; i < line.length(); i++){
+		if(line[i] == '\"')
+			in_string = !in_string;
+		else if(in_string)
+			continue;
+		else if(line[i] == '#')
+			break;
+		else if(line[i] == '{')
+			depth++;
+		else if(line[i] == '}')
+			depth--;
+	}
+	return depth;
+}
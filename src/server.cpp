@@ -0,0 +1,387 @@
+#include "server.hpp"
+
+// 標準入力, 標準出力, 標準エラー出力
+static const int STD_FD_NUM = 3;
+
+// シグナルで終了するためのフラグ
+static volatile sig_atomic_t StopServer = 0;
+static void stopServerHandler(int sig){
+	StopServer = 1;
+}
+
+/**
+ * デストラクタ
+ */
+CompileServer::~CompileServer(){
+	recycleContext();
+	if(ListenFd >= 0){
+		close(ListenFd);
+		unlink(SocketPath.c_str());
+	}
+}
+
+/**
+ * デフォルトのソケットのパス
+ * $DCC_SOCKET か /tmp/dcc-<uid>.sock
+ * @return ソケットのパス
+ */
+std::string CompileServer::getDefaultSocketPath(){
+	const char *path = getenv("DCC_SOCKET");
+	if(path && path[0] != '\0')
+		return path;
+	return "/tmp/dcc-" + std::to_string((long long)getuid()) + ".sock";
+}
+
+/**
+ * ソケットの生成
+ * 前回のサーバが残したソケットファイルは、接続できなければ削除する
+ * @return 成功時:true 失敗時:false
+ */
+bool CompileServer::initialize(){
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if(SocketPath.length() >= sizeof(addr.sun_path)){
+		fprintf(stderr, "ソケットのパス %s が長すぎます\n", SocketPath.c_str());
+		return false;
+	}
+	strcpy(addr.sun_path, SocketPath.c_str());
+
+	// 既にサーバが動いているか確認
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(fd >= 0 && connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0){
+		close(fd);
+		fprintf(stderr, "%s で既にサーバが動いています\n", SocketPath.c_str());
+		return false;
+	}
+	if(fd >= 0)
+		close(fd);
+	unlink(SocketPath.c_str());
+
+	// bindした時点で自分だけが読み書きできるソケットにする
+	mode_t old_mask = umask(0177);
+	ListenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+	bool ok = ListenFd >= 0 &&
+		bind(ListenFd, (struct sockaddr*)&addr, sizeof(addr)) == 0 &&
+		listen(ListenFd, 16) == 0;
+	int error = errno;
+	umask(old_mask);
+	if(!ok){
+		fprintf(stderr, "ソケット %s が作成できません : %s\n", SocketPath.c_str(), strerror(error));
+		if(ListenFd >= 0)
+			close(ListenFd);
+		ListenFd = -1;
+		return false;
+	}
+	return true;
+}
+
+/**
+ * リクエストを待って処理する
+ * SIGINT, SIGTERMで終了する
+ * @param リクエストの処理関数
+ * @return 終了コード
+ */
+int CompileServer::run(RequestHandler handler){
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = stopServerHandler;
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	fprintf(stderr, "dcc : %s で待ち受けています\n", SocketPath.c_str());
+	while(!StopServer){
+		int fd = accept(ListenFd, NULL, NULL);
+		if(fd < 0){
+			if(errno == EINTR)
+				continue;
+			fprintf(stderr, "接続を受け付けられません : %s\n", strerror(errno));
+			return 1;
+		}
+		handleConnection(fd, handler);
+		close(fd);
+	}
+	return 0;
+}
+
+/**
+ * リクエストをコンパイルするLLVMContextを取得する
+ * 作り直すまでは同じLLVMContextを返すので、-l のModuleを読み直さずに使える
+ * @return LLVMContext
+ */
+llvm::LLVMContext &CompileServer::getContext(){
+	if(!Context)
+		Context = new llvm::LLVMContext();
+	return *Context;
+}
+
+/**
+ * -l のModuleを取得する
+ * Contextに読み込んだModuleをファイルが更新されるまで使い回す
+ * リンクする側でPreserveSourceで結合するので、このModuleは変更されない
+ * @param ファイル名
+ * @return 成功時:Module 失敗時:NULL
+ */
+llvm::Module *CompileServer::getLinkModule(std::string file_name){
+	if(file_name.empty())
+		return NULL;
+	struct stat st;
+	if(stat(file_name.c_str(), &st) != 0){
+		fprintf(stderr, "リンクファイル %s が開けません\n", file_name.c_str());
+		return NULL;
+	}
+
+	char real_path[PATH_MAX];
+	std::string key = realpath(file_name.c_str(), real_path) ? real_path : file_name;
+	std::map<std::string, std::pair<time_t, llvm::Module*>>::iterator iter = LinkModules.find(key);
+	if(iter != LinkModules.end()){
+		if(iter->second.first == st.st_mtime)
+			return iter->second.second;
+		// 更新されていたら読み直す
+		SAFE_DELETE(iter->second.second);
+		LinkModules.erase(iter);
+	}
+
+	llvm::SMDiagnostic err;
+	llvm::Module *mod = llvm::ParseIRFile(file_name, err, getContext());
+	if(!mod){
+		fprintf(stderr, "リンクファイル %s が読み込めません : %s\n", file_name.c_str(), err.getMessage().c_str());
+		return NULL;
+	}
+	LinkModules[key] = std::make_pair(st.st_mtime, mod);
+	return mod;
+}
+
+/**
+ * リクエストの処理が終わったら呼ぶ
+ * 処理したリクエスト数かメモリ使用量が上限を超えたらContextを作り直す
+ */
+void CompileServer::finishRequest(){
+	if(++ContextRequests < RecycleRequests){
+		long rss = getCurrentRSS();
+		if(rss < 0 || rss <= RecycleRSS)
+			return;
+	}
+	recycleContext();
+}
+
+/**
+ * -l のModuleとContextを破棄する (次のリクエストで作り直す)
+ */
+void CompileServer::recycleContext(){
+	std::map<std::string, std::pair<time_t, llvm::Module*>>::iterator iter = LinkModules.begin();
+	for(; iter != LinkModules.end(); iter++)
+		SAFE_DELETE(iter->second.second);
+	LinkModules.clear();
+	SAFE_DELETE(Context);
+	ContextRequests = 0;
+}
+
+/**
+ * 現在のメモリ使用量 (/proc/self/statm の常駐ページ数から求める)
+ * @return KB 取得できない場合:-1
+ */
+long CompileServer::getCurrentRSS(){
+	FILE *fp = fopen("/proc/self/statm", "r");
+	if(!fp)
+		return -1;
+	long size, resident;
+	int num = fscanf(fp, "%ld %ld", &size, &resident);
+	fclose(fp);
+	if(num != 2)
+		return -1;
+	return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+/**
+ * 受け取ったメッセージに含まれるfdを全て閉じる (不正なリクエストを捨てる時)
+ * @param 受け取ったメッセージ
+ */
+void CompileServer::closeReceivedFds(struct msghdr *msg){
+	for(struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg)){
+		if(cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+			continue;
+		int num = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+		int *fds = (int*)CMSG_DATA(cmsg);
+		for(int i = 0; i < num; i++)
+			close(fds[i]);
+	}
+}
+
+/**
+ * 1接続の処理
+ * 受信 : [サイズ(uint32) + 標準入出力のfd(SCM_RIGHTS)] [作業ディレクトリ\0 引数\0 ...]
+ * 送信 : [終了コード(int32)]
+ * @param 接続したソケット リクエストの処理関数
+ * @return 成功時:true 失敗時:false
+ */
+bool CompileServer::handleConnection(int fd, RequestHandler handler){
+	// サイズと標準入出力のfdを受け取る
+	uint32_t size = 0;
+	struct iovec iov;
+	iov.iov_base = &size;
+	iov.iov_len = sizeof(size);
+	char control[CMSG_SPACE(sizeof(int) * STD_FD_NUM)];
+	memset(control, 0, sizeof(control));
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+	ssize_t received = recvmsg(fd, &msg, 0);
+	if(received != sizeof(size)){
+		if(received > 0)
+			closeReceivedFds(&msg);
+		return false;
+	}
+
+	int client_fds[STD_FD_NUM] = {-1, -1, -1};
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+	if(!cmsg || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS ||
+			cmsg->cmsg_len != CMSG_LEN(sizeof(int) * STD_FD_NUM)){
+		closeReceivedFds(&msg);
+		return false;
+	}
+	memcpy(client_fds, CMSG_DATA(cmsg), sizeof(client_fds));
+
+	// 作業ディレクトリと引数
+	std::vector<char> payload(size);
+	std::vector<std::string> args;
+	bool ok = size > 0 && readAll(fd, payload.data(), size) && payload[size-1] == '\0';
+	for(uint32_t pos = 0; ok && pos < size; pos += args.back().length() + 1)
+		args.push_back(std::string(&payload[pos]));
+
+	int result = 1;
+	if(ok && !args.empty()){
+		std::string cwd = args.front();
+		args.erase(args.begin());
+
+		// 標準入出力をクライアントのものに差し替えて実行
+		char server_cwd[PATH_MAX];
+		bool has_cwd = getcwd(server_cwd, sizeof(server_cwd)) != NULL;
+		int saved_fds[STD_FD_NUM];
+		fflush(stdout);
+		fflush(stderr);
+		for(int i = 0; i < STD_FD_NUM; i++){
+			saved_fds[i] = dup(i);
+			dup2(client_fds[i], i);
+		}
+		if(chdir(cwd.c_str()) == 0)
+			result = handler(args, *this);
+		else
+			fprintf(stderr, "ディレクトリ %s に移動できません\n", cwd.c_str());
+		fflush(stdout);
+		fflush(stderr);
+		clearerr(stdin);
+		for(int i = 0; i < STD_FD_NUM; i++){
+			dup2(saved_fds[i], i);
+			close(saved_fds[i]);
+		}
+		if(has_cwd && chdir(server_cwd) != 0)
+			fprintf(stderr, "ディレクトリ %s に戻れません\n", server_cwd);
+	}
+	for(int i = 0; i < STD_FD_NUM; i++)
+		close(client_fds[i]);
+
+	int32_t code = result;
+	return writeAll(fd, &code, sizeof(code));
+}
+
+/**
+ * クライアント (dcc --client)
+ * 作業ディレクトリ, 引数, 標準入出力をサーバに送り、終了コードを受け取る
+ * LLVMの初期化をしないので起動が速い
+ * @param ソケットのパス 引数の数 引数
+ * @return サーバでの終了コード 接続失敗時:1
+ */
+int CompileServer::sendRequest(std::string socket_path, int argc, char **argv){
+	char cwd[PATH_MAX];
+	if(!getcwd(cwd, sizeof(cwd))){
+		fprintf(stderr, "作業ディレクトリが取得できません\n");
+		return 1;
+	}
+	std::string payload(cwd);
+	payload += '\0';
+	for(int i = 0; i < argc; i++){
+		payload += argv[i];
+		payload += '\0';
+	}
+
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(fd < 0 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0){
+		fprintf(stderr, "サーバ %s に接続できません (dcc --serve で起動してください)\n", socket_path.c_str());
+		if(fd >= 0)
+			close(fd);
+		return 1;
+	}
+
+	// サイズと一緒に標準入出力のfdを送る
+	uint32_t size = payload.size();
+	struct iovec iov;
+	iov.iov_base = &size;
+	iov.iov_len = sizeof(size);
+	char control[CMSG_SPACE(sizeof(int) * STD_FD_NUM)];
+	memset(control, 0, sizeof(control));
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int) * STD_FD_NUM);
+	int std_fds[STD_FD_NUM] = {0, 1, 2};
+	memcpy(CMSG_DATA(cmsg), std_fds, sizeof(std_fds));
+
+	int32_t code = 1;
+	if(sendmsg(fd, &msg, 0) != sizeof(size) ||
+			!writeAll(fd, payload.data(), payload.size()) ||
+			!readAll(fd, &code, sizeof(code))){
+		fprintf(stderr, "サーバとの通信に失敗しました\n");
+		code = 1;
+	}
+	close(fd);
+	return code;
+}
+
+/**
+ * 全て書き込む
+ */
+bool CompileServer::writeAll(int fd, const void *data, size_t size){
+	const char *ptr = (const char*)data;
+	while(size > 0){
+		ssize_t n = write(fd, ptr, size);
+		if(n < 0 && errno == EINTR)
+			continue;
+		if(n <= 0)
+			return false;
+		ptr += n;
+		size -= n;
+	}
+	return true;
+}
+
+/**
+ * 全て読み込む
+ */
+bool CompileServer::readAll(int fd, void *data, size_t size){
+	char *ptr = (char*)data;
+	while(size > 0){
+		ssize_t n = read(fd, ptr, size);
+		if(n < 0 && errno == EINTR)
+			continue;
+		if(n <= 0)
+			return false;
+		ptr += n;
+		size -= n;
+	}
+	return true;
+}
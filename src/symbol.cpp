@@ -0,0 +1,176 @@
+#include "symbol.hpp"
+
+const SymbolID SymbolTable::None;
+
+// スレッドに結び付けた表
+static thread_local SymbolTable *CurrentTable = NULL;
+
+/**
+ * インスタンス取得
+ * スレッドに結び付けた表 (なければプロセスの表)
+ */
+SymbolTable &SymbolTable::getInstance(){
+	if(CurrentTable)
+		return *CurrentTable;
+	static SymbolTable instance;
+	return instance;
+}
+
+/**
+ * 表を現在のスレッドに結び付ける
+ * @param 表
+ */
+SymbolTable::Binding::Binding(SymbolTable &table) : Previous(CurrentTable){
+	CurrentTable = &table;
+}
+
+/**
+ * 結び付ける前の表に戻す
+ */
+SymbolTable::Binding::~Binding(){
+	CurrentTable = Previous;
+}
+
+/**
+ * 識別子を登録する
+ * @param 名前
+ * @return 名前の番号 (登録済みならその番号)
+ */
+SymbolID SymbolTable::intern(llvm::StringRef name){
+	std::unique_lock<std::mutex> lock(Lock, std::defer_lock);
+	if(Concurrent)
+		lock.lock();
+	llvm::StringMapEntry<SymbolID> &entry = IDs.GetOrCreateValue(name, None);
+	if(entry.getValue() == None){
+		entry.setValue(Entries.size());
+		Entries.push_back(&entry);
+	}
+	return entry.getValue();
+}
+
+/**
+ * 番号から名前を取得する
+ * StringMapのエントリは移動しないので、返した範囲は表が増えても有効
+ * @param 番号
+ * @return 名前 (未登録の番号なら空)
+ */
+llvm::StringRef SymbolTable::getName(SymbolID symbol){
+	std::unique_lock<std::mutex> lock(Lock, std::defer_lock);
+	if(Concurrent)
+		lock.lock();
+	if(symbol < 0 || symbol >= Entries.size())
+		return llvm::StringRef();
+	return Entries[symbol]->getKey();
+}
+
+/**
+ * 登録済みの識別子の数
+ */
+int SymbolTable::size(){
+	std::unique_lock<std::mutex> lock(Lock, std::defer_lock);
+	if(Concurrent)
+		lock.lock();
+	return Entries.size();
+}
+
+
+/**
+ * 表を空にする
+ */
+void ScopedSymbolTable::clear(){
+	Slot empty = {SymbolTable::None, 0};
+	Slots.assign(16, empty);
+	Log.clear();
+	ScopeStarts.clear();
+}
+
+/**
+ * 現在のスコープを抜ける
+ * スコープ内で追加したものを逆順に消す (表全体は見ない)
+ */
+void ScopedSymbolTable::popScope(){
+	if(ScopeStarts.empty())
+		return;
+	int start = ScopeStarts.back();
+	ScopeStarts.pop_back();
+	while(Log.size() > start){
+		Slots[find(Log.back())].Symbol = SymbolTable::None;
+		Log.pop_back();
+	}
+}
+
+/**
+ * 追加する
+ * @param 番号 値
+ * @return 追加した:true 既にある:false
+ */
+bool ScopedSymbolTable::insert(SymbolID symbol, int value){
+	if(find(symbol) >= 0)
+		return false;
+	// 使用率を1/2以下に保つ
+	if((Log.size() + 1) * 2 > Slots.size())
+		grow();
+	int index = getHome(symbol);
+	while(Slots[index].Symbol != SymbolTable::None)
+		index = (index + 1) & (Slots.size() - 1);
+	Slots[index].Symbol = symbol;
+	Slots[index].Value = value;
+	Log.push_back(symbol);
+	return true;
+}
+
+/**
+ * 値を取得する
+ * @param 番号 無い場合の値
+ * @return 値
+ */
+int ScopedSymbolTable::lookup(SymbolID symbol, int default_value){
+	int index = find(symbol);
+	return index >= 0 ? Slots[index].Value : default_value;
+}
+
+/**
+ * 現在のスコープで追加した番号を追加順に取得する
+ */
+std::vector<SymbolID> ScopedSymbolTable::getScopeSymbols(){
+	int start = ScopeStarts.empty() ? 0 : ScopeStarts.back();
+	return std::vector<SymbolID>(Log.begin() + start, Log.end());
+}
+
+/**
+ * 位置を探す
+ * @param 番号
+ * @return 位置 (無ければ-1)
+ */
+int ScopedSymbolTable::find(SymbolID symbol){
+	Finds++;
+	int index = getHome(symbol);
+	while(Slots[index].Symbol != SymbolTable::None){
+		Probes++;
+		if(Slots[index].Symbol == symbol)
+			return index;
+		index = (index + 1) & (Slots.size() - 1);
+	}
+	return -1;
+}
+
+/**
+ * 容量を2倍にする
+ * 追加順に入れ直すので、逆順に消せば探索の列は壊れない
+ */
+void ScopedSymbolTable::grow(){
+	Grows++;
+	std::vector<int> values(Log.size());
+	for(int i = 0; i < Log.size(); i++)
+		values[i] = Slots[find(Log[i])].Value;
+
+	Slot empty = {SymbolTable::None, 0};
+	Slots.assign(Slots.size() * 2, empty);
+	for(int i = 0; i < Log.size(); i++){
+		int index = getHome(Log[i]);
+		while(Slots[index].Symbol != SymbolTable::None)
+			index = (index + 1) & (Slots.size() - 1);
+		Slots[index].Symbol = Log[i];
+		Slots[index].Value = values[i];
+	}
+}
@@ -0,0 +1,290 @@
+#include "typeinfer.hpp"
+
+/**
+ * 関数の変数の型を推論する
+ * 全てのローカル変数を整数と仮定し、整数でない値が代入される変数を外すことを変わらなくなるまで繰り返す
+ * 値の範囲も同時に求め、範囲が ±2^53 を超えるかもしれない変数と式は整数から外す
+ * @param FunctionStmtAST doubleに決まっている変数 (他の関数と共有するmainの変数)
+ * @return 整数と推論した変数の数
+ */
+int TypeInference::inferFunction(FunctionStmtAST *func_stmt, const llvm::DenseSet<SymbolID> &doubles){
+	Integers.clear();
+	Ranges.clear();
+	Widens.clear();
+	for(int i = 0; ; i++){
+		VariableDeclAST *vdecl = func_stmt->getVariableDecl(i);
+		if(!vdecl)
+			break;
+		if(vdecl->getType() == VariableDeclAST::local && 
+				vdecl->getIdentify() == VariableDeclAST::ddouble &&
+				!doubles.count(vdecl->getSymbol()) &&
+				!func_stmt->isGlobalVariable(vdecl->getSymbol())){
+			// ローカル変数の初期値は0
+			Range zero = {0, 0};
+			Integers.insert(vdecl->getSymbol());
+			Ranges[vdecl->getSymbol()] = zero;
+		}
+	}
+
+	// 最後の周回は何も変わらないので、式に設定した型はその周回のものになる
+	do{
+		Changed = false;
+		Grown.clear();
+		visitBlock(func_stmt->getBody());
+	}while(Changed);
+
+	int num = 0;
+	for(int i = 0; ; i++){
+		VariableDeclAST *vdecl = func_stmt->getVariableDecl(i);
+		if(!vdecl)
+			break;
+		if(vdecl->getType() == VariableDeclAST::local && Integers.count(vdecl->getSymbol())){
+			vdecl->setIdentifyType(VariableDeclAST::dint64);
+			num++;
+		}
+	}
+	return num;
+}
+
+/**
+ * Blockの文を順に見る
+ * @param BlockAST
+ */
+void TypeInference::visitBlock(BlockAST *block){
+	for(int i = 0; ; i++){
+		BaseAST *stmt = block->getStatement(i);
+		if(!stmt)
+			break;
+		visitStatement(stmt);
+	}
+}
+
+/**
+ * 文の中の代入を見る
+ * @param 文
+ */
+void TypeInference::visitStatement(BaseAST *stmt){
+	Range range;
+	if(llvm::isa<IfStatementAST>(stmt)){
+		for(IfStatementAST *clause = llvm::dyn_cast<IfStatementAST>(stmt); clause; clause = clause->getElse()){
+			for(int i = 0; i < clause->getComparisonNumber(); i++){
+				visitExpression(clause->getComparison(i)->getLHS(), range);
+				visitExpression(clause->getComparison(i)->getRHS(), range);
+			}
+			visitBlock(clause->getThen());
+		}
+	}
+	else if(llvm::isa<ForStatementAST>(stmt)){
+		// 範囲の繰り返し変数には始めから終わりまでの整数 (始め + 誘導変数 * 増分) が代入される
+		ForStatementAST *for_expr = llvm::dyn_cast<ForStatementAST>(stmt);
+		Range start, end;
+		visitExpression(for_expr->getStartExpr(), start);
+		visitExpression(for_expr->getEndExpr(), end);
+		if(for_expr->getVal()){
+			Range val = {std::min(start.Low, end.Low), std::max(start.High, end.High)};
+			widenRange(for_expr->getVal()->getSymbol(), val);
+		}
+		visitBlock(for_expr->getBody());
+	}
+	else if(llvm::isa<ReturnStmtAST>(stmt)){
+		visitExpression(llvm::dyn_cast<ReturnStmtAST>(stmt)->getExpr(), range);
+	}
+	else if(llvm::isa<BinaryExprAST>(stmt) || llvm::isa<CallExprAST>(stmt)){
+		visitExpression(stmt, range);
+	}
+}
+
+/**
+ * 式が整数になるか調べる (代入先の変数の型と範囲も更新する)
+ * @param 式 値の範囲(出力)
+ * @return 整数:true double:false
+ */
+bool TypeInference::visitExpression(BaseAST *expr, Range &range){
+	range = getUnknownRange();
+	if(!expr)
+		return false;
+	if(llvm::isa<NumberAST>(expr)){
+		double value = llvm::dyn_cast<NumberAST>(expr)->getNumberValue();
+		if(std::isfinite(value)){
+			range.Low = value;
+			range.High = value;
+		}
+		return isIntegerNumber(value);
+	}
+	if(llvm::isa<VariableAST>(expr)){
+		SymbolID symbol = llvm::dyn_cast<VariableAST>(expr)->getSymbol();
+		llvm::DenseMap<SymbolID, Range>::iterator it = Ranges.find(symbol);
+		if(it != Ranges.end())
+			range = it->second;
+		return Integers.count(symbol) != 0;
+	}
+	if(llvm::isa<CallExprAST>(expr)){
+		CallExprAST *call_expr = llvm::dyn_cast<CallExprAST>(expr);
+		bool is_input = call_expr->getCallee() == "input";
+		Range arg_range;
+		for(int i = 0; ; i++){
+			BaseAST *arg = call_expr->getArgs(i);
+			if(!arg)
+				break;
+			// inputはdoubleを読み込む
+			if(is_input && llvm::isa<VariableAST>(arg)){
+				setDouble(llvm::dyn_cast<VariableAST>(arg)->getSymbol());
+				widenRange(llvm::dyn_cast<VariableAST>(arg)->getSymbol(), getUnknownRange());
+			}
+			else
+				visitExpression(arg, arg_range);
+		}
+		return false;
+	}
+	if(llvm::isa<BinaryExprAST>(expr)){
+		BinaryExprAST *bin_expr = llvm::dyn_cast<BinaryExprAST>(expr);
+		Range lhs_range, rhs_range;
+		bool lhs = bin_expr->getOp() == BOP_ASSIGN ? false : visitExpression(bin_expr->getLHS(), lhs_range);
+		bool rhs = visitExpression(bin_expr->getRHS(), rhs_range);
+		bool integer = false;
+		switch(bin_expr->getOp()){
+			case BOP_ASSIGN:{
+				VariableAST *var = llvm::dyn_cast<VariableAST>(bin_expr->getLHS());
+				if(!var)
+					return false;
+				if(!rhs)
+					setDouble(var->getSymbol());
+				widenRange(var->getSymbol(), rhs_range);
+				range = rhs_range;
+				return Integers.count(var->getSymbol()) != 0;
+			}
+			case BOP_ADD:
+			case BOP_SUB:
+			case BOP_MUL:
+			case BOP_REM:
+				integer = lhs && rhs;
+				break;
+			case BOP_DIV:
+				integer = false;
+				break;
+			case BOP_FLOOR_DIV:
+				integer = true;
+				break;
+			default:
+				break;
+		}
+		// 範囲を超えるかもしれない演算はdoubleで計算する (i64のオーバーフローや2^53を超えた時の丸めの違いを避ける)
+		range = getBinaryRange(bin_expr->getOp(), lhs_range, rhs_range);
+		integer = integer && isExactRange(range);
+		bin_expr->setInteger(integer);
+		return integer;
+	}
+	return false;
+}
+
+/**
+ * 変数を整数から外す
+ * @param 変数名の番号
+ */
+void TypeInference::setDouble(SymbolID symbol){
+	if(Integers.erase(symbol))
+		Changed = true;
+}
+
+/**
+ * 変数の範囲に代入する値の範囲を合わせる
+ * 何周も広がり続ける向きは無限にする (繰り返しで足していく変数など)
+ * ±2^53 に収まらなくなった変数は整数から外す
+ * @param 変数名の番号 代入する値の範囲
+ */
+void TypeInference::widenRange(SymbolID symbol, Range range){
+	llvm::DenseMap<SymbolID, Range>::iterator it = Ranges.find(symbol);
+	if(it == Ranges.end())
+		return;
+	Range &current = it->second;
+	Range next = {std::min(current.Low, range.Low), std::max(current.High, range.High)};
+	if(next.Low == current.Low && next.High == current.High)
+		return;
+
+	if(Grown.insert(symbol).second && ++Widens[symbol] > 2){
+		if(next.Low < current.Low)
+			next.Low = -HUGE_VAL;
+		if(next.High > current.High)
+			next.High = HUGE_VAL;
+	}
+	current = next;
+	Changed = true;
+	if(!isExactRange(current))
+		setDouble(symbol);
+}
+
+/**
+ * 分からない範囲を取得する
+ * @return 無限の範囲
+ */
+TypeInference::Range TypeInference::getUnknownRange(){
+	Range range = {-HUGE_VAL, HUGE_VAL};
+	return range;
+}
+
+/**
+ * 範囲の値がdoubleで正確に表せるか判定する
+ * @param 範囲
+ * @return 全て ±2^53 に収まる:true 収まらないかもしれない:false
+ */
+bool TypeInference::isExactRange(Range range){
+	return range.Low >= -9007199254740992.0 && range.High <= 9007199254740992.0;
+}
+
+/**
+ * 二項演算の結果の範囲を求める
+ * % は割られる数と同じ符号で、割る数の絶対値より小さい
+ * / と // は割る数の絶対値が1以上と分かる場合だけ割られる数の絶対値以下にする
+ * @param 演算子 左辺の範囲 右辺の範囲
+ * @return 結果の範囲
+ */
+TypeInference::Range TypeInference::getBinaryRange(BinaryOp op, Range lhs, Range rhs){
+	Range range = getUnknownRange();
+	switch(op){
+		case BOP_ADD:
+			range.Low = lhs.Low + rhs.Low;
+			range.High = lhs.High + rhs.High;
+			break;
+		case BOP_SUB:
+			range.Low = lhs.Low - rhs.High;
+			range.High = lhs.High - rhs.Low;
+			break;
+		case BOP_MUL:{
+			double bounds[4] = {
+				multiplyBound(lhs.Low, rhs.Low), multiplyBound(lhs.Low, rhs.High),
+				multiplyBound(lhs.High, rhs.Low), multiplyBound(lhs.High, rhs.High)
+			};
+			range.Low = *std::min_element(bounds, bounds + 4);
+			range.High = *std::max_element(bounds, bounds + 4);
+			break;
+		}
+		case BOP_REM:{
+			double divisor = std::max(std::fabs(rhs.Low), std::fabs(rhs.High));
+			range.Low = lhs.Low < 0 ? std::max(lhs.Low, -divisor) : 0;
+			range.High = lhs.High > 0 ? std::min(lhs.High, divisor) : 0;
+			break;
+		}
+		case BOP_DIV:
+		case BOP_FLOOR_DIV:
+			if(rhs.Low >= 1 || rhs.High <= -1){
+				double dividend = std::max(std::fabs(lhs.Low), std::fabs(lhs.High));
+				range.Low = -dividend;
+				range.High = dividend;
+			}
+			break;
+		default:
+			break;
+	}
+	return range;
+}
+
+/**
+ * 範囲の端同士の積 (0と無限の積は0にする)
+ * @param 左辺の端 右辺の端
+ * @return 積
+ */
+double TypeInference::multiplyBound(double lhs, double rhs){
+	if(lhs == 0 || rhs == 0)
+		return 0;
+	return lhs * rhs;
+}